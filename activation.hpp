@@ -2,6 +2,7 @@
 
 #include "config.h"
 
+#include "flash_io.hpp"
 #include "utils.hpp"
 #include "xyz/openbmc_project/Software/ActivationProgress/server.hpp"
 #include "xyz/openbmc_project/Software/ExtendedVersion/server.hpp"
@@ -166,7 +167,8 @@ class Activation : public ActivationInherit
                 sdbusRule::path("/org/freedesktop/systemd1") +
                 sdbusRule::interface("org.freedesktop.systemd1.Manager"),
             std::bind(std::mem_fn(&Activation::unitStateChange), this,
-                      std::placeholders::_1))
+                      std::placeholders::_1)),
+        flashIo(bus, path)
     {
         // Set Properties.
         extendedVersion(extVersion);
@@ -229,6 +231,9 @@ class Activation : public ActivationInherit
     /** @brief Used to subscribe to dbus systemd signals **/
     sdbusplus::bus::match_t systemdSignals;
 
+    /** @brief Flash I/O of the activations of this version */
+    FlashIoStatistics flashIo;
+
     /**
      * @brief Determine the configured image apply time value
      *
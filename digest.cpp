@@ -0,0 +1,86 @@
+#include "digest.hpp"
+
+#include <fcntl.h>
+#include <openssl/evp.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+using EVP_MD_CTX_Ptr =
+    std::unique_ptr<EVP_MD_CTX, decltype(&::EVP_MD_CTX_free)>;
+
+} // namespace
+
+std::string fileDigest(const fs::path& file)
+{
+    auto fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to open " + file.string());
+    }
+
+    EVP_MD_CTX_Ptr ctx(EVP_MD_CTX_new(), ::EVP_MD_CTX_free);
+    if (!ctx || EVP_DigestInit_ex(ctx.get(), EVP_sha256(), nullptr) != 1)
+    {
+        close(fd);
+        throw std::runtime_error("Failed to initialize SHA-256");
+    }
+
+    std::array<unsigned char, 64 * 1024> buffer;
+    while (true)
+    {
+        auto bytes = read(fd, buffer.data(), buffer.size());
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes < 0)
+        {
+            auto error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(),
+                                    "Failed to read " + file.string());
+        }
+        if (bytes == 0)
+        {
+            break;
+        }
+        EVP_DigestUpdate(ctx.get(), buffer.data(), bytes);
+    }
+    close(fd);
+
+    std::array<unsigned char, EVP_MAX_MD_SIZE> md;
+    unsigned int mdLen = 0;
+    EVP_DigestFinal_ex(ctx.get(), md.data(), &mdLen);
+
+    constexpr auto hexDigits = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(mdLen * 2);
+    for (unsigned int i = 0; i < mdLen; ++i)
+    {
+        hex += hexDigits[md[i] >> 4];
+        hex += hexDigits[md[i] & 0xf];
+    }
+    return hex;
+}
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+/** @brief Computes the SHA-256 digest of a file.
+ *
+ *  @param[in] file - The file to hash.
+ *  @return The lowercase hexadecimal digest, throws on failure.
+ */
+std::string fileDigest(const std::filesystem::path& file);
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
@@ -0,0 +1,199 @@
+#include "flash_io.hpp"
+
+#include <phosphor-logging/log.hpp>
+
+#include <cinttypes>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+using namespace phosphor::logging;
+namespace fs = std::filesystem;
+
+namespace
+{
+
+/** @brief Returns the sysfs directory of the MTD device with the given
+ *         name.
+ */
+fs::path mtdSysfs(const std::string& name)
+{
+    std::error_code ec;
+    for (const auto& dev : fs::directory_iterator("/sys/class/mtd", ec))
+    {
+        // Skip the read-only aliases (mtdXro) of the devices.
+        if (dev.path().filename().string().ends_with("ro"))
+        {
+            continue;
+        }
+        std::ifstream nameFile(dev.path() / "name");
+        std::string devName;
+        if (std::getline(nameFile, devName) && devName == name)
+        {
+            return dev.path();
+        }
+    }
+    return {};
+}
+
+/** @brief Reads an attribute of the MTD device with the given name. */
+uint64_t mtdAttribute(const std::string& name, const std::string& attribute)
+{
+    auto dev = mtdSysfs(name);
+    if (dev.empty())
+    {
+        return 0;
+    }
+    std::ifstream attributeFile(dev / attribute);
+    uint64_t value = 0;
+    attributeFile >> value;
+    return value;
+}
+
+} // namespace
+
+const sdbusplus::vtable::vtable_t FlashIoStatistics::vtable[] = {
+    sdbusplus::vtable::start(),
+    sdbusplus::vtable::property("BytesRead", "t", getProperty,
+                                sdbusplus::vtable::property_::emits_change),
+    sdbusplus::vtable::property("BytesWritten", "t", getProperty,
+                                sdbusplus::vtable::property_::emits_change),
+    sdbusplus::vtable::property("BytesErased", "t", getProperty,
+                                sdbusplus::vtable::property_::emits_change),
+    sdbusplus::vtable::property("PayloadBytes", "t", getProperty,
+                                sdbusplus::vtable::property_::emits_change),
+    sdbusplus::vtable::property("WriteAmplification", "d", getProperty,
+                                sdbusplus::vtable::property_::emits_change),
+    sdbusplus::vtable::property("Operations", "t", getProperty,
+                                sdbusplus::vtable::property_::emits_change),
+    sdbusplus::vtable::property("SuspendedUsec", "t", getProperty,
+                                sdbusplus::vtable::property_::emits_change),
+    sdbusplus::vtable::property("LastSuspendedUsec", "t", getProperty,
+                                sdbusplus::vtable::property_::emits_change),
+    sdbusplus::vtable::end()};
+
+FlashIoStatistics::FlashIoStatistics(sdbusplus::bus_t& bus,
+                                     const std::string& path) :
+    path(path), interface(bus, path.c_str(), FLASH_IO_INTERFACE, vtable, this)
+{
+    interface.emit_added();
+}
+
+FlashIoStatistics::~FlashIoStatistics()
+{
+    interface.emit_removed();
+}
+
+void FlashIoStatistics::record(const std::string& operation,
+                               const FlashIoCounts& op)
+{
+    counts += op;
+    ++count;
+    lastSuspended = op.suspended;
+
+    log<level::INFO>(
+        "Flash I/O", entry("OPERATION=%s", operation.c_str()),
+        entry("OBJECT_PATH=%s", path.c_str()),
+        entry("BYTES_READ=%" PRIu64, op.read),
+        entry("BYTES_WRITTEN=%" PRIu64, op.written),
+        entry("BYTES_ERASED=%" PRIu64, op.erased),
+        entry("PAYLOAD_BYTES=%" PRIu64, op.payload),
+        entry("SUSPENDED_USEC=%" PRId64,
+              static_cast<int64_t>(op.suspended.count())));
+
+    for (auto property :
+         {"BytesRead", "BytesWritten", "BytesErased", "PayloadBytes",
+          "WriteAmplification", "Operations", "SuspendedUsec",
+          "LastSuspendedUsec"})
+    {
+        interface.property_changed(property);
+    }
+}
+
+double FlashIoStatistics::writeAmplification() const
+{
+    if (counts.payload == 0)
+    {
+        return 0;
+    }
+    return static_cast<double>(counts.written) / counts.payload;
+}
+
+int FlashIoStatistics::getProperty(sd_bus*, const char*, const char*,
+                                   const char* property, sd_bus_message* reply,
+                                   void* context, sd_bus_error*)
+{
+    auto stats = static_cast<FlashIoStatistics*>(context);
+
+    if (strcmp(property, "WriteAmplification") == 0)
+    {
+        return sd_bus_message_append(reply, "d", stats->writeAmplification());
+    }
+
+    uint64_t value = 0;
+    if (strcmp(property, "BytesRead") == 0)
+    {
+        value = stats->counts.read;
+    }
+    else if (strcmp(property, "BytesWritten") == 0)
+    {
+        value = stats->counts.written;
+    }
+    else if (strcmp(property, "BytesErased") == 0)
+    {
+        value = stats->counts.erased;
+    }
+    else if (strcmp(property, "PayloadBytes") == 0)
+    {
+        value = stats->counts.payload;
+    }
+    else if (strcmp(property, "Operations") == 0)
+    {
+        value = stats->count;
+    }
+    else if (strcmp(property, "SuspendedUsec") == 0)
+    {
+        value = stats->counts.suspended.count();
+    }
+    else if (strcmp(property, "LastSuspendedUsec") == 0)
+    {
+        value = stats->lastSuspended.count();
+    }
+    return sd_bus_message_append(reply, "t", value);
+}
+
+fs::path mtdDevice(const std::string& name)
+{
+    auto dev = mtdSysfs(name);
+    if (dev.empty())
+    {
+        return {};
+    }
+    return fs::path("/dev") / dev.filename();
+}
+
+uint64_t mtdEraseSize(const std::string& name)
+{
+    return mtdAttribute(name, "erasesize");
+}
+
+uint64_t eraseFootprint(const std::string& name, uint64_t bytes)
+{
+    auto eraseSize = mtdEraseSize(name);
+    if (eraseSize == 0)
+    {
+        return bytes;
+    }
+    return (bytes + eraseSize - 1) / eraseSize * eraseSize;
+}
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
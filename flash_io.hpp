@@ -0,0 +1,152 @@
+#pragma once
+
+#include <sdbusplus/bus.hpp>
+#include <sdbusplus/server.hpp>
+#include <sdbusplus/vtable.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+/** @brief D-Bus interface holding the flash I/O statistics */
+constexpr auto FLASH_IO_INTERFACE = "org.open_power.Software.Host.FlashIO";
+
+/** @brief D-Bus path of the priority store flash I/O statistics */
+constexpr auto PRIORITY_STORE_PATH = "/org/open_power/control/priority_store";
+
+/** @struct FlashIoCounts
+ *  @brief Bytes moved to and from the PNOR flash by an operation.
+ */
+struct FlashIoCounts
+{
+    /** @brief Bytes read from the flash */
+    uint64_t read = 0;
+    /** @brief Bytes written to the flash */
+    uint64_t written = 0;
+    /** @brief Bytes erased on the flash */
+    uint64_t erased = 0;
+    /** @brief Bytes the operation had to store, e.g. the image size */
+    uint64_t payload = 0;
+    /** @brief Time the host access to the flash was suspended */
+    std::chrono::microseconds suspended{0};
+
+    FlashIoCounts& operator+=(const FlashIoCounts& other)
+    {
+        read += other.read;
+        written += other.written;
+        erased += other.erased;
+        payload += other.payload;
+        suspended += other.suspended;
+        return *this;
+    }
+};
+
+/** @class FlashIoStatistics
+ *  @brief Accumulates the flash I/O of the operations made on behalf of a
+ *         D-Bus object.
+ *  @details Exposes the org.open_power.Software.Host.FlashIO interface on
+ *  the object path (e.g. the activation of a version, or the software
+ *  manager for the factory resets) and writes a structured journal entry
+ *  per operation, so that layouts can be compared and regressions spotted.
+ */
+class FlashIoStatistics
+{
+  public:
+    FlashIoStatistics() = delete;
+    FlashIoStatistics(const FlashIoStatistics&) = delete;
+    FlashIoStatistics& operator=(const FlashIoStatistics&) = delete;
+    FlashIoStatistics(FlashIoStatistics&&) = delete;
+    FlashIoStatistics& operator=(FlashIoStatistics&&) = delete;
+
+    /** @brief Constructs FlashIoStatistics
+     *
+     * @param[in] bus  - The D-Bus bus object
+     * @param[in] path - The D-Bus object path
+     */
+    FlashIoStatistics(sdbusplus::bus_t& bus, const std::string& path);
+
+    ~FlashIoStatistics();
+
+    /** @brief Accounts the flash I/O of an operation.
+     *
+     * @param[in] operation - The name of the operation, e.g. "activation".
+     * @param[in] counts    - The bytes moved by the operation.
+     */
+    void record(const std::string& operation, const FlashIoCounts& counts);
+
+    /** @brief Returns the bytes moved by all the recorded operations. */
+    const FlashIoCounts& totals() const
+    {
+        return counts;
+    }
+
+    /** @brief Returns the number of recorded operations. */
+    uint64_t operations() const
+    {
+        return count;
+    }
+
+    /** @brief Returns the total bytes written over the total payload, or 0
+     *         when nothing was stored.
+     */
+    double writeAmplification() const;
+
+  private:
+    /** @brief The D-Bus interface description */
+    static const sdbusplus::vtable::vtable_t vtable[];
+
+    /** @brief sd-bus property getter callback */
+    static int getProperty(sd_bus* bus, const char* path, const char* intf,
+                           const char* property, sd_bus_message* reply,
+                           void* context, sd_bus_error* error);
+
+    /** @brief The D-Bus object path */
+    std::string path;
+
+    /** @brief Bytes moved by all the recorded operations */
+    FlashIoCounts counts;
+
+    /** @brief Number of recorded operations */
+    uint64_t count = 0;
+
+    /** @brief Suspend time of the last recorded operation */
+    std::chrono::microseconds lastSuspended{0};
+
+    /** @brief The D-Bus interface */
+    sdbusplus::server::interface_t interface;
+};
+
+/** @brief Returns the character device of an MTD device.
+ *
+ * @param[in] name - The MTD device name (e.g. "pnor").
+ * @return The device path (e.g. /dev/mtd6), or an empty path if the device
+ *         is not found.
+ */
+std::filesystem::path mtdDevice(const std::string& name);
+
+/** @brief Returns the erase block size in bytes of an MTD device.
+ *
+ * @param[in] name - The MTD device name (e.g. "pnor").
+ * @return The erase block size, or 0 if the device is not found.
+ */
+uint64_t mtdEraseSize(const std::string& name);
+
+/** @brief Rounds a byte count up to whole erase blocks of an MTD device.
+ *
+ * @param[in] name  - The MTD device name.
+ * @param[in] bytes - The bytes written.
+ * @return The bytes erased to write them.
+ */
+uint64_t eraseFootprint(const std::string& name, uint64_t bytes);
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
@@ -6,6 +6,12 @@
 
 #include "functions.hpp"
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <nlohmann/json.hpp>
 #include <phosphor-logging/log.hpp>
 #include <sdbusplus/bus.hpp>
@@ -15,13 +21,24 @@
 #include <sdeventplus/event.hpp>
 #include <xyz/openbmc_project/Common/error.hpp>
 
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <functional>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
 #include <variant>
 #include <vector>
 
@@ -38,6 +55,16 @@ using ManagedObjectType =
     std::map<sdbusplus::object_path, InterfacesPropertiesMap>;
 
 constexpr auto tocName = "pnor.toc";
+constexpr auto compatibleInterface =
+    "xyz.openbmc_project.Inventory.Decorator.Compatible";
+constexpr auto entityManagerService = "xyz.openbmc_project.EntityManager";
+constexpr auto inventoryPath = "/xyz/openbmc_project/inventory";
+
+/** @brief The Compatible names found in this boot, with the entity manager
+ *  instance that published them
+ */
+constexpr auto compatibleCacheFile =
+    "/run/openpower-update-manager/compatible-names";
 
 /**
  * @brief Returns the managed objects for a given service
@@ -65,6 +92,31 @@ ManagedObjectType getManagedObjects(sdbusplus::bus_t& bus,
     return objects;
 }
 
+/**
+ * @brief Returns the unique name owning a well-known bus name
+ *
+ * @return The unique name, std::nullopt if the name has no owner.
+ */
+std::optional<std::string> getNameOwner(sdbusplus::bus_t& bus,
+                                        const std::string& name)
+{
+    auto method = bus.new_method_call("org.freedesktop.DBus",
+                                      "/org/freedesktop/DBus",
+                                      "org.freedesktop.DBus", "GetNameOwner");
+    method.append(name);
+    try
+    {
+        auto reply = bus.call(method);
+        std::string owner;
+        reply.read(owner);
+        return owner;
+    }
+    catch (const sdbusplus::exception_t& e)
+    {
+        return std::nullopt;
+    }
+}
+
 /**
  * @brief Issue callbacks safely
  *
@@ -128,155 +180,710 @@ bool getExtensionsForIbmCompatibleSystem(
 }
 
 /**
- * @brief Write host firmware well-known name
+ * @brief Replace a symlink in a directory atomically
  *
- * A wrapper around std::filesystem::create_symlink that avoids EEXIST by
- * deleting any pre-existing file.
+ * The symlink is created under a temporary name and renamed over the link
+ * path, so the link path always names either its old file or the new link.
+ * A directory in the way is removed if it is empty.
  *
- * @param[in] linkTarget The link target argument to
- * std::filesystem::create_symlink
- * @param[in] linkPath The link path argument to std::filesystem::create_symlink
+ * @param[in] dirFd The directory holding the link.
+ * @param[in] linkTarget The link target.
+ * @param[in] linkName The link name in the directory.
+ * @param[in] linkPath The link path, reported to the error callback.
  * @param[in] errorCallback A callback made in the event of filesystem errors.
+ * @return true if the link was written, otherwise false
  */
-void writeLink(const std::filesystem::path& linkTarget,
-               const std::filesystem::path& linkPath,
-               const ErrorCallbackType& errorCallback)
+bool replaceLink(int dirFd, const std::string& linkTarget,
+                 const std::string& linkName,
+                 const std::filesystem::path& linkPath,
+                 const ErrorCallbackType& errorCallback)
 {
-    std::error_code ec;
+    auto tmpName = "." + linkName + ".tmp";
+    auto fail = [&](int error) {
+        std::error_code ec(error, std::generic_category());
+        makeCallback(errorCallback, linkPath, ec);
+        return false;
+    };
+
+    // A temporary link left over by an interrupted run is replaced.
+    if (symlinkat(linkTarget.c_str(), dirFd, tmpName.c_str()) < 0 &&
+        (errno != EEXIST || unlinkat(dirFd, tmpName.c_str(), 0) < 0 ||
+         symlinkat(linkTarget.c_str(), dirFd, tmpName.c_str()) < 0))
+    {
+        return fail(errno);
+    }
+    if (renameat(dirFd, tmpName.c_str(), dirFd, linkName.c_str()) == 0)
+    {
+        return true;
+    }
 
-    // remove files with the same name as the symlink to be created,
-    // otherwise symlink will fail with EEXIST.
-    if (!std::filesystem::remove(linkPath, ec))
+    auto error = errno;
+    if (error == EISDIR)
     {
-        if (ec)
+        error = 0;
+        if (unlinkat(dirFd, linkName.c_str(), AT_REMOVEDIR) < 0 ||
+            renameat(dirFd, tmpName.c_str(), dirFd, linkName.c_str()) < 0)
         {
-            makeCallback(errorCallback, linkPath, ec);
-            return;
+            error = errno;
         }
     }
+    if (error == 0)
+    {
+        return true;
+    }
+    unlinkat(dirFd, tmpName.c_str(), 0);
+    return fail(error);
+}
 
-    std::filesystem::create_symlink(linkTarget, linkPath, ec);
-    if (ec)
+/**
+ * @brief Read the entries of a directory and the targets of its symlinks
+ *
+ * The directory is read with getdents64, and readlinkat is only called for
+ * the symlinks.
+ *
+ * @param[in] dirFd The directory.
+ * @param[in] dir The directory path, reported to the error callback.
+ * @param[out] entries The entry names, mapped to their link target or to
+ * std::nullopt for an entry that is not a symlink.
+ * @param[in] errorCallback A callback made in the event of filesystem errors.
+ * @return true if the directory was read, otherwise false
+ */
+bool readLinkState(int dirFd, const std::filesystem::path& dir,
+                   LinkState& entries, const ErrorCallbackType& errorCallback)
+{
+    std::vector<char> buffer(32 * 1024);
+    while (true)
     {
-        makeCallback(errorCallback, linkPath, ec);
-        return;
+        auto bytes = getdents64(dirFd, buffer.data(), buffer.size());
+        if (bytes < 0)
+        {
+            std::error_code ec(errno, std::generic_category());
+            makeCallback(errorCallback, dir, ec);
+            return false;
+        }
+        if (bytes == 0)
+        {
+            return true;
+        }
+
+        for (ssize_t offset = 0; offset < bytes;)
+        {
+            const auto* dirEntry =
+                reinterpret_cast<const struct dirent64*>(&buffer[offset]);
+            offset += dirEntry->d_reclen;
+            std::string name = dirEntry->d_name;
+            if (name == "." || name == "..")
+            {
+                continue;
+            }
+
+            auto type = dirEntry->d_type;
+            struct stat st;
+            if (type == DT_UNKNOWN &&
+                fstatat(dirFd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0)
+            {
+                type = S_ISLNK(st.st_mode) ? DT_LNK : DT_REG;
+            }
+            std::optional<std::string> target;
+            if (type == DT_LNK)
+            {
+                std::array<char, PATH_MAX> link;
+                auto length = readlinkat(dirFd, name.c_str(), link.data(),
+                                         link.size());
+                target.emplace(length < 0 ? "" : std::string(link.data(),
+                                                             length));
+            }
+            entries.emplace(std::move(name), std::move(target));
+        }
+    }
+}
+
+/**
+ * @brief Bring the links of a directory in line with a desired link set
+ *
+ * Only the difference is applied: a link already pointing at its target is
+ * left untouched, a missing one is created and any other entry of that name
+ * is replaced atomically.
+ *
+ * @param[in] dirFd The directory.
+ * @param[in] dir The directory path, reported to the error callback.
+ * @param[in] current The current entries of the directory.
+ * @param[in] desired The link names, mapped to their target.
+ * @param[in] replaceFiles Whether an entry that is not a symlink is replaced,
+ * otherwise it is left untouched.
+ * @param[in] errorCallback A callback made in the event of filesystem errors.
+ * @return The number of links created, replaced and left untouched
+ */
+LinkStats applyLinks(int dirFd, const std::filesystem::path& dir,
+                     const LinkState& current,
+                     const std::map<std::string, std::string>& desired,
+                     bool replaceFiles, const ErrorCallbackType& errorCallback)
+{
+    LinkStats stats;
+    for (const auto& [linkName, linkTarget] : desired)
+    {
+        auto entryIt = current.find(linkName);
+        if (entryIt == current.end())
+        {
+            if (symlinkat(linkTarget.c_str(), dirFd, linkName.c_str()) == 0)
+            {
+                ++stats.created;
+            }
+            else if (errno != EEXIST)
+            {
+                std::error_code ec(errno, std::generic_category());
+                makeCallback(errorCallback, dir / linkName, ec);
+            }
+            else if (replaceLink(dirFd, linkTarget, linkName, dir / linkName,
+                                 errorCallback))
+            {
+                ++stats.replaced;
+            }
+            continue;
+        }
+
+        if (entryIt->second == linkTarget ||
+            (!entryIt->second && !replaceFiles))
+        {
+            ++stats.untouched;
+            continue;
+        }
+        if (replaceLink(dirFd, linkTarget, linkName, dir / linkName,
+                        errorCallback))
+        {
+            ++stats.replaced;
+        }
+    }
+
+    log<level::INFO>("Reconciled host firmware links",
+                     entry("DIR=%s", dir.c_str()),
+                     entry("CREATED=%zu", stats.created),
+                     entry("REPLACED=%zu", stats.replaced),
+                     entry("UNTOUCHED=%zu", stats.untouched));
+    return stats;
+}
+
+/**
+ * @brief Bring the links of a directory in line with a desired link set
+ *
+ * The directory is read once and only the difference is applied, see
+ * applyLinks.
+ *
+ * @param[in] dir The directory.
+ * @param[in] desired The link names, mapped to their target.
+ * @param[in] replaceFiles Whether an entry that is not a symlink is replaced,
+ * otherwise it is left untouched.
+ * @param[in] errorCallback A callback made in the event of filesystem errors.
+ * @return The number of links created, replaced and left untouched
+ */
+LinkStats reconcileLinks(const std::filesystem::path& dir,
+                         const std::map<std::string, std::string>& desired,
+                         bool replaceFiles,
+                         const ErrorCallbackType& errorCallback)
+{
+    auto dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0)
+    {
+        std::error_code ec(errno, std::generic_category());
+        makeCallback(errorCallback, dir, ec);
+        return {};
+    }
+
+    LinkStats stats;
+    LinkState current;
+    if (readLinkState(dirFd, dir, current, errorCallback))
+    {
+        stats = applyLinks(dirFd, dir, current, desired, replaceFiles,
+                           errorCallback);
     }
+    close(dirFd);
+    return stats;
 }
 
 /**
- * @brief Find host firmware blob files that need well-known names
+ * @brief Write the well-known names of the host firmware blob files
  *
  * The IBM host firmware runtime looks for data and/or additional code while
- * bootstrapping in files with well-known names. findLinks uses the provided
- * extensions argument to find host firmware blob files that require a
- * well-known name. When a blob is found, issue the provided callback
- * (typically a function that will write a symlink).
+ * bootstrapping in files with well-known names. A blob file whose extension
+ * is one of the provided extensions is linked to under its stem, and
+ * 81e00994.lid under pnor.toc. The directory is read once, with the targets
+ * of its symlinks, and only the links that are missing or point elsewhere
+ * are written, each replaced atomically.
  *
- * @param[in] hostFirmwareDirectory The directory in which findLinks should
- * look for host firmware blob files that need well-known names.
+ * @param[in] hostFirmwareDirectory The directory holding the host firmware
+ * blob files.
  * @param[in] extensions The extensions of the firmware blob files denote a
  * host firmware blob file requires a well-known name.
  * @param[in] errorCallback A callback made in the event of filesystem errors.
- * @param[in] linkCallback A callback made when host firmware blob files
- * needing a well known name are found.
+ * @return The number of links created, replaced and left untouched
  */
-void findLinks(const std::filesystem::path& hostFirmwareDirectory,
-               const std::vector<std::string>& extensions,
-               const ErrorCallbackType& errorCallback,
-               const LinkCallbackType& linkCallback)
+LinkStats writeLinks(const std::filesystem::path& hostFirmwareDirectory,
+                     const std::vector<std::string>& extensions,
+                     const ErrorCallbackType& errorCallback)
 {
-    std::error_code ec;
-    std::filesystem::directory_iterator directoryIterator(
-        hostFirmwareDirectory, ec);
-    if (ec)
+    auto dirFd = open(hostFirmwareDirectory.c_str(),
+                      O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0)
     {
+        std::error_code ec(errno, std::generic_category());
         makeCallback(errorCallback, hostFirmwareDirectory, ec);
-        return;
+        return {};
+    }
+
+    LinkState current;
+    if (!readLinkState(dirFd, hostFirmwareDirectory, current, errorCallback))
+    {
+        close(dirFd);
+        return {};
     }
 
+    std::map<std::string, std::string> desired;
+
     // Create a symlink for pnor.toc
     static const auto tocLid = "81e00994.lid";
-    auto tocLidPath = hostFirmwareDirectory / tocLid;
-    if (std::filesystem::exists(tocLidPath))
+    if (current.contains(tocLid))
+    {
+        desired.emplace(tocName, tocLid);
+    }
+
+    const std::unordered_set<std::string> extensionSet(extensions.begin(),
+                                                       extensions.end());
+    for (const auto& [name, target] : current)
+    {
+        // Same as std::filesystem::path::extension, a leading dot does not
+        // start an extension.
+        auto dot = name.rfind('.');
+        if (dot == std::string::npos || dot == 0 ||
+            !extensionSet.contains(name.substr(dot)))
+        {
+            continue;
+        }
+        desired.emplace(name.substr(0, dot), name);
+    }
+
+    auto stats = applyLinks(dirFd, hostFirmwareDirectory, current, desired,
+                            true, errorCallback);
+    close(dirFd);
+    return stats;
+}
+
+/**
+ * @brief Split a file name into its stem and its extension, as
+ * std::filesystem::path::stem and extension do
+ */
+std::pair<std::string_view, std::string_view>
+    splitExtension(std::string_view name)
+{
+    auto dot = name.rfind('.');
+    if (dot == std::string_view::npos || dot == 0)
+    {
+        return {name, {}};
+    }
+    return {name.substr(0, dot), name.substr(dot)};
+}
+
+/** @brief Extension of the elements loaded at IPL time, ex: A.P10.iplTime */
+constexpr std::string_view iplExtension = ".iplTime";
+
+/**
+ * @brief SAX handler collecting the lids of the elements json file
+ *
+ * Only the element_name and short_lid_name of the objects of the top level
+ * lids array are kept, and only for the elements getBiosAttrStr uses with
+ * the extensions of this system, so no document is built.
+ */
+class ElementsSax : public nlohmann::json_sax<nlohmann::json>
+{
+  public:
+    ElementsSax(const std::vector<std::string>& extensions,
+                HostFirmwareElements& elements) :
+        extensions(extensions.begin(), extensions.end()), elements(elements)
+    {}
+
+    bool null() override
+    {
+        return true;
+    }
+
+    bool boolean(bool) override
+    {
+        return true;
+    }
+
+    bool number_integer(number_integer_t) override
+    {
+        return true;
+    }
+
+    bool number_unsigned(number_unsigned_t) override
+    {
+        return true;
+    }
+
+    bool number_float(number_float_t, const string_t&) override
     {
-        auto tocLinkPath = hostFirmwareDirectory / tocName;
-        makeCallback(linkCallback, tocLid, tocLinkPath, errorCallback);
+        return true;
     }
 
-    for (; directoryIterator != std::filesystem::end(directoryIterator);
-         directoryIterator.increment(ec))
+    bool string(string_t& val) override
     {
-        const auto& file = directoryIterator->path();
-        if (ec)
+        if (inLids && depth == elementDepth)
         {
-            makeCallback(errorCallback, file, ec);
-            // quit here if the increment call failed otherwise the loop may
-            // never finish
-            break;
+            if (currentKey == "element_name")
+            {
+                name = std::move(val);
+            }
+            else if (currentKey == "short_lid_name")
+            {
+                lid = std::move(val);
+            }
         }
+        return true;
+    }
+
+    bool binary(binary_t&) override
+    {
+        return true;
+    }
 
-        if (std::find(extensions.begin(), extensions.end(), file.extension()) ==
-            extensions.end())
+    bool start_object(std::size_t) override
+    {
+        ++depth;
+        if (inLids && depth == elementDepth)
         {
-            // this file doesn't have an extension or doesn't match any of the
-            // provided extensions.
-            continue;
+            name.reset();
+            lid.reset();
+        }
+        return true;
+    }
+
+    bool key(string_t& val) override
+    {
+        if (depth == 1 || depth == elementDepth)
+        {
+            currentKey = std::move(val);
+        }
+        return true;
+    }
+
+    bool end_object() override
+    {
+        if (inLids && depth == elementDepth)
+        {
+            if (!name || !lid)
+            {
+                // Possibly the element or lid name field was not found
+                log<level::ERR>("Error reading JSON field",
+                                entry("ELEMENT=%s", name ? name->c_str() : ""));
+            }
+            else if (wanted(*name))
+            {
+                elements.emplace_back(std::move(*name), std::move(*lid));
+            }
+        }
+        --depth;
+        return true;
+    }
+
+    bool start_array(std::size_t) override
+    {
+        ++depth;
+        if (depth == elementDepth - 1 && currentKey == "lids")
+        {
+            inLids = true;
+        }
+        return true;
+    }
+
+    bool end_array() override
+    {
+        if (depth == elementDepth - 1)
+        {
+            inLids = false;
+        }
+        --depth;
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&,
+                     const nlohmann::detail::exception&) override
+    {
+        return false;
+    }
+
+  private:
+    /** @brief The depth of the element objects: root, lids array, element */
+    static constexpr size_t elementDepth = 3;
+
+    /**
+     * @brief Whether getBiosAttrStr uses an element on this system: it has
+     * no extension, or one of the system, possibly followed by the ipl
+     * extension.
+     */
+    bool wanted(std::string_view elementName) const
+    {
+        auto [stem, extension] = splitExtension(elementName);
+        if (extension == iplExtension)
+        {
+            extension = splitExtension(stem).second;
         }
+        return extension.empty() ||
+               extensions.contains(std::string(extension));
+    }
+
+    std::unordered_set<std::string> extensions;
+    HostFirmwareElements& elements;
+    size_t depth = 0;
+    bool inLids = false;
+    std::string currentKey;
+    std::optional<std::string> name;
+    std::optional<std::string> lid;
+};
+
+/** @brief Identifies the version of the elements cache file format */
+constexpr uint32_t elementsCacheMagic = 0x48464531; // "HFE1"
+
+/** @brief Key of the elements cache: the json file and the extensions */
+struct ElementsCacheKey
+{
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t hash = 0;
+    std::vector<std::string> extensions;
+
+    bool operator==(const ElementsCacheKey&) const = default;
+};
+
+/** @brief Returns the FNV-1a hash of a string. */
+uint64_t fnv1a(std::string_view data)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (auto c : data)
+    {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3;
+    }
+    return hash;
+}
+
+/** @brief Appends an integer to a cache in host byte order. */
+template <typename T>
+void putCacheValue(std::string& out, T value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
 
-        auto linkPath(file.parent_path().append(
-            static_cast<const std::string&>(file.stem())));
+/** @brief Appends a length prefixed string to a cache. */
+void putCacheString(std::string& out, std::string_view value)
+{
+    putCacheValue<uint32_t>(out, value.size());
+    out.append(value);
+}
 
-        makeCallback(linkCallback, file.filename(), linkPath, errorCallback);
+/** @brief Reads an integer of a cache, false past its end. */
+template <typename T>
+bool getCacheValue(std::string_view& in, T& value)
+{
+    if (in.size() < sizeof(value))
+    {
+        return false;
     }
+    std::memcpy(&value, in.data(), sizeof(value));
+    in.remove_prefix(sizeof(value));
+    return true;
+}
+
+/** @brief Reads a length prefixed string of a cache, false past its end. */
+bool getCacheString(std::string_view& in, std::string& value)
+{
+    uint32_t size = 0;
+    if (!getCacheValue(in, size) || in.size() < size)
+    {
+        return false;
+    }
+    value.assign(in.substr(0, size));
+    in.remove_prefix(size);
+    return true;
+}
+
+/** @brief Reads the elements of a cache file if its key matches. */
+std::optional<HostFirmwareElements>
+    loadElementsCache(const std::filesystem::path& cachePath,
+                      const ElementsCacheKey& key)
+{
+    std::ifstream cacheFile(cachePath, std::ios::binary);
+    std::string data{std::istreambuf_iterator<char>(cacheFile),
+                     std::istreambuf_iterator<char>()};
+    std::string_view in(data);
+
+    uint32_t magic = 0;
+    uint32_t count = 0;
+    ElementsCacheKey cachedKey;
+    if (!getCacheValue(in, magic) || magic != elementsCacheMagic ||
+        !getCacheValue(in, cachedKey.size) ||
+        !getCacheValue(in, cachedKey.mtime) ||
+        !getCacheValue(in, cachedKey.hash) || !getCacheValue(in, count))
+    {
+        return std::nullopt;
+    }
+    cachedKey.extensions.resize(std::min<size_t>(count, in.size()));
+    for (auto& extension : cachedKey.extensions)
+    {
+        if (!getCacheString(in, extension))
+        {
+            return std::nullopt;
+        }
+    }
+    if (cachedKey != key || !getCacheValue(in, count))
+    {
+        return std::nullopt;
+    }
+
+    HostFirmwareElements elements(std::min<size_t>(count, in.size()));
+    for (auto& [name, lid] : elements)
+    {
+        if (!getCacheString(in, name) || !getCacheString(in, lid))
+        {
+            return std::nullopt;
+        }
+    }
+    if (!in.empty())
+    {
+        return std::nullopt;
+    }
+    return elements;
+}
+
+/** @brief Writes a cache file, replacing it in a single rename. */
+void saveElementsCache(const std::filesystem::path& cachePath,
+                       const ElementsCacheKey& key,
+                       const HostFirmwareElements& elements)
+{
+    std::string out;
+    putCacheValue(out, elementsCacheMagic);
+    putCacheValue(out, key.size);
+    putCacheValue(out, key.mtime);
+    putCacheValue(out, key.hash);
+    putCacheValue<uint32_t>(out, key.extensions.size());
+    for (const auto& extension : key.extensions)
+    {
+        putCacheString(out, extension);
+    }
+    putCacheValue<uint32_t>(out, elements.size());
+    for (const auto& [name, lid] : elements)
+    {
+        putCacheString(out, name);
+        putCacheString(out, lid);
+    }
+
+    std::error_code ec;
+    auto tmpPath = cachePath;
+    tmpPath += ".tmp";
+    std::filesystem::create_directories(cachePath.parent_path(), ec);
+    std::ofstream cacheFile(tmpPath, std::ios::binary | std::ios::trunc);
+    cacheFile.write(out.data(), out.size());
+    cacheFile.close();
+    if (!cacheFile)
+    {
+        std::filesystem::remove(tmpPath, ec);
+        return;
+    }
+    std::filesystem::rename(tmpPath, cachePath, ec);
 }
 
 /**
- * @brief Parse the elements json file and construct a string with the data to
- *        be used to update the bios attribute table.
+ * @brief Parse the elements json file
  *
- * @param[in] elementsJsonFilePath - The path to the host firmware json file.
+ * The file is streamed through a SAX parser which keeps, in file order, the
+ * lids of the elements that apply to the given extensions.
+ *
+ * @param[in] elementsJson - The content of the host firmware json file.
  * @param[in] extensions - The extensions of the firmware blob files.
+ * @param[out] elements - The element names and their lid.
+ * @return false if the json is not valid
  */
-std::string getBiosAttrStr(const std::filesystem::path& elementsJsonFilePath,
-                           const std::vector<std::string>& extensions)
+bool parseElements(std::string_view elementsJson,
+                   const std::vector<std::string>& extensions,
+                   HostFirmwareElements& elements)
 {
-    std::string biosAttrStr{};
+    ElementsSax sax(extensions, elements);
+    return nlohmann::json::sax_parse(elementsJson, &sax);
+}
 
-    std::ifstream jsonFile(elementsJsonFilePath.c_str());
+/**
+ * @brief Read the elements of the elements json file that apply to the
+ * given extensions
+ *
+ * The elements are read from a binary cache file when its key matches the
+ * size, modification time and hash of the json file and the extensions,
+ * otherwise the json is parsed and the cache written.
+ *
+ * @param[in] elementsJsonFilePath - The path to the host firmware json file.
+ * @param[in] extensions - The extensions of the firmware blob files.
+ * @param[in] cachePath - The path to the cache file.
+ * @return The element names and their lid, std::nullopt if the json file
+ * cannot be read or parsed
+ */
+std::optional<HostFirmwareElements>
+    readElements(const std::filesystem::path& elementsJsonFilePath,
+                 const std::vector<std::string>& extensions,
+                 const std::filesystem::path& cachePath)
+{
+    std::ifstream jsonFile(elementsJsonFilePath.c_str(), std::ios::binary);
     if (!jsonFile)
     {
-        return {};
+        return std::nullopt;
+    }
+    std::string elementsJson{std::istreambuf_iterator<char>(jsonFile),
+                             std::istreambuf_iterator<char>()};
+
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(elementsJsonFilePath, ec);
+    ElementsCacheKey key{
+        elementsJson.size(),
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            mtime.time_since_epoch())
+            .count(),
+        fnv1a(elementsJson), extensions};
+    if (auto elements = loadElementsCache(cachePath, key))
+    {
+        return elements;
     }
 
-    std::map<std::string, std::string> attr;
-    auto data = nlohmann::json::parse(jsonFile, nullptr, false);
-    if (data.is_discarded())
+    HostFirmwareElements elements;
+    if (!parseElements(elementsJson, extensions, elements))
     {
         log<level::ERR>("Error parsing JSON file",
                         entry("FILE=%s", elementsJsonFilePath.c_str()));
-        return {};
+        return std::nullopt;
     }
+    saveElementsCache(cachePath, key, elements);
+    return elements;
+}
 
-    // .get requires a non-const iterator
-    for (auto& iter : data["lids"])
-    {
-        std::string name{};
-        std::string lid{};
+/**
+ * @brief Parse the elements json file and construct a string with the data to
+ *        be used to update the bios attribute table.
+ *
+ * @param[in] elementsJsonFilePath - The path to the host firmware json file.
+ * @param[in] extensions - The extensions of the firmware blob files.
+ */
+std::string getBiosAttrStr(const std::filesystem::path& elementsJsonFilePath,
+                           const std::vector<std::string>& extensions)
+{
+    std::string biosAttrStr{};
 
-        try
-        {
-            name = iter["element_name"].get<std::string>();
-            lid = iter["short_lid_name"].get<std::string>();
-        }
-        catch (const std::exception& e)
-        {
-            // Possibly the element or lid name field was not found
-            log<level::ERR>("Error reading JSON field",
-                            entry("FILE=%s", elementsJsonFilePath.c_str()),
-                            entry("ERROR=%s", e.what()));
-            continue;
-        }
+    auto elements = readElements(elementsJsonFilePath, extensions,
+                                 PERSIST_DIR "hostfw-elements.cache");
+    if (!elements)
+    {
+        return {};
+    }
 
+    // The elements were filtered with the extensions of this system while
+    // parsing.
+    std::map<std::string, std::string, std::less<>> attr;
+    for (const auto& [name, lid] : *elements)
+    {
         // The elements with the ipl extension have higher priority. Therefore
         // Use operator[] to overwrite value if an entry for it already exists,
         // and create a second entry with key name element_RT to specify it as
@@ -285,33 +892,18 @@ std::string getBiosAttrStr(const std::filesystem::path& elementsJsonFilePath,
         // and try A=X. If the JSON also contained an entry A.P10.iplTime with
         // lid name Y, the A entry would be overwritten to be A=Y and a second
         // entry A_RT=X would be created.
-        constexpr auto iplExtension = ".iplTime";
         constexpr auto runtimeSuffix = "_RT";
-        std::filesystem::path path(name);
-        if (path.extension() == iplExtension)
+        auto [stem, extension] = splitExtension(name);
+        if (extension == iplExtension)
         {
-            // Some elements have an additional extension, ex: .P10.iplTime
-            // Strip off the ipl extension with stem(), then check if there is
-            // an additional extension with extension().
-            if (!path.stem().extension().empty())
-            {
-                // Check if the extension matches the extensions for this system
-                if (std::find(extensions.begin(), extensions.end(),
-                              path.stem().extension()) == extensions.end())
-                {
-                    continue;
-                }
-            }
-            // Get the element name without extensions by calling stem() twice
-            // since stem() returns the base name if no periods are found.
-            // Therefore both "element.P10" and "element.P10.iplTime" would
-            // become "element".
-            auto keyName = path.stem().stem();
+            // Get the element name without extensions, both "element.P10" and
+            // "element.P10.iplTime" become "element".
+            std::string keyName(splitExtension(stem).first);
             auto attrIt = attr.find(keyName);
             if (attrIt != attr.end())
             {
                 // Copy the existing entry to a runtime entry
-                auto runtimeKeyName = keyName.string() + runtimeSuffix;
+                auto runtimeKeyName = keyName + runtimeSuffix;
                 attr.insert({runtimeKeyName, attrIt->second});
             }
             // Overwrite the existing element with the ipl entry
@@ -319,14 +911,13 @@ std::string getBiosAttrStr(const std::filesystem::path& elementsJsonFilePath,
             continue;
         }
 
-        // Process all other extensions. The extension should match the list of
-        // supported extensions for this system. Use .insert() to only add
-        // entries that do not exist, so to not overwrite the values that may
-        // had been added that had the ipl extension.
-        if (std::find(extensions.begin(), extensions.end(), path.extension()) !=
-            extensions.end())
+        // Process the elements with one of the supported extensions for this
+        // system. Use .insert() to only add entries that do not exist, so to
+        // not overwrite the values that may had been added that had the ipl
+        // extension.
+        if (!extension.empty())
         {
-            auto keyName = path.stem();
+            std::string keyName(stem);
             auto attrIt = attr.find(keyName);
             if (attrIt != attr.end())
             {
@@ -336,70 +927,45 @@ std::string getBiosAttrStr(const std::filesystem::path& elementsJsonFilePath,
                 // extension check.
                 if (attrIt->second != lid)
                 {
-                    auto runtimeKeyName = keyName.string() + runtimeSuffix;
+                    auto runtimeKeyName = keyName + runtimeSuffix;
                     attr.insert({runtimeKeyName, lid});
                 }
             }
             else
             {
-                attr.insert({path.stem(), lid});
+                attr.insert({keyName, lid});
             }
+            continue;
         }
 
         // Process elements that have no extensions. Only add entries that do
         // not already exist. A runtime entry may had already been created.
-        if (path.extension().empty())
-        {
-            auto keyName = path.filename();
-            auto attrIt = attr.find(keyName);
-            if (attrIt == attr.end())
-            {
-                attr.insert({keyName, lid});
-            }
-        }
+        attr.try_emplace(name, lid);
     }
+    std::map<std::string, std::string> links;
     for (const auto& a : attr)
     {
         // Build the bios attribute string with format:
         // "element1=lid1,element2=lid2,elementN=lidN,"
         biosAttrStr += a.first + "=" + a.second + ",";
 
-        std::error_code ec;
-        auto lidName = a.second + ".lid";
-        auto elementFilePath =
-            std::filesystem::path("/media/hostfw/running") / a.first;
-
-        // Remove the symlink if the target does not match so that it gets
-        // recreated. Ignore pnor.toc, this symlink is manually created by the
-        // function findLinks().
-        if ((a.first != tocName) &&
-            std::filesystem::is_symlink(elementFilePath, ec))
-        {
-            auto target = std::filesystem::read_symlink(elementFilePath, ec);
-            if (target != lidName)
-            {
-                log<level::INFO>("Removing mismatched symlilnk",
-                                 entry("LINK=%s", elementFilePath.c_str()),
-                                 entry("TARGET=%s", target.c_str()),
-                                 entry("EXPECTED:%s", lidName.c_str()));
-                std::filesystem::remove(elementFilePath, ec);
-            }
-        }
-
-        // Create symlinks from the hostfw elements to their corresponding
-        // lid files if they don't exist
-        if (!std::filesystem::exists(elementFilePath))
+        // Link the hostfw elements to their corresponding lid files. Ignore
+        // pnor.toc, this symlink is created by the function writeLinks().
+        if (a.first != tocName)
         {
-            std::filesystem::create_symlink(lidName, elementFilePath, ec);
-            if (ec)
-            {
-                log<level::ERR>("Error creating symlink",
-                                entry("TARGET=%s", lidName.c_str()),
-                                entry("LINK=%s", elementFilePath.c_str()));
-            }
+            links.emplace(a.first, a.second + ".lid");
         }
     }
 
+    // Only the links that are missing or point at another lid are written,
+    // files of the same name are left alone.
+    auto logCallback = [](const auto& path, auto& ec) {
+        log<level::ERR>("Error creating symlink",
+                        entry("LINK=%s", path.c_str()),
+                        entry("ERROR=%s", ec.message().c_str()));
+    };
+    reconcileLinks("/media/hostfw/running", links, false, logCallback);
+
     // Delete the last comma of the bios attribute string
     if (biosAttrStr.back() == ',')
     {
@@ -409,16 +975,65 @@ std::string getBiosAttrStr(const std::filesystem::path& elementsJsonFilePath,
     return biosAttrStr;
 }
 
+/**
+ * @brief Get the value a string bios attribute will have: its pending value
+ * if it has one, otherwise its current value.
+ *
+ * @param[in] bus - The D-Bus connection.
+ * @param[in] service - The BIOS config manager service.
+ * @param[in] path - The BIOS config manager path.
+ * @param[in] intf - The BIOS config manager interface.
+ * @param[in] name - The attribute name.
+ * @return The value, std::nullopt if it cannot be read
+ */
+std::optional<std::string> getBiosAttr(sdbusplus::bus_t& bus,
+                                       const std::string& service,
+                                       const char* path, const char* intf,
+                                       const char* name)
+{
+    using AttributeValueType = std::variant<int64_t, std::string>;
+    std::string type;
+    AttributeValueType currentValue;
+    AttributeValueType pendingValue;
+    try
+    {
+        auto method = bus.new_method_call(service.c_str(), path, intf,
+                                          "GetAttribute");
+        method.append(name);
+        auto reply = bus.call(method);
+        reply.read(type, currentValue, pendingValue);
+    }
+    catch (const sdbusplus::exception_t& e)
+    {
+        // The attribute may not exist yet
+        return std::nullopt;
+    }
+
+    if (auto pending = std::get_if<std::string>(&pendingValue);
+        pending && !pending->empty())
+    {
+        return *pending;
+    }
+    if (auto current = std::get_if<std::string>(&currentValue))
+    {
+        return *current;
+    }
+    return std::nullopt;
+}
+
 /**
  * @brief Set the bios attribute table with details of the host firmware data
  * for this system.
  *
+ * @param[in] bus - The D-Bus connection.
  * @param[in] elementsJsonFilePath - The path to the host firmware json file.
  * @param[in] extensions - The extensions of the firmware blob files.
  */
-void setBiosAttr(const std::filesystem::path& elementsJsonFilePath,
+void setBiosAttr(sdbusplus::bus_t& bus,
+                 const std::filesystem::path& elementsJsonFilePath,
                  const std::vector<std::string>& extensions)
 {
+    auto start = std::chrono::steady_clock::now();
     auto biosAttrStr = getBiosAttrStr(elementsJsonFilePath, extensions);
 
     constexpr auto biosConfigPath = "/xyz/openbmc_project/bios_config/manager";
@@ -433,7 +1048,6 @@ void setBiosAttr(const std::filesystem::path& elementsJsonFilePath,
     pendingAttributes.emplace_back(std::make_pair(
         dbusAttrName, std::make_tuple(dbusAttrType, biosAttrStr)));
 
-    auto bus = sdbusplus::bus::new_default();
     auto method = bus.new_method_call(MAPPER_BUSNAME, MAPPER_PATH,
                                       MAPPER_INTERFACE, "GetObject");
     method.append(biosConfigPath, std::vector<std::string>({biosConfigIntf}));
@@ -450,8 +1064,24 @@ void setBiosAttr(const std::filesystem::path& elementsJsonFilePath,
             throw sdbusplus::xyz::openbmc_project::Common::Error::
                 InternalFailure();
         }
-        auto method = bus.new_method_call((response.begin()->first).c_str(),
-                                          biosConfigPath,
+        const auto& service = response.begin()->first;
+
+        // Setting the attribute has PLDM regenerate the BIOS tables, skip it
+        // when the attribute already holds the value, or is pending with it.
+        if (getBiosAttr(bus, service, biosConfigPath, biosConfigIntf,
+                        dbusAttrName) == biosAttrStr)
+        {
+            auto elapsed = std::chrono::duration_cast<
+                std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start);
+            log<level::INFO>("The bios attribute is up to date",
+                             entry("ATTRIBUTE=%s", dbusAttrName),
+                             entry("ELAPSED_MS=%lld",
+                                   static_cast<long long>(elapsed.count())));
+            return;
+        }
+
+        auto method = bus.new_method_call(service.c_str(), biosConfigPath,
                                           SYSTEMD_PROPERTY_INTERFACE, "Set");
         method.append(biosConfigIntf, "PendingAttributes",
                       std::variant<PendingAttributesType>(pendingAttributes));
@@ -464,6 +1094,13 @@ void setBiosAttr(const std::filesystem::path& elementsJsonFilePath,
                          entry("ATTRIBUTE=%s", dbusAttrName));
         throw;
     }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    log<level::INFO>("Set the bios attribute",
+                     entry("ATTRIBUTE=%s", dbusAttrName),
+                     entry("ELAPSED_MS=%lld",
+                           static_cast<long long>(elapsed.count())));
 }
 
 /**
@@ -527,6 +1164,34 @@ bool maybeCall(
     return true;
 }
 
+/**
+ * @brief Save the names of the
+ * xyz.openbmc_project.Inventory.Decorator.Compatible instance found, if any.
+ *
+ * @param[in] cachePath The file caching the names.
+ * @param[in] owner The unique bus name of the entity manager that published
+ * the names.
+ * @param[in] interfacesAndProperties The interfaces in which to look for the
+ * names.
+ */
+void maybeSaveCompatibleNames(
+    const std::filesystem::path& cachePath, const std::string& owner,
+    const InterfacesPropertiesMap& interfacesAndProperties)
+{
+    auto interface = interfacesAndProperties.find(compatibleInterface);
+    if (interface == interfacesAndProperties.end())
+    {
+        return;
+    }
+    if (auto names = interface->second.find("Names");
+        names != interface->second.end())
+    {
+        saveCompatibleNames(
+            cachePath, owner,
+            std::get<std::vector<std::string>>(names->second));
+    }
+}
+
 /**
  * @brief Make callbacks on
  * xyz.openbmc_project.Inventory.Decorator.Compatible instances.
@@ -549,9 +1214,181 @@ bool maybeCallMessage(sdbusplus::message_t& message,
         interfacesAndProperties;
     sdbusplus::object_path _;
     message.read(_, interfacesAndProperties);
+
+    // Remember the names for the later lookups of this boot, as long as the
+    // entity manager instance that sent them runs.
+    maybeSaveCompatibleNames(compatibleCacheFile, message.get_sender(),
+                             interfacesAndProperties);
     return maybeCall(interfacesAndProperties, callback);
 }
 
+/**
+ * @brief Read the xyz.openbmc_project.Inventory.Decorator.Compatible names
+ * saved by saveCompatibleNames.
+ *
+ * The names are only trusted if entity manager was not restarted since, it
+ * may publish other names then.
+ *
+ * @param[in] cachePath The file holding the names, one per line.
+ * @param[in] owner The unique bus name of the running entity manager.
+ * @return The names, std::nullopt if the file does not exist or was saved
+ * for another entity manager instance.
+ */
+std::optional<std::vector<std::string>>
+    loadCompatibleNames(const std::filesystem::path& cachePath,
+                        const std::string& owner)
+{
+    std::ifstream cache(cachePath);
+    std::string savedOwner;
+    if (!std::getline(cache, savedOwner) || savedOwner != owner)
+    {
+        return std::nullopt;
+    }
+
+    std::vector<std::string> names;
+    std::string name;
+    while (std::getline(cache, name))
+    {
+        names.push_back(std::move(name));
+    }
+    return names;
+}
+
+/**
+ * @brief Save the xyz.openbmc_project.Inventory.Decorator.Compatible names.
+ *
+ * The file is written aside and renamed, a concurrent reader sees all of the
+ * names or none. Errors are ignored, the names are looked up again then.
+ *
+ * @param[in] cachePath The file holding the names, one per line.
+ * @param[in] owner The unique bus name of the entity manager that published
+ * the names, written first.
+ * @param[in] names The names.
+ */
+void saveCompatibleNames(const std::filesystem::path& cachePath,
+                         const std::string& owner,
+                         const std::vector<std::string>& names)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(cachePath.parent_path(), ec);
+    auto tmpPath = cachePath;
+    tmpPath += ".tmp";
+    {
+        std::ofstream cache(tmpPath, std::ios::out | std::ios::trunc);
+        cache << owner << '\n';
+        for (const auto& name : names)
+        {
+            cache << name << '\n';
+        }
+        cache.close();
+        if (!cache)
+        {
+            std::filesystem::remove(tmpPath, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(tmpPath, cachePath, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tmpPath, ec);
+    }
+}
+
+/**
+ * @brief Look up the xyz.openbmc_project.Inventory.Decorator.Compatible
+ * instance of entity manager.
+ *
+ * The names found earlier in this boot are read from the cache, if the same
+ * entity manager instance still runs. Otherwise the mapper is asked for the
+ * inventory objects implementing the interface, and only the Names property
+ * of the entity manager ones is read, instead of enumerating the whole
+ * inventory. The mapper indexes entity manager asynchronously, so if it
+ * knows of no such object yet the inventory of entity manager is read
+ * directly. The names found are cached.
+ *
+ * @param[in] bus a DBus client connection
+ * @param[in] cachePath The file caching the names.
+ * @return The interface and its Names property in the form maybeCall takes,
+ * empty if entity manager has not published the interface yet.
+ */
+InterfacesPropertiesMap getCompatible(sdbusplus::bus_t& bus,
+                                      const std::filesystem::path& cachePath)
+{
+    InterfacesPropertiesMap interfacesAndProperties;
+    auto owner = getNameOwner(bus, entityManagerService);
+    if (!owner)
+    {
+        // Entity manager isn't running, the InterfacesAdded match sees the
+        // interface once it does.
+        return interfacesAndProperties;
+    }
+    if (auto names = loadCompatibleNames(cachePath, *owner))
+    {
+        interfacesAndProperties[compatibleInterface]["Names"] =
+            std::move(*names);
+        return interfacesAndProperties;
+    }
+
+    std::map<std::string, std::map<std::string, std::vector<std::string>>>
+        objects;
+    try
+    {
+        auto method = bus.new_method_call(MAPPER_BUSNAME, MAPPER_PATH,
+                                          MAPPER_INTERFACE, "GetSubTree");
+        method.append(inventoryPath, 0,
+                      std::vector<std::string>{compatibleInterface});
+        auto reply = bus.call(method);
+        reply.read(objects);
+    }
+    catch (const sdbusplus::exception_t& e)
+    {
+        // The mapper fails the call when no object implements the interface.
+    }
+
+    auto found = std::find_if(objects.begin(), objects.end(),
+                              [](const auto& object) {
+        return object.second.contains(entityManagerService);
+    });
+    if (found != objects.end())
+    {
+        std::variant<std::vector<std::string>> names;
+        try
+        {
+            auto method = bus.new_method_call(
+                entityManagerService, found->first.c_str(),
+                "org.freedesktop.DBus.Properties", "Get");
+            method.append(compatibleInterface, "Names");
+            auto reply = bus.call(method);
+            reply.read(names);
+        }
+        catch (const sdbusplus::exception_t& e)
+        {
+            // The interface exists but the property doesn't, leave it to
+            // maybeCall to report.
+            interfacesAndProperties[compatibleInterface];
+            return interfacesAndProperties;
+        }
+        interfacesAndProperties[compatibleInterface]["Names"] =
+            std::move(names);
+    }
+    else
+    {
+        for (auto& [path, interfaces] :
+             getManagedObjects(bus, entityManagerService, inventoryPath))
+        {
+            if (auto interface = interfaces.find(compatibleInterface);
+                interface != interfaces.end())
+            {
+                interfacesAndProperties.insert(std::move(*interface));
+                break;
+            }
+        }
+    }
+
+    maybeSaveCompatibleNames(cachePath, *owner, interfacesAndProperties);
+    return interfacesAndProperties;
+}
+
 /**
  * @brief Determine system support for host firmware well-known names.
  *
@@ -562,7 +1399,7 @@ bool maybeCallMessage(sdbusplus::message_t& message,
  * @param[in] extensionMap a map of
  * xyz.openbmc_project.Inventory.Decorator.Compatible to host firmware blob file
  * extensions.
- * @param[in] hostFirmwareDirectory The directory in which findLinks should look
+ * @param[in] hostFirmwareDirectory The directory in which writeLinks should look
  * for host firmware blob files that need well-known names.
  * @param[in] ibmCompatibleSystem The names property of an instance of
  * xyz.openbmc_project.Inventory.Decorator.Compatible
@@ -578,7 +1415,7 @@ void maybeMakeLinks(
     if (getExtensionsForIbmCompatibleSystem(extensionMap, ibmCompatibleSystem,
                                             extensions))
     {
-        findLinks(hostFirmwareDirectory, extensions, errorCallback, writeLink);
+        writeLinks(hostFirmwareDirectory, extensions, errorCallback);
     }
 }
 
@@ -593,12 +1430,13 @@ void maybeMakeLinks(
  * xyz.openbmc_project.Inventory.Decorator.Compatible to host firmware blob file
  * extensions.
  * @param[in] elementsJsonFilePath The file path to the json file
+ * @param[in] bus a DBus client connection
  * @param[in] ibmCompatibleSystem The names property of an instance of
  * xyz.openbmc_project.Inventory.Decorator.Compatible
  */
 void maybeSetBiosAttr(
     const std::map<std::string, std::vector<std::string>>& extensionMap,
-    const std::filesystem::path& elementsJsonFilePath,
+    const std::filesystem::path& elementsJsonFilePath, sdbusplus::bus_t& bus,
     const std::vector<std::string>& ibmCompatibleSystem)
 {
     std::vector<std::string> extensions;
@@ -607,7 +1445,7 @@ void maybeSetBiosAttr(
     {
         try
         {
-            setBiosAttr(elementsJsonFilePath, extensions);
+            setBiosAttr(bus, elementsJsonFilePath, extensions);
         }
         catch (const sdbusplus::exception_t& e)
         {
@@ -622,11 +1460,10 @@ void maybeSetBiosAttr(
  * Allocate a callback context and register for DBus.ObjectManager Interfaces
  * added signals from entity manager.
  *
- * Check the current entity manager object tree for a
- * xyz.openbmc_project.Inventory.Decorator.Compatible instance (entity manager
- * will be dbus activated if it is not running). If one is found, determine if
- * symlinks need to be created and create them. Instruct the program event loop
- * to exit.
+ * Look up the entity manager instance of
+ * xyz.openbmc_project.Inventory.Decorator.Compatible, see getCompatible. If
+ * one is found, determine if symlinks need to be created and create them.
+ * Instruct the program event loop to exit.
  *
  * If no instance of xyz.openbmc_project.Inventory.Decorator.Compatible is found
  * return the callback context to main, where the program will sleep until the
@@ -691,26 +1528,7 @@ std::shared_ptr<void> processHostFirmware(
 
     // now that we'll get a callback in the event of an InterfacesAdded signal
     // (potentially containing
-    // xyz.openbmc_project.Inventory.Decorator.Compatible), activate entity
-    // manager if it isn't running and enumerate its objects
-    auto getManagedObjects = bus.new_method_call(
-        "xyz.openbmc_project.EntityManager", "/xyz/openbmc_project/inventory",
-        "org.freedesktop.DBus.ObjectManager", "GetManagedObjects");
-    std::map<std::string,
-             std::map<std::string, std::variant<std::vector<std::string>>>>
-        interfacesAndProperties;
-    std::map<sdbusplus::object_path, decltype(interfacesAndProperties)> objects;
-    try
-    {
-        auto reply = bus.call(getManagedObjects);
-        reply.read(objects);
-    }
-    catch (const sdbusplus::exception_t& e)
-    {
-        // Error querying the EntityManager interface. Return the match to have
-        // the callback run if/when the interface appears in D-Bus.
-        return interfacesAddedMatch;
-    }
+    // xyz.openbmc_project.Inventory.Decorator.Compatible), look it up.
 
     // bind the extension map, host firmware directory, and error callback to
     // the maybeMakeLinks function.
@@ -719,20 +1537,17 @@ std::shared_ptr<void> processHostFirmware(
                   std::cref(*pHostFirmwareDirectory), std::placeholders::_1,
                   std::cref(*pErrorCallback));
 
-    for (const auto& pair : objects)
+    // if entity manager has an instance of
+    // xyz.openbmc_project.Inventory.Decorator.Compatible, check to see if
+    // links are necessary on this system and if so, create them
+    if (maybeCall(getCompatible(bus, compatibleCacheFile),
+                  maybeMakeLinksWithArgsBound))
     {
-        std::tie(std::ignore, interfacesAndProperties) = pair;
-        // if interfacesAndProperties contains an an instance of
-        // xyz.openbmc_project.Inventory.Decorator.Compatible, check to see if
-        // links are necessary on this system and if so, create them
-        if (maybeCall(interfacesAndProperties, maybeMakeLinksWithArgsBound))
-        {
-            // The Compatible interface is already on the bus and the links were
-            // created if applicable. Instruct the event loop to exit.
-            loop.exit(0);
-            // The match object isn't needed anymore, so destroy it on return.
-            return nullptr;
-        }
+        // The Compatible interface is already on the bus and the links were
+        // created if applicable. Instruct the event loop to exit.
+        loop.exit(0);
+        // The match object isn't needed anymore, so destroy it on return.
+        return nullptr;
     }
 
     // The Compatible interface has not yet been published. Move ownership of
@@ -759,9 +1574,6 @@ std::vector<std::shared_ptr<void>> updateBiosAttrTable(
     std::map<std::string, std::vector<std::string>> extensionMap,
     std::filesystem::path elementsJsonFilePath, sdeventplus::Event& loop)
 {
-    constexpr auto entityManagerServiceName =
-        "xyz.openbmc_project.EntityManager";
-
     auto pExtensionMap =
         std::make_shared<decltype(extensionMap)>(std::move(extensionMap));
     auto pElementsJsonFilePath =
@@ -770,7 +1582,8 @@ std::vector<std::shared_ptr<void>> updateBiosAttrTable(
 
     auto maybeSetAttrWithArgsBound =
         std::bind(maybeSetBiosAttr, std::cref(*pExtensionMap),
-                  std::cref(*pElementsJsonFilePath), std::placeholders::_1);
+                  std::cref(*pElementsJsonFilePath), std::ref(bus),
+                  std::placeholders::_1);
 
     std::vector<std::shared_ptr<void>> matches;
 
@@ -798,7 +1611,7 @@ std::vector<std::shared_ptr<void>> updateBiosAttrTable(
             sdbusplus::bus::match::rules::arg0namespace(
                 "xyz.openbmc_project.PLDM"),
         [pExtensionMap, pElementsJsonFilePath, maybeSetAttrWithArgsBound,
-         &loop](auto& message) {
+         &bus, &loop](auto& message) {
             std::string name;
             std::string oldOwner;
             std::string newOwner;
@@ -809,32 +1622,143 @@ std::vector<std::shared_ptr<void>> updateBiosAttrTable(
                 return;
             }
 
-            auto bus = sdbusplus::bus::new_default();
-            InterfacesPropertiesMap interfacesAndProperties;
-            auto objects = getManagedObjects(bus, entityManagerServiceName,
-                                             "/xyz/openbmc_project/inventory");
-            for (const auto& pair : objects)
+            if (maybeCall(getCompatible(bus, compatibleCacheFile),
+                          maybeSetAttrWithArgsBound))
             {
-                std::tie(std::ignore, interfacesAndProperties) = pair;
-                if (maybeCall(interfacesAndProperties,
-                              maybeSetAttrWithArgsBound))
-                {
-                    loop.exit(0);
-                }
+                loop.exit(0);
             }
         }));
 
-    InterfacesPropertiesMap interfacesAndProperties;
-    auto objects = getManagedObjects(bus, entityManagerServiceName,
-                                     "/xyz/openbmc_project/inventory");
-    for (const auto& pair : objects)
+    if (maybeCall(getCompatible(bus, compatibleCacheFile),
+                  maybeSetAttrWithArgsBound))
     {
-        std::tie(std::ignore, interfacesAndProperties) = pair;
-        if (maybeCall(interfacesAndProperties, maybeSetAttrWithArgsBound))
+        loop.exit(0);
+        return {};
+    }
+
+    return matches;
+}
+
+/**
+ * @brief set up host firmware
+ *
+ * The combination of processHostFirmware and updateBiosAttrTable: the
+ * xyz.openbmc_project.Inventory.Decorator.Compatible names are looked up
+ * once, and the names found then, or
+ * in a later InterfacesAdded signal, are used both to create the well-known
+ * names and to update the bios attribute table, on the same connection. The
+ * bios attribute table is updated once PLDM is running. Instruct the program
+ * event loop to exit once both are done.
+ *
+ * @param[in] bus a DBus client connection
+ * @param[in] extensionMap a map of
+ * xyz.openbmc_project.Inventory.Decorator.Compatible to host firmware blob file
+ * extensions.
+ * @param[in] hostFirmwareDirectory The directory in which the well-known
+ * names are created.
+ * @param[in] elementsJsonFilePath The file path to the json file
+ * @param[in] errorCallback A callback made in the event of filesystem errors.
+ * @param[in] loop a program event loop
+ * @return The sdbusplus match objects to keep while waiting for the Compatible
+ * interface or for PLDM, empty if both are done.
+ */
+std::vector<std::shared_ptr<void>> setupHostFirmware(
+    sdbusplus::bus_t& bus,
+    std::map<std::string, std::vector<std::string>> extensionMap,
+    std::filesystem::path hostFirmwareDirectory,
+    std::filesystem::path elementsJsonFilePath, ErrorCallbackType errorCallback,
+    sdeventplus::Event& loop)
+{
+    struct Context
+    {
+        std::map<std::string, std::vector<std::string>> extensionMap;
+        std::filesystem::path hostFirmwareDirectory;
+        std::filesystem::path elementsJsonFilePath;
+        ErrorCallbackType errorCallback;
+        std::optional<std::vector<std::string>> ibmCompatibleSystem;
+        bool biosAttrSet = false;
+    };
+    auto context = std::make_shared<Context>(
+        Context{std::move(extensionMap), std::move(hostFirmwareDirectory),
+                std::move(elementsJsonFilePath), std::move(errorCallback),
+                std::nullopt, false});
+
+    // Update the bios attribute table if the Compatible names are known, and
+    // exit once done. PLDM may not be running yet, its start is waited for.
+    auto maybeFinish = [context, &bus, &loop]() {
+        if (!context->ibmCompatibleSystem)
+        {
+            return false;
+        }
+        if (!context->biosAttrSet)
+        {
+            try
+            {
+                maybeSetBiosAttr(context->extensionMap,
+                                 context->elementsJsonFilePath, bus,
+                                 *context->ibmCompatibleSystem);
+            }
+            catch (const sdbusplus::exception_t& e)
+            {
+                return false;
+            }
+            context->biosAttrSet = true;
+        }
+        loop.exit(0);
+        return true;
+    };
+
+    // The links are created as soon as the Compatible names are known.
+    auto onCompatible = [context](const std::vector<std::string>& names) {
+        if (context->ibmCompatibleSystem)
+        {
+            return;
+        }
+        context->ibmCompatibleSystem = names;
+        maybeMakeLinks(context->extensionMap, context->hostFirmwareDirectory,
+                       names, context->errorCallback);
+    };
+
+    // A Compatible interface without a Names property is a bug of its
+    // implementation, there is nothing to set up then.
+    auto onFound = [context, maybeFinish, &loop]() {
+        if (!maybeFinish() && !context->ibmCompatibleSystem)
         {
             loop.exit(0);
-            return {};
         }
+    };
+
+    std::vector<std::shared_ptr<void>> matches;
+    matches.emplace_back(std::make_shared<sdbusplus::bus::match_t>(
+        bus,
+        sdbusplus::bus::match::rules::interfacesAdded() +
+            sdbusplus::bus::match::rules::sender(
+                "xyz.openbmc_project.EntityManager"),
+        [onCompatible, onFound](auto& message) {
+            if (maybeCallMessage(message, onCompatible))
+            {
+                onFound();
+            }
+        }));
+    matches.emplace_back(std::make_shared<sdbusplus::bus::match_t>(
+        bus,
+        sdbusplus::bus::match::rules::nameOwnerChanged() +
+            sdbusplus::bus::match::rules::arg0namespace(
+                "xyz.openbmc_project.PLDM"),
+        [maybeFinish](auto& message) {
+            std::string name;
+            std::string oldOwner;
+            std::string newOwner;
+            message.read(name, oldOwner, newOwner);
+            if (!newOwner.empty())
+            {
+                maybeFinish();
+            }
+        }));
+
+    if (maybeCall(getCompatible(bus, compatibleCacheFile), onCompatible))
+    {
+        onFound();
     }
 
     return matches;
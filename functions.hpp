@@ -1,8 +1,13 @@
+#include <cstddef>
 #include <filesystem>
 #include <functional>
 #include <map>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -26,18 +31,36 @@ namespace process_hostfirmware
 {
 using ErrorCallbackType =
     std::function<void(const std::filesystem::path&, std::error_code&)>;
-using LinkCallbackType =
-    std::function<void(const std::filesystem::path&,
-                       const std::filesystem::path&, const ErrorCallbackType&)>;
 using MaybeCallCallbackType =
     std::function<void(const std::vector<std::string>&)>;
+using LinkState = std::unordered_map<std::string, std::optional<std::string>>;
+using HostFirmwareElements = std::vector<std::pair<std::string, std::string>>;
+
+/** @brief The outcome of a reconciliation of the links of a directory */
+struct LinkStats
+{
+    size_t created = 0;
+    size_t replaced = 0;
+    size_t untouched = 0;
+};
+
 bool getExtensionsForIbmCompatibleSystem(
     const std::map<std::string, std::vector<std::string>>&,
     const std::vector<std::string>&, std::vector<std::string>&);
-void writeLink(const std::filesystem::path&, const std::filesystem::path&,
-               const ErrorCallbackType&);
-void findLinks(const std::filesystem::path&, const std::vector<std::string>&,
-               const ErrorCallbackType&, const LinkCallbackType&);
+LinkStats reconcileLinks(const std::filesystem::path&,
+                         const std::map<std::string, std::string>&, bool,
+                         const ErrorCallbackType&);
+LinkStats writeLinks(const std::filesystem::path&,
+                     const std::vector<std::string>&, const ErrorCallbackType&);
+bool parseElements(std::string_view, const std::vector<std::string>&,
+                   HostFirmwareElements&);
+std::optional<HostFirmwareElements> readElements(
+    const std::filesystem::path&, const std::vector<std::string>&,
+    const std::filesystem::path&);
+std::optional<std::vector<std::string>>
+    loadCompatibleNames(const std::filesystem::path&, const std::string&);
+void saveCompatibleNames(const std::filesystem::path&, const std::string&,
+                         const std::vector<std::string>&);
 bool maybeCall(
     const std::map<
         std::string,
@@ -49,5 +72,9 @@ std::shared_ptr<void> processHostFirmware(
 std::vector<std::shared_ptr<void>> updateBiosAttrTable(
     sdbusplus::bus_t&, std::map<std::string, std::vector<std::string>>,
     std::filesystem::path, sdeventplus::Event&);
+std::vector<std::shared_ptr<void>> setupHostFirmware(
+    sdbusplus::bus_t&, std::map<std::string, std::vector<std::string>>,
+    std::filesystem::path, std::filesystem::path, ErrorCallbackType,
+    sdeventplus::Event&);
 } // namespace process_hostfirmware
 } // namespace functions
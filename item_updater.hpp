@@ -1,6 +1,7 @@
 #pragma once
 
 #include "activation.hpp"
+#include "flash_io.hpp"
 #include "version.hpp"
 #include "xyz/openbmc_project/Collection/DeleteAll/server.hpp"
 
@@ -50,7 +51,7 @@ class GardReset : public GardResetInherit
     GardReset(sdbusplus::bus_t& bus, const std::string& path) :
         GardResetInherit(bus, path.c_str(),
                          GardResetInherit::action::emit_interface_added),
-        bus(bus), path(path)
+        bus(bus), path(path), flashIo(bus, path)
     {}
 
     virtual ~GardReset() {}
@@ -65,6 +66,9 @@ class GardReset : public GardResetInherit
     static constexpr auto interface = "xyz.openbmc_project.Common.FactoryReset";
     sdbusplus::bus_t& bus;
     std::string path;
+
+    /** @brief Flash I/O of the GUARD resets */
+    FlashIoStatistics flashIo;
 };
 
 /** @class ItemUpdater
@@ -84,7 +88,8 @@ class ItemUpdater : public ItemUpdaterInherit
                      MatchRules::interfacesAdded() +
                          MatchRules::path("/xyz/openbmc_project/software"),
                      std::bind(std::mem_fn(&ItemUpdater::createActivation),
-                               this, std::placeholders::_1))
+                               this, std::placeholders::_1)),
+        resetFlashIo(bus, path)
     {}
 
     virtual ~ItemUpdater() = default;
@@ -215,6 +220,9 @@ class ItemUpdater : public ItemUpdaterInherit
     /** @brief This entry's associations */
     AssociationList assocs = {};
 
+    /** @brief Flash I/O of the host factory resets */
+    FlashIoStatistics resetFlashIo;
+
     /** @brief Host factory reset - clears PNOR partitions for each
      * Activation D-Bus object */
     void reset() override = 0;
@@ -2,11 +2,18 @@
 
 #ifdef UBIFS_LAYOUT
 #include "ubi/item_updater_ubi.hpp"
+#include "ubi/partition_store.hpp"
 #include "ubi/watch.hpp"
 #elif defined MMC_LAYOUT
+#include "mmc/hostfw_sync.hpp"
 #include "mmc/item_updater_mmc.hpp"
+#include "mmc/lid_integrity.hpp"
+#include "mmc/lid_store.hpp"
+#include "utils.hpp"
 #else
+#include "flash_io.hpp"
 #include "static/item_updater_static.hpp"
+#include "static/pnor_flash.hpp"
 #endif
 #include "functions.hpp"
 
@@ -16,8 +23,11 @@
 #include <sdbusplus/server/manager.hpp>
 #include <sdeventplus/event.hpp>
 
+#include <chrono>
+#include <cinttypes>
 #include <map>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <system_error>
 #include <vector>
@@ -35,7 +45,7 @@ void initializeService(sdbusplus::bus_t& bus)
     static ItemUpdaterUbi updater(bus, SOFTWARE_OBJPATH);
     static Watch watch(
         bus.get_event(),
-        std::bind(std::mem_fn(&ItemUpdater::updateFunctionalAssociation),
+        std::bind(std::mem_fn(&ItemUpdaterUbi::processFilesystemChanges),
                   &updater, std::placeholders::_1));
 #elif defined MMC_LAYOUT
     static ItemUpdaterMMC updater(bus, SOFTWARE_OBJPATH);
@@ -113,6 +123,237 @@ int main(int argc, char* argv[])
                     subcommandContext.push_back(subcommand);
                 }
             }));
+    static_cast<void>(
+        app.add_subcommand("setup-host-firmware",
+                           "Point the host firmware at its data and update "
+                           "the bios attribute table.")
+            ->callback([&bus, &loop, &subcommandContext, extensionMap]() {
+                auto hostFirmwareDirectory = "/media/hostfw/running"s;
+                auto elementsJsonFilePath = "/usr/share/hostfw/elements.json"s;
+                auto logCallback = [](const auto& path, auto& ec) {
+                    std::cerr << path << ": " << ec.message() << "\n";
+                };
+                auto subcommands =
+                    functions::process_hostfirmware::setupHostFirmware(
+                        bus, extensionMap, std::move(hostFirmwareDirectory),
+                        std::move(elementsJsonFilePath),
+                        std::move(logCallback), loop);
+                for (const auto& subcommand : subcommands)
+                {
+                    subcommandContext.push_back(subcommand);
+                }
+            }));
+
+#ifdef UBIFS_LAYOUT
+    std::string storeDir;
+    std::string storeVersionId;
+    std::string storeSource;
+    auto importCommand = app.add_subcommand(
+        "import-pnor-volume",
+        "Add the partitions of a host version to the partition store.");
+    importCommand->add_option("store", storeDir, "The store directory")
+        ->required();
+    importCommand->add_option("version", storeVersionId, "The version id")
+        ->required();
+    importCommand
+        ->add_option("source", storeSource,
+                     "The directory holding the partitions of the version")
+        ->required();
+    static_cast<void>(importCommand->callback(
+        [&loop, &storeDir, &storeVersionId, &storeSource]() {
+            try
+            {
+                PartitionStore store(storeDir);
+                store.importVersion(storeVersionId, storeSource);
+                loop.exit(0);
+            }
+            catch (const std::exception& e)
+            {
+                log<level::ERR>("Failed to import host version",
+                                entry("VERSIONID=%s", storeVersionId.c_str()),
+                                entry("ERROR=%s", e.what()));
+                loop.exit(1);
+            }
+        }));
+
+    auto removeCommand = app.add_subcommand(
+        "remove-pnor-volume",
+        "Remove a host version from the partition store.");
+    removeCommand->add_option("store", storeDir, "The store directory")
+        ->required();
+    removeCommand->add_option("version", storeVersionId, "The version id")
+        ->required();
+    static_cast<void>(
+        removeCommand->callback([&loop, &storeDir, &storeVersionId]() {
+            try
+            {
+                PartitionStore store(storeDir);
+                store.removeVersion(storeVersionId);
+                loop.exit(0);
+            }
+            catch (const std::exception& e)
+            {
+                log<level::ERR>("Failed to remove host version",
+                                entry("VERSIONID=%s", storeVersionId.c_str()),
+                                entry("ERROR=%s", e.what()));
+                loop.exit(1);
+            }
+        }));
+#endif
+
+#ifdef MMC_LAYOUT
+    std::string roDir = MEDIA_DIR "hostfw/running-ro";
+    std::string runningDir = MEDIA_DIR "hostfw/running";
+    unsigned syncJobs = 0;
+    std::string storeDir;
+    std::string lidSet;
+    std::string hostfwImage;
+    auto syncCommand = app.add_subcommand(
+        "sync-host-firmware",
+        "Bring the running lids in line with the read-only image, copying "
+        "only the changed lids.");
+    syncCommand->add_option("--ro-dir", roDir,
+                            "The read-only image directory");
+    syncCommand->add_option("--running-dir", runningDir,
+                            "The running directory");
+    syncCommand->add_option("--jobs", syncJobs,
+                            "Parallel copies, 0 for one per CPU");
+    auto storeOption = syncCommand->add_option(
+        "--store", storeDir,
+        "The lid store the read-only lids are linked from");
+    syncCommand->add_option("--set", lidSet, "The lid set of the image")
+        ->needs(storeOption);
+    syncCommand->add_option("--image", hostfwImage,
+                            "The image file mounted on the read-only dir")
+        ->needs(storeOption);
+    static_cast<void>(syncCommand->callback(
+        [&bus, &loop, &roDir, &runningDir, &syncJobs, &storeDir, &lidSet,
+         &hostfwImage]() {
+            try
+            {
+                std::unique_ptr<LidStore> store;
+                if (!storeDir.empty())
+                {
+                    store = std::make_unique<LidStore>(
+                        storeDir, lidSet,
+                        hostfwImage.empty()
+                            ? std::string()
+                            : LidStore::imageStamp(hostfwImage));
+                }
+                auto stats = syncHostFirmware(roDir, runningDir, syncJobs,
+                                              store.get());
+                for (const auto& mismatch : stats.mismatches)
+                {
+                    utils::logHostFileError(bus, mismatch.file,
+                                            mismatch.current,
+                                            mismatch.expected);
+                }
+                if (!stats.mismatches.empty())
+                {
+                    utils::createBmcDump(bus);
+                }
+                loop.exit(0);
+            }
+            catch (const std::exception& e)
+            {
+                log<level::ERR>("Failed to synchronize the host firmware",
+                                entry("ERROR=%s", e.what()));
+                loop.exit(1);
+            }
+        }));
+
+    std::string recoverRunningDir =
+        "/var/lib/phosphor-software-manager/hostfw/running";
+    unsigned recoverJobs = 0;
+    auto recoverCommand = app.add_subcommand(
+        "recover-host-firmware",
+        "Check the running lids against the read-only image and restore the "
+        "damaged ones.");
+    recoverCommand->add_option("--ro-dir", roDir,
+                               "The read-only image directory");
+    recoverCommand->add_option("--running-dir", recoverRunningDir,
+                               "The running directory");
+    recoverCommand->add_option("--jobs", recoverJobs,
+                               "Parallel checks, 0 for one per CPU");
+    static_cast<void>(recoverCommand->callback(
+        [&bus, &loop, &roDir, &recoverRunningDir, &recoverJobs]() {
+            try
+            {
+                auto stats = recoverLids(roDir, recoverRunningDir,
+                                         recoverJobs);
+                for (const auto& mismatch : stats.mismatches)
+                {
+                    utils::logHostFileError(
+                        bus, mismatch.lid, mismatch.current, mismatch.expected,
+                        mismatch.reason == "size" ? "" : mismatch.reason);
+                }
+                // One dump covers every lid restored.
+                if (!stats.mismatches.empty())
+                {
+                    utils::createBmcDump(bus);
+                }
+                loop.exit(0);
+            }
+            catch (const std::exception& e)
+            {
+                log<level::ERR>("Failed to recover the host firmware",
+                                entry("ERROR=%s", e.what()));
+                loop.exit(1);
+            }
+        }));
+#endif
+
+#if !defined UBIFS_LAYOUT && !defined MMC_LAYOUT
+    std::string pnorImage;
+    bool verify = false;
+    unsigned verifyBudget = 0;
+    auto flashCommand = app.add_subcommand(
+        "flash-pnor",
+        "Write a PNOR image to the flash, skipping the unchanged blocks.");
+    flashCommand->add_option("image", pnorImage, "The PNOR image file")
+        ->required();
+    flashCommand->add_flag("--verify", verify,
+                           "Read the whole flash back and compare it to the "
+                           "image once written");
+    flashCommand->add_option("--verify-budget", verifyBudget,
+                             "Seconds the verification may take, 0 for no "
+                             "limit");
+    static_cast<void>(flashCommand->callback([&loop, &pnorImage, &verify,
+                                              &verifyBudget]() {
+        try
+        {
+            FlashDevice flash(mtdDevice("pnor"));
+            auto stats = flashImage(pnorImage, flash);
+            if (verify)
+            {
+                auto result = verifyImage(pnorImage, flash,
+                                          std::chrono::seconds(verifyBudget));
+                stats.verified = result.verified;
+                if (result.mismatch)
+                {
+                    throw std::runtime_error(
+                        "Flash does not match the image at offset " +
+                        std::to_string(*result.mismatch));
+                }
+                log<level::INFO>(
+                    "Verified PNOR flash", entry("IMAGE=%s", pnorImage.c_str()),
+                    entry("BYTES=%" PRIu64, result.verified),
+                    entry("COMPLETE=%d", result.complete),
+                    entry("ELAPSED_MS=%lld",
+                          static_cast<long long>(result.elapsed.count())));
+            }
+            saveFlashStats(pnorImage + FLASH_STATS_SUFFIX, stats);
+            loop.exit(0);
+        }
+        catch (const std::exception& e)
+        {
+            log<level::ERR>("Failed to flash PNOR image",
+                            entry("IMAGE=%s", pnorImage.c_str()),
+                            entry("ERROR=%s", e.what()));
+            loop.exit(1);
+        }
+    }));
+#endif
 
     CLI11_PARSE(app, argc, argv);
 
@@ -121,9 +362,10 @@ int main(int argc, char* argv[])
         initializeService(bus);
     }
 
+    int rc = 0;
     try
     {
-        auto rc = loop.loop();
+        rc = loop.loop();
         if (rc < 0)
         {
             log<level::ERR>("Error occurred during the sd_event_loop",
@@ -137,5 +379,6 @@ int main(int argc, char* argv[])
         return -1;
     }
 
-    return 0;
+    // Subcommands report their failures through the loop exit code.
+    return rc;
 }
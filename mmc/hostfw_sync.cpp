@@ -0,0 +1,584 @@
+#include "hostfw_sync.hpp"
+
+#include "lid_integrity.hpp"
+#include "lid_store.hpp"
+#include "parallel.hpp"
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <phosphor-logging/log.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <system_error>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+using namespace phosphor::logging;
+namespace fs = std::filesystem;
+
+namespace
+{
+
+/** @brief Size of the reads comparing and copying the lids */
+constexpr size_t chunkSize = 256 * 1024;
+
+/** @class File
+ *  @brief Owns a file descriptor.
+ */
+class File
+{
+  public:
+    File() = delete;
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+    File(File&&) = delete;
+    File& operator=(File&&) = delete;
+
+    File(const fs::path& path, int flags, mode_t mode = 0) :
+        fd(open(path.c_str(), flags | O_CLOEXEC, mode))
+    {
+        if (fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to open " + path.string());
+        }
+    }
+
+    ~File()
+    {
+        close(fd);
+    }
+
+    int get() const
+    {
+        return fd;
+    }
+
+  private:
+    int fd;
+};
+
+/** @brief Reads up to size bytes, stopping at the end of the file. */
+size_t readFull(int fd, const fs::path& path, uint8_t* data, size_t size)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        auto bytes = ::read(fd, data + done, size - done);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes < 0)
+        {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to read " + path.string());
+        }
+        if (bytes == 0)
+        {
+            break;
+        }
+        done += bytes;
+    }
+    return done;
+}
+
+/** @brief Writes size bytes. */
+void writeFull(int fd, const fs::path& path, const uint8_t* data, size_t size)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        auto bytes = ::write(fd, data + done, size - done);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes < 0)
+        {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to write " + path.string());
+        }
+        done += bytes;
+    }
+}
+
+/** @brief Copies the data of a file to another, in the kernel when the
+ *         filesystems allow it.
+ *
+ *  @return The bytes copied.
+ */
+uintmax_t copyData(int src, int dst, const fs::path& from, const fs::path& to,
+                   uintmax_t size)
+{
+    uintmax_t done = 0;
+    while (done < size)
+    {
+        auto bytes = copy_file_range(src, nullptr, dst, nullptr, size - done,
+                                     0);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes < 0 && done == 0 &&
+            (errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+             errno == EOPNOTSUPP))
+        {
+            break;
+        }
+        if (bytes < 0)
+        {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to copy " + from.string());
+        }
+        if (bytes == 0)
+        {
+            return done;
+        }
+        done += bytes;
+    }
+    if (done == size)
+    {
+        return done;
+    }
+
+    // The filesystems do not support copy_file_range, read and write.
+    std::vector<uint8_t> buffer(chunkSize);
+    while (true)
+    {
+        auto bytes = readFull(src, from, buffer.data(), buffer.size());
+        if (bytes == 0)
+        {
+            return done;
+        }
+        writeFull(dst, to, buffer.data(), bytes);
+        done += bytes;
+    }
+}
+
+/** @brief Returns the directory the new running set is built in, a hidden
+ *         sibling of the running directory on the same filesystem.
+ */
+fs::path stagingDir(const fs::path& runningDir)
+{
+    auto dir = runningDir.has_filename() ? runningDir
+                                         : runningDir.parent_path();
+    return dir.parent_path() / ("." + dir.filename().string() + ".staging");
+}
+
+/** @brief Swaps two directories in a single rename. */
+void exchangeDirs(const fs::path& first, const fs::path& second)
+{
+    if (renameat2(AT_FDCWD, first.c_str(), AT_FDCWD, second.c_str(),
+                  RENAME_EXCHANGE) < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to exchange " + first.string() +
+                                    " and " + second.string());
+    }
+}
+
+/** @brief Flushes the filesystem holding a directory. */
+void syncFilesystem(const fs::path& dir)
+{
+    File file(dir, O_RDONLY | O_DIRECTORY);
+    if (syncfs(file.get()) < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to sync " + dir.string());
+    }
+}
+
+/** @brief Returns the lids of the PRESERVED partitions to keep.
+ *  @details A preserved lid is kept if it is in both directories with the
+ *  same size, a size change meaning that the partition layout changed or
+ *  that the lid is corrupted.
+ */
+std::set<std::string> preservedLids(const fs::path& roDir,
+                                    const fs::path& runningDir,
+                                    std::vector<SizeMismatch>& mismatches)
+{
+    std::set<std::string> lids;
+    for (const auto& name :
+         tocPartitions(roDir / HOSTFW_TOC_LID, "PRESERVED"))
+    {
+        auto lid = partitionLid(runningDir, name);
+        if (!lid)
+        {
+            continue;
+        }
+        std::error_code ec;
+        auto running = runningDir / *lid;
+        auto ro = roDir / *lid;
+        if (!fs::is_regular_file(running, ec) || !fs::is_regular_file(ro, ec))
+        {
+            continue;
+        }
+
+        auto current = fs::file_size(running);
+        auto expected = fs::file_size(ro);
+        if (current != expected)
+        {
+            mismatches.push_back({*lid, current, expected});
+            continue;
+        }
+        lids.insert(*lid);
+    }
+    return lids;
+}
+
+/** @brief Returns the lids of the READONLY partitions, which the host never
+ *         writes. The partition links of the image are used, or those left
+ *         in the running directory by setup-host-firmware.
+ */
+std::set<std::string> readOnlyLids(const fs::path& roDir,
+                                   const fs::path& runningDir)
+{
+    std::set<std::string> lids;
+    for (const auto& name : tocPartitions(roDir / HOSTFW_TOC_LID, "READONLY"))
+    {
+        auto lid = partitionLid(roDir, name);
+        if (!lid)
+        {
+            lid = partitionLid(runningDir, name);
+        }
+        if (lid)
+        {
+            lids.insert(*lid);
+        }
+    }
+    return lids;
+}
+
+} // namespace
+
+std::vector<std::string> tocPartitions(const fs::path& toc,
+                                       const std::string& flag)
+{
+    std::vector<std::string> names;
+    std::ifstream file(toc);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        auto eq = line.find('=');
+        if (!line.starts_with("partition") || eq == std::string::npos)
+        {
+            continue;
+        }
+
+        // The name is the first field, the flags follow the offsets.
+        std::vector<std::string> fields;
+        size_t start = eq + 1;
+        while (true)
+        {
+            auto comma = line.find(',', start);
+            fields.push_back(line.substr(start, comma - start));
+            if (comma == std::string::npos)
+            {
+                break;
+            }
+            start = comma + 1;
+        }
+        if (!fields[0].empty() &&
+            std::find(fields.begin() + 1, fields.end(), flag) != fields.end())
+        {
+            names.push_back(fields[0]);
+        }
+    }
+    return names;
+}
+
+std::optional<std::string> partitionLid(const fs::path& dir,
+                                        const std::string& name)
+{
+    std::error_code ec;
+    auto link = dir / name;
+    if (!fs::is_symlink(link, ec))
+    {
+        return std::nullopt;
+    }
+    auto target = fs::read_symlink(link, ec);
+    if (ec || target.has_parent_path() || target.empty())
+    {
+        return std::nullopt;
+    }
+    return target.string();
+}
+
+bool sameContent(const fs::path& first, const fs::path& second)
+{
+    File a(first, O_RDONLY);
+    File b(second, O_RDONLY);
+    struct stat stA;
+    struct stat stB;
+    if (fstat(a.get(), &stA) < 0 || fstat(b.get(), &stB) < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to stat " + first.string());
+    }
+    if (stA.st_size != stB.st_size)
+    {
+        return false;
+    }
+    posix_fadvise(a.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(b.get(), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    std::vector<uint8_t> bufA(chunkSize);
+    std::vector<uint8_t> bufB(chunkSize);
+    while (true)
+    {
+        auto bytesA = readFull(a.get(), first, bufA.data(), bufA.size());
+        auto bytesB = readFull(b.get(), second, bufB.data(), bufB.size());
+        if (bytesA != bytesB ||
+            std::memcmp(bufA.data(), bufB.data(), bytesA) != 0)
+        {
+            return false;
+        }
+        if (bytesA < chunkSize)
+        {
+            return true;
+        }
+    }
+}
+
+uintmax_t copyLid(const fs::path& from, const fs::path& to, bool& reflinked)
+{
+    File src(from, O_RDONLY);
+    struct stat st;
+    if (fstat(src.get(), &st) < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to stat " + from.string());
+    }
+
+    File dst(to, O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 07777);
+    reflinked = ioctl(dst.get(), FICLONE, src.get()) == 0;
+    uintmax_t written = 0;
+    if (!reflinked)
+    {
+        written = copyData(src.get(), dst.get(), from, to, st.st_size);
+    }
+
+    const struct timespec times[] = {st.st_atim, st.st_mtim};
+    if (fchmod(dst.get(), st.st_mode & 07777) < 0 ||
+        futimens(dst.get(), times) < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to set the attributes of " +
+                                    to.string());
+    }
+    return written;
+}
+
+SyncStats syncHostFirmware(const fs::path& roDir, const fs::path& runningDir,
+                           unsigned jobs, LidStore* store)
+{
+    auto start = std::chrono::steady_clock::now();
+    SyncStats stats;
+    fs::create_directories(runningDir);
+
+    // The new running set is built aside and swapped in whole, so a power
+    // loss leaves either the old or the new set, never a mix. A set left
+    // over by an interrupted sync is started over.
+    auto staging = stagingDir(runningDir);
+    fs::remove_all(staging);
+    fs::create_directory(staging);
+
+    auto preserved = preservedLids(roDir, runningDir, stats.mismatches);
+    auto readOnly = readOnlyLids(roDir, runningDir);
+    auto hostWritten = hostWrittenLids(roDir, runningDir);
+    std::map<std::string, fs::path> storedLids;
+    IntegrityIndex index;
+
+    std::vector<std::string> lids;
+    for (const auto& file : fs::directory_iterator(roDir))
+    {
+        if (file.is_regular_file() && file.path().extension() == ".lid")
+        {
+            lids.push_back(file.path().filename().string());
+        }
+    }
+    stats.files = lids.size();
+
+    // Each task puts a lid in the staging directory. A running lid that is
+    // kept is hard linked, only the changed lids are written. The comparison
+    // reads dominate when few lids changed, the copies otherwise.
+    std::mutex lock;
+    forEachParallel(lids.size(), jobs, [&](size_t i) {
+        const auto& lid = lids[i];
+        auto ro = roDir / lid;
+        auto running = runningDir / lid;
+        auto staged = staging / lid;
+        if (preserved.contains(lid))
+        {
+            fs::create_hard_link(running, staged);
+            auto digest = measureLid(staged, false);
+            std::lock_guard guard(lock);
+            index.emplace(lid, digest);
+            ++stats.preserved;
+            return;
+        }
+
+        if (store && readOnly.contains(lid))
+        {
+            // The blob of an unchanged image is known, the lid is only read
+            // to be stored.
+            uintmax_t written = 0;
+            auto blob = store->find(lid);
+            if (blob.empty())
+            {
+                blob = store->store(ro, written);
+            }
+            std::error_code ec;
+            bool linked = !fs::equivalent(blob, running, ec);
+            LidStore::link(blob, staged);
+            LidDigest digest{"sha256", blob.filename().string(),
+                             fs::file_size(staged),
+                             lidModificationTime(staged)};
+            std::lock_guard guard(lock);
+            storedLids.emplace(lid, blob);
+            index.emplace(lid, std::move(digest));
+            stats.linked += linked;
+            stats.unchanged += !linked;
+            stats.bytesWritten += written;
+            return;
+        }
+
+        std::error_code ec;
+        bool unchanged =
+            fs::is_regular_file(fs::symlink_status(running, ec)) &&
+            sameContent(ro, running);
+        bool reflinked = false;
+        uintmax_t written = 0;
+        if (unchanged)
+        {
+            fs::create_hard_link(running, staged);
+        }
+        else
+        {
+            written = copyLid(ro, staged, reflinked);
+        }
+
+        // The content of a read-only lid, or of a lid the host rewrites as
+        // it is written here, is recorded for the integrity checks.
+        std::optional<LidDigest> digest;
+        if (readOnly.contains(lid) || hostWritten.contains(lid))
+        {
+            digest = measureLid(staged, false);
+        }
+
+        std::lock_guard guard(lock);
+        if (digest)
+        {
+            index.emplace(lid, *digest);
+        }
+        if (unchanged)
+        {
+            ++stats.unchanged;
+            stats.bytesCompared += 2 * fs::file_size(ro, ec);
+            return;
+        }
+        ++stats.copied;
+        stats.reflinked += reflinked;
+        stats.bytesWritten += written;
+    });
+
+    // The hidden files and the partition links to the lids of the new set
+    // are carried over, the other entries the image does not hold are
+    // dropped. The running directory thus keeps the links that find the
+    // PRESERVED lids until setup-host-firmware recreates them, also when
+    // the label is lost to a power loss and the sync runs again.
+    std::set<std::string> keep(lids.begin(), lids.end());
+    keep.insert(INTEGRITY_INDEX_FILE);
+    // The new set is verified again by the next integrity check
+    keep.insert(INTEGRITY_VERIFIED_FILE);
+    for (const auto& file : fs::directory_iterator(runningDir))
+    {
+        auto name = file.path().filename().string();
+        std::error_code ec;
+        if (keep.contains(name) || file.is_directory(ec))
+        {
+            continue;
+        }
+        if (name.starts_with("."))
+        {
+            fs::create_hard_link(file.path(), staging / name);
+            continue;
+        }
+        if (file.is_symlink(ec))
+        {
+            auto target = fs::read_symlink(file.path(), ec);
+            if (!ec && !target.has_parent_path() &&
+                target.extension() == ".lid" && keep.contains(target))
+            {
+                fs::create_symlink(target, staging / name);
+                continue;
+            }
+        }
+        ++stats.removed;
+    }
+
+    if (store)
+    {
+        store->publish(storedLids);
+    }
+    saveIntegrityIndex(staging / INTEGRITY_INDEX_FILE, index);
+
+    // The new set is made durable before it replaces the old one.
+    syncFilesystem(staging);
+    exchangeDirs(staging, runningDir);
+    syncFilesystem(runningDir);
+
+    // The old set is now in the staging directory. Its subdirectories are
+    // moved over, the rest is removed, which also releases the store blobs
+    // only the old set linked to.
+    for (const auto& file : fs::directory_iterator(staging))
+    {
+        std::error_code ec;
+        if (file.is_directory(ec) && !file.is_symlink(ec))
+        {
+            fs::rename(file.path(), runningDir / file.path().filename());
+        }
+    }
+    fs::remove_all(staging);
+    if (store)
+    {
+        store->collectGarbage();
+    }
+
+    stats.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    log<level::INFO>("Synchronized the running host firmware",
+                     entry("FILES=%zu", stats.files),
+                     entry("COPIED=%zu", stats.copied),
+                     entry("REFLINKED=%zu", stats.reflinked),
+                     entry("LINKED=%zu", stats.linked),
+                     entry("UNCHANGED=%zu", stats.unchanged),
+                     entry("PRESERVED=%zu", stats.preserved),
+                     entry("REMOVED=%zu", stats.removed),
+                     entry("BYTES_WRITTEN=%ju", stats.bytesWritten),
+                     entry("ELAPSED_MS=%lld",
+                           static_cast<long long>(stats.elapsed.count())));
+    return stats;
+}
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+class LidStore;
+
+/** @brief Lid holding the pnor.toc of the host firmware */
+constexpr auto HOSTFW_TOC_LID = "81e00994.lid";
+
+/** @struct SizeMismatch
+ *  @brief A preserved lid whose size differs from the read-only copy.
+ */
+struct SizeMismatch
+{
+    /** @brief The lid file name */
+    std::string file;
+    /** @brief The size of the running lid */
+    uintmax_t current = 0;
+    /** @brief The size of the read-only lid */
+    uintmax_t expected = 0;
+};
+
+/** @struct SyncStats
+ *  @brief Outcome of a synchronization of the running lids.
+ */
+struct SyncStats
+{
+    /** @brief Number of lids of the read-only image */
+    size_t files = 0;
+    /** @brief Number of lids copied from the read-only image */
+    size_t copied = 0;
+    /** @brief Number of copied lids sharing their extents with the source */
+    size_t reflinked = 0;
+    /** @brief Number of lids replaced by a link to the lid store */
+    size_t linked = 0;
+    /** @brief Number of lids already identical to the read-only image */
+    size_t unchanged = 0;
+    /** @brief Number of preserved lids kept as they were */
+    size_t preserved = 0;
+    /** @brief Number of stale entries removed from the running directory */
+    size_t removed = 0;
+    /** @brief Bytes written to the running directory */
+    uintmax_t bytesWritten = 0;
+    /** @brief Bytes read to compare the lids */
+    uintmax_t bytesCompared = 0;
+    /** @brief Preserved lids replaced because of their size */
+    std::vector<SizeMismatch> mismatches;
+    /** @brief Time spent */
+    std::chrono::milliseconds elapsed{0};
+};
+
+/** @brief Returns the partitions of a pnor.toc carrying a flag.
+ *  @details A line of the pnor.toc looks like
+ *  partition05=SECBOOT,0x00381000,0x003a5000,00,ECC,PRESERVED
+ *
+ *  @param[in] toc  - The pnor.toc file.
+ *  @param[in] flag - The flag, e.g. "PRESERVED".
+ *  @return The partition names, empty if the file does not exist.
+ */
+std::vector<std::string> tocPartitions(const std::filesystem::path& toc,
+                                       const std::string& flag);
+
+/** @brief Returns the lid a partition name links to in a directory.
+ *  @details The running directory holds a link per partition name to its
+ *  lid, e.g. SECBOOT -> 81e00630.lid.
+ *
+ *  @param[in] dir  - The directory.
+ *  @param[in] name - The partition name.
+ *  @return The lid file name, if the directory has such a link.
+ */
+std::optional<std::string> partitionLid(const std::filesystem::path& dir,
+                                        const std::string& name);
+
+/** @brief Returns whether two files have the same size and content. */
+bool sameContent(const std::filesystem::path& first,
+                 const std::filesystem::path& second);
+
+/** @brief Copies a lid, preserving its mode and times as cp -p does.
+ *  @details The copy is a reflink of the source if the filesystem supports
+ *  it, else the data is copied in the kernel if possible.
+ *
+ *  @param[in]  from      - The source lid.
+ *  @param[in]  to        - The copy, created or truncated.
+ *  @param[out] reflinked - Whether the copy shares the source extents.
+ *  @return The bytes written.
+ */
+uintmax_t copyLid(const std::filesystem::path& from,
+                  const std::filesystem::path& to, bool& reflinked);
+
+/** @brief Brings the running lids in line with the read-only image.
+ *  @details This replaces removing every running lid and copying the whole
+ *  image back when the boot side changes. The new running set is built in
+ *  a hidden sibling staging directory, then exchanged with the running
+ *  directory in a single rename, so the running directory always holds a
+ *  complete set. The running lids identical to the image, and those of the
+ *  PRESERVED partitions unless their size differs from the image, are hard
+ *  linked into the new set. The others are cloned or copied, in parallel.
+ *  The hidden files and the subdirectories of the running directory are
+ *  kept, its other entries, e.g. the links to the lids, are not.
+ *
+ *  With a lid store, the lids of the READONLY partitions become hard links
+ *  to the store blobs instead of copies, and the lid set of the image is
+ *  published in the store. The digests of the READONLY lids, and of the
+ *  lids the host rewrites as they are written, are recorded in the
+ *  integrity index of the running directory, to be verified by the next
+ *  recoverLids.
+ *
+ *  @param[in] roDir      - The read-only image directory.
+ *  @param[in] runningDir - The running directory.
+ *  @param[in] jobs       - The number of parallel copies, 0 for one per CPU.
+ *  @param[in] store      - The lid store, or nullptr to copy every lid.
+ *  @return The synchronization statistics, throws on failure.
+ */
+SyncStats syncHostFirmware(const std::filesystem::path& roDir,
+                           const std::filesystem::path& runningDir,
+                           unsigned jobs = 0, LidStore* store = nullptr);
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
@@ -7,11 +7,15 @@
 #include "version.hpp"
 
 #include <phosphor-logging/log.hpp>
+#include <sdbusplus/bus/match.hpp>
 
+#include <chrono>
 #include <filesystem>
 #include <format>
 #include <iostream>
-#include <thread>
+#include <map>
+#include <utility>
+#include <vector>
 
 namespace openpower
 {
@@ -20,6 +24,7 @@ namespace software
 namespace updater
 {
 
+using ::phosphor::logging::entry;
 using ::phosphor::logging::level;
 using ::phosphor::logging::log;
 // These functions are just a stub (empty) because the current eMMC
@@ -103,30 +108,118 @@ void ItemUpdaterMMC::reset()
     const std::tuple<std::string, std::string> services[] = {
         {"StartUnit", "obmc-flash-bios-init.service"},
         {"StartUnit", "obmc-flash-bios-patch.service"},
-        {"StartUnit", "openpower-process-host-firmware.service"},
-        {"StartUnit", "openpower-update-bios-attr-table.service"},
+        {"StartUnit", "openpower-setup-host-firmware.service"},
         {"RestartUnit", "org.open_power.HardwareIsolation.service"}};
 
+    // The BMC may be rebooted once the reset returns, which corrupts the
+    // files the services are still writing, so wait for their jobs. The
+    // jobs are tracked on a connection of their own, waiting on it does not
+    // dispatch the requests queued on the service bus.
+    auto jobBus = sdbusplus::bus::new_system();
+    // The result of each removed job and when it was removed
+    std::map<std::string,
+             std::pair<std::string, std::chrono::steady_clock::time_point>>
+        removedJobs;
+    sdbusplus::bus::match_t jobRemoved(
+        jobBus,
+        sdbusRule::type::signal() + sdbusRule::member("JobRemoved") +
+            sdbusRule::path(SYSTEMD_PATH) +
+            sdbusRule::interface(SYSTEMD_INTERFACE),
+        [&removedJobs](sdbusplus::message_t& msg) {
+            uint32_t id = 0;
+            sdbusplus::object_path job;
+            std::string unit;
+            std::string result;
+            msg.read(id, job, unit, result);
+            removedJobs.emplace(
+                job.str,
+                std::make_pair(result, std::chrono::steady_clock::now()));
+        });
+    auto subscribe = jobBus.new_method_call(SYSTEMD_BUSNAME, SYSTEMD_PATH,
+                                            SYSTEMD_INTERFACE, "Subscribe");
+    try
+    {
+        jobBus.call_noreply(subscribe);
+    }
+    catch (const sdbusplus::exception_t& e)
+    {
+        log<level::ERR>(
+            std::format("Error subscribing to systemd ex({})", e.what())
+                .c_str());
+    }
+
+    struct Job
+    {
+        std::string unit;
+        std::string path;
+        std::chrono::steady_clock::time_point start;
+    };
+    std::vector<Job> jobs;
     for (const auto& service : services)
     {
-        auto method = bus.new_method_call(SYSTEMD_BUSNAME, SYSTEMD_PATH,
-                                          SYSTEMD_INTERFACE,
-                                          std::get<0>(service).c_str());
+        auto method = jobBus.new_method_call(SYSTEMD_BUSNAME, SYSTEMD_PATH,
+                                             SYSTEMD_INTERFACE,
+                                             std::get<0>(service).c_str());
         method.append(std::get<1>(service), "replace");
         // Ignore errors if the service is not found - not all systems
         // may have these services
         try
         {
-            bus.call_noreply(method);
+            auto start = std::chrono::steady_clock::now();
+            auto reply = jobBus.call(method);
+            sdbusplus::object_path job;
+            reply.read(job);
+            jobs.push_back({std::get<1>(service), job.str, start});
         }
         catch (const std::exception& e)
         {}
     }
 
-    // Wait a few seconds for the service files and reset operations to finish,
-    // otherwise the BMC may be rebooted and cause corruption.
-    constexpr auto resetWait = std::chrono::seconds(5);
-    std::this_thread::sleep_for(resetWait);
+    // The signals received while starting the units are queued, a job
+    // removed before its path was known is still seen here.
+    constexpr auto resetTimeout = std::chrono::seconds(RESET_TIMEOUT);
+    auto deadline = std::chrono::steady_clock::now() + resetTimeout;
+    while (true)
+    {
+        auto now = std::chrono::steady_clock::now();
+        std::erase_if(jobs, [&removedJobs](const auto& job) {
+            auto removed = removedJobs.find(job.path);
+            if (removed == removedJobs.end())
+            {
+                return false;
+            }
+            const auto& [result, end] = removed->second;
+            auto elapsed = std::chrono::duration_cast<
+                std::chrono::milliseconds>(end - job.start);
+            log<level::INFO>(
+                std::format("Reset service finished unit({}) result({}) "
+                            "elapsed({}ms)",
+                            job.unit, result, elapsed.count())
+                    .c_str());
+            return true;
+        });
+        if (jobs.empty())
+        {
+            break;
+        }
+        if (now >= deadline)
+        {
+            for (const auto& job : jobs)
+            {
+                log<level::ERR>(
+                    std::format("Timed out waiting for reset service unit({}) "
+                                "timeout({}s)",
+                                job.unit, RESET_TIMEOUT)
+                        .c_str());
+            }
+            break;
+        }
+        if (!jobBus.process_discard())
+        {
+            jobBus.wait(std::chrono::duration_cast<std::chrono::microseconds>(
+                deadline - now));
+        }
+    }
 }
 
 bool ItemUpdaterMMC::isVersionFunctional(const std::string& versionId)
@@ -175,16 +268,6 @@ void GardResetMMC::enableInventoryItemsHelper(const std::string& service,
 
         auto response = bus.call(mapperCall);
         response.read(objs);
-        for (auto& obj : objs)
-        {
-            auto method =
-                bus.new_method_call(service.c_str(), obj.c_str(),
-                                    "org.freedesktop.DBus.Properties", "Set");
-            std::variant<bool> propertyVal{true};
-            method.append("xyz.openbmc_project.Object.Enable", "Enabled",
-                          propertyVal);
-            bus.call_noreply(method);
-        }
     }
     catch (const sdbusplus::exception_t& e)
     {
@@ -193,7 +276,75 @@ void GardResetMMC::enableInventoryItemsHelper(const std::string& service,
                         "intf({}) objpath({})",
                         e.what(), intf, objPath)
                 .c_str());
+        return;
+    }
+
+    // The Set calls are pipelined, up to maxSetsInFlight at once, so that
+    // hundreds of items cost about one round trip per window rather than
+    // one each. The replies are processed on a connection of its own, which
+    // does not dispatch the requests queued on the service bus meanwhile.
+    constexpr size_t maxSetsInFlight = 32;
+    auto start = std::chrono::steady_clock::now();
+    auto setBus = sdbusplus::bus::new_system();
+    std::vector<sdbusplus::slot_t> pending;
+    pending.reserve(objs.size());
+    std::vector<std::pair<std::string, std::string>> failures;
+    size_t next = 0;
+    size_t inFlight = 0;
+    while (next < objs.size() || inFlight > 0)
+    {
+        for (; next < objs.size() && inFlight < maxSetsInFlight; ++next)
+        {
+            const auto& obj = objs[next];
+            try
+            {
+                auto method = setBus.new_method_call(
+                    service.c_str(), obj.c_str(),
+                    "org.freedesktop.DBus.Properties", "Set");
+                std::variant<bool> propertyVal{true};
+                method.append("xyz.openbmc_project.Object.Enable", "Enabled",
+                              propertyVal);
+                pending.emplace_back(setBus.call_async(
+                    method, [&failures, &inFlight,
+                             &obj](sdbusplus::message_t& reply) {
+                        --inFlight;
+                        if (reply.is_method_error())
+                        {
+                            auto error = sd_bus_message_get_error(reply.get());
+                            failures.emplace_back(
+                                obj, error && error->name ? error->name
+                                                          : "unknown");
+                        }
+                    }));
+                ++inFlight;
+            }
+            catch (const sdbusplus::exception_t& e)
+            {
+                failures.emplace_back(obj, e.what());
+            }
+        }
+
+        if (inFlight > 0 && !setBus.process_discard())
+        {
+            setBus.wait();
+        }
+    }
+
+    for (const auto& [obj, error] : failures)
+    {
+        log<level::ERR>(
+            std::format("Failed to enable inventory item objpath({}) "
+                        "error({})",
+                        obj, error)
+                .c_str());
     }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    log<level::INFO>(
+        std::format("Enabled inventory items intf({}) items({}) failed({}) "
+                    "elapsed({}ms)",
+                    intf, objs.size(), failures.size(), elapsed.count())
+            .c_str());
 }
 
 void GardResetMMC::reset()
@@ -0,0 +1,382 @@
+#include "lid_integrity.hpp"
+
+#include "digest.hpp"
+#include "hostfw_sync.hpp"
+#include "parallel.hpp"
+
+#include <fcntl.h>
+#include <linux/fsverity.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <phosphor-logging/log.hpp>
+
+#include <cerrno>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+using namespace phosphor::logging;
+namespace fs = std::filesystem;
+
+namespace
+{
+
+/** @brief Largest fs-verity digest, SHA-512 */
+constexpr size_t verityDigestMax = 64;
+
+/** @brief Returns the fs-verity digest of an open file, if it has one. */
+std::optional<LidDigest> measureVerity(int fd)
+{
+    alignas(fsverity_digest) uint8_t buffer[sizeof(fsverity_digest) +
+                                            verityDigestMax] = {};
+    auto measure = reinterpret_cast<fsverity_digest*>(buffer);
+    measure->digest_size = verityDigestMax;
+    if (ioctl(fd, FS_IOC_MEASURE_VERITY, measure) < 0)
+    {
+        // ENODATA: the file has no fs-verity, ENOTTY/EOPNOTSUPP: the
+        // filesystem does not support it.
+        return std::nullopt;
+    }
+
+    LidDigest digest;
+    digest.algorithm = measure->digest_algorithm ==
+                               FS_VERITY_HASH_ALG_SHA512
+                           ? "verity-sha512"
+                           : "verity-sha256";
+    constexpr auto hexDigits = "0123456789abcdef";
+    for (size_t i = 0; i < measure->digest_size; ++i)
+    {
+        digest.value += hexDigits[measure->digest[i] >> 4];
+        digest.value += hexDigits[measure->digest[i] & 0xf];
+    }
+    return digest;
+}
+
+/** @brief Returns a modification time in nanoseconds. */
+int64_t nanoseconds(const struct timespec& time)
+{
+    return static_cast<int64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+}
+
+} // namespace
+
+LidDigest measureLid(const fs::path& lid, bool verify)
+{
+    auto fd = open(lid.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to open " + lid.string());
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        auto error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(),
+                                "Failed to stat " + lid.string());
+    }
+
+    auto verity = measureVerity(fd);
+    if (verity && verify)
+    {
+        // The kernel fails the read of a block that does not match the
+        // fs-verity Merkle tree.
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        std::vector<uint8_t> buffer(256 * 1024);
+        while (true)
+        {
+            auto bytes = read(fd, buffer.data(), buffer.size());
+            if (bytes < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (bytes < 0)
+            {
+                auto error = errno;
+                close(fd);
+                throw std::system_error(error, std::generic_category(),
+                                        "Failed to read " + lid.string());
+            }
+            if (bytes == 0)
+            {
+                break;
+            }
+        }
+    }
+    close(fd);
+
+    auto digest = verity ? *verity : LidDigest{"sha256", fileDigest(lid)};
+    digest.size = st.st_size;
+    digest.mtime = nanoseconds(st.st_mtim);
+    return digest;
+}
+
+int64_t lidModificationTime(const fs::path& lid)
+{
+    struct stat st;
+    if (stat(lid.c_str(), &st) < 0)
+    {
+        return 0;
+    }
+    return nanoseconds(st.st_mtim);
+}
+
+std::set<std::string> hostWrittenLids(const fs::path& roDir,
+                                      const fs::path& runningDir)
+{
+    auto names = tocPartitions(roDir / HOSTFW_TOC_LID, "PRESERVED");
+    names.push_back("DEVTREE");
+    std::set<std::string> lids;
+    for (const auto& name : names)
+    {
+        auto lid = partitionLid(roDir, name);
+        if (!lid)
+        {
+            lid = partitionLid(runningDir, name);
+        }
+        if (lid)
+        {
+            lids.insert(*lid);
+        }
+    }
+    return lids;
+}
+
+void saveIntegrityIndex(const fs::path& file, const IntegrityIndex& index)
+{
+    std::error_code ec;
+    if (index.empty())
+    {
+        fs::remove(file, ec);
+        return;
+    }
+
+    auto tmp = file;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::out | std::ios::trunc);
+        for (const auto& [lid, digest] : index)
+        {
+            out << lid << ' ' << digest.algorithm << ' ' << digest.value << ' '
+                << digest.size << ' ' << digest.mtime << '\n';
+        }
+        out.close();
+        if (!out)
+        {
+            fs::remove(tmp, ec);
+            throw std::runtime_error("Failed to write " + tmp.string());
+        }
+    }
+    fs::rename(tmp, file);
+}
+
+IntegrityIndex loadIntegrityIndex(const fs::path& file)
+{
+    IntegrityIndex index;
+    std::ifstream in(file);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string lid;
+        LidDigest digest;
+        if (fields >> lid >> digest.algorithm >> digest.value >> digest.size)
+        {
+            // An index without the modification times has them unknown
+            fields >> digest.mtime;
+            index.emplace(std::move(lid), std::move(digest));
+        }
+    }
+    return index;
+}
+
+RecoverStats recoverLids(const fs::path& roDir, const fs::path& runningDir,
+                         unsigned jobs)
+{
+    auto start = std::chrono::steady_clock::now();
+    RecoverStats stats;
+
+    // The lids are read through once after each sync.
+    std::error_code ec;
+    auto verifiedFile = runningDir / INTEGRITY_VERIFIED_FILE;
+    bool fullCheck = !fs::exists(verifiedFile, ec);
+    auto indexFile = runningDir / INTEGRITY_INDEX_FILE;
+    auto index = loadIntegrityIndex(indexFile);
+    auto sizeLids = hostWrittenLids(roDir, runningDir);
+
+    struct Check
+    {
+        std::string lid;
+        std::optional<LidDigest> expected;
+        bool hostWritten;
+    };
+    std::vector<Check> checks;
+    for (const auto& lid : sizeLids)
+    {
+        auto expected = index.find(lid);
+        checks.push_back({lid,
+                          expected != index.end()
+                              ? std::make_optional(expected->second)
+                              : std::nullopt,
+                          true});
+    }
+    for (const auto& [lid, digest] : index)
+    {
+        if (!sizeLids.contains(lid))
+        {
+            checks.push_back({lid, digest, false});
+        }
+    }
+
+    // The index entries to refresh, of the lids measured or restored
+    IntegrityIndex updates;
+    std::mutex lock;
+    forEachParallel(checks.size(), jobs, [&](size_t i) {
+        const auto& check = checks[i];
+        auto running = runningDir / check.lid;
+        auto ro = roDir / check.lid;
+        std::error_code ec;
+        if (!fs::is_regular_file(running, ec) || !fs::is_regular_file(ro, ec))
+        {
+            return;
+        }
+
+        LidMismatch mismatch{check.lid, "size", fs::file_size(running),
+                             check.hostWritten ? fs::file_size(ro)
+                                               : check.expected->size};
+        bool damaged = mismatch.current != mismatch.expected;
+
+        // A lid rewritten by the host since the sync can only be checked
+        // by size. A READONLY lid with fs-verity is measured without being
+        // read, the kernel checks its data as the host reads it.
+        std::optional<LidDigest> measured;
+        if (!damaged && check.expected)
+        {
+            bool modified =
+                lidModificationTime(running) != check.expected->mtime;
+            bool verity = check.expected->algorithm.starts_with("verity-");
+            bool measure = check.hostWritten
+                               ? fullCheck && !modified
+                               : fullCheck || verity || modified;
+            if (measure)
+            {
+                try
+                {
+                    measured = measureLid(running, fullCheck);
+                    damaged = *measured != *check.expected;
+                }
+                catch (const std::exception& e)
+                {
+                    // An fs-verity lid fails to read once damaged.
+                    log<level::ERR>("Failed to measure lid",
+                                    entry("FILE_NAME=%s", check.lid.c_str()),
+                                    entry("ERROR=%s", e.what()));
+                    damaged = true;
+                }
+                mismatch.reason = damaged ? "digest" : mismatch.reason;
+            }
+
+            // The index is recorded when the running lids are synchronized,
+            // a lid still identical to the image is not damaged.
+            damaged = damaged && !sameContent(ro, running);
+        }
+
+        {
+            std::lock_guard guard(lock);
+            if (measured)
+            {
+                ++stats.digestChecked;
+            }
+            else
+            {
+                ++stats.sizeChecked;
+            }
+            if (!damaged && measured &&
+                measured->mtime != check.expected->mtime)
+            {
+                updates.emplace(check.lid, *measured);
+            }
+        }
+        if (!damaged)
+        {
+            return;
+        }
+
+        // The lid is rewritten in place as cp -p does, which also repairs
+        // the other hard links of a lid shared through the lid store.
+        try
+        {
+            bool reflinked = false;
+            copyLid(ro, running, reflinked);
+            mismatch.restored = true;
+            if (check.expected)
+            {
+                auto restored = measureLid(running, false);
+                std::lock_guard guard(lock);
+                updates.insert_or_assign(check.lid, restored);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            log<level::ERR>("Failed to restore lid",
+                            entry("FILE_NAME=%s", check.lid.c_str()),
+                            entry("ERROR=%s", e.what()));
+        }
+        std::lock_guard guard(lock);
+        stats.mismatches.push_back(std::move(mismatch));
+    });
+
+    // The index follows the lids measured again, so that they are not read
+    // on every check.
+    if (!updates.empty())
+    {
+        for (auto& [lid, digest] : updates)
+        {
+            index.insert_or_assign(lid, std::move(digest));
+        }
+        try
+        {
+            saveIntegrityIndex(indexFile, index);
+        }
+        catch (const std::exception& e)
+        {
+            log<level::ERR>("Failed to update the integrity index",
+                            entry("ERROR=%s", e.what()));
+        }
+    }
+    if (fullCheck)
+    {
+        std::ofstream verified(verifiedFile);
+    }
+
+    stats.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    log<level::INFO>("Checked the running host firmware",
+                     entry("SIZE_CHECKED=%zu", stats.sizeChecked),
+                     entry("DIGEST_CHECKED=%zu", stats.digestChecked),
+                     entry("MISMATCHES=%zu", stats.mismatches.size()),
+                     entry("FULL_CHECK=%d", fullCheck),
+                     entry("ELAPSED_MS=%lld",
+                           static_cast<long long>(stats.elapsed.count())));
+    return stats;
+}
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+/** @brief File of the running directory holding its integrity index */
+constexpr auto INTEGRITY_INDEX_FILE = ".integrity";
+
+/** @brief File of the running directory telling its lids were verified
+ *         since they were synchronized
+ */
+constexpr auto INTEGRITY_VERIFIED_FILE = ".integrity-verified";
+
+/** @struct LidDigest
+ *  @brief The expected content of a lid.
+ */
+struct LidDigest
+{
+    /** @brief The digest algorithm, "sha256" for a digest of the content or
+     *         "verity-sha256"/"verity-sha512" for an fs-verity digest
+     */
+    std::string algorithm;
+    /** @brief The lowercase hexadecimal digest */
+    std::string value;
+    /** @brief The lid size */
+    uintmax_t size = 0;
+    /** @brief The modification time of the lid when it was measured, in
+     *         nanoseconds, 0 if unknown
+     */
+    int64_t mtime = 0;
+
+    /** @brief Whether two digests describe the same content, whatever the
+     *         modification time.
+     */
+    bool operator==(const LidDigest& other) const
+    {
+        return algorithm == other.algorithm && value == other.value &&
+               size == other.size;
+    }
+};
+
+/** @brief The expected content of the lids of a directory, by lid name */
+using IntegrityIndex = std::map<std::string, LidDigest>;
+
+/** @struct LidMismatch
+ *  @brief A running lid that does not match its expected content.
+ */
+struct LidMismatch
+{
+    /** @brief The lid file name */
+    std::string lid;
+    /** @brief What did not match, "size" or "digest" */
+    std::string reason;
+    /** @brief The size of the running lid */
+    uintmax_t current = 0;
+    /** @brief The expected size */
+    uintmax_t expected = 0;
+    /** @brief Whether the lid was restored from the read-only image */
+    bool restored = false;
+};
+
+/** @struct RecoverStats
+ *  @brief Outcome of the integrity check of the running lids.
+ */
+struct RecoverStats
+{
+    /** @brief Number of lids checked by size and modification time only */
+    size_t sizeChecked = 0;
+    /** @brief Number of lids checked by digest */
+    size_t digestChecked = 0;
+    /** @brief The lids that did not match */
+    std::vector<LidMismatch> mismatches;
+    /** @brief Time spent */
+    std::chrono::milliseconds elapsed{0};
+};
+
+/** @brief Computes the digest of a lid.
+ *  @details The fs-verity digest is used when the lid has fs-verity
+ *  enabled, the kernel then checks the data against it as it is read, and
+ *  only a verifying measure reads the lid. A SHA-256 digest of the content
+ *  is computed otherwise.
+ *
+ *  @param[in] lid    - The lid.
+ *  @param[in] verify - Whether to read an fs-verity lid through.
+ *  @return The digest, throws on failure, e.g. an fs-verity lid whose data
+ *          does not match its digest.
+ */
+LidDigest measureLid(const std::filesystem::path& lid, bool verify = true);
+
+/** @brief Returns the modification time of a lid in nanoseconds, 0 if it
+ *         cannot be read.
+ */
+int64_t lidModificationTime(const std::filesystem::path& lid);
+
+/** @brief Returns the lids the host and PHAL rewrite, those of the
+ *         PRESERVED partitions and of DEVTREE.
+ *  @details The partition links of the image are used, or those left in
+ *  the running directory by setup-host-firmware.
+ *
+ *  @param[in] roDir      - The read-only image directory.
+ *  @param[in] runningDir - The running directory.
+ */
+std::set<std::string> hostWrittenLids(const std::filesystem::path& roDir,
+                                      const std::filesystem::path& runningDir);
+
+/** @brief Saves an integrity index, replacing the file in a single rename.
+ *         An empty index removes the file.
+ */
+void saveIntegrityIndex(const std::filesystem::path& file,
+                        const IntegrityIndex& index);
+
+/** @brief Loads an integrity index, empty if the file does not exist. */
+IntegrityIndex loadIntegrityIndex(const std::filesystem::path& file);
+
+/** @brief Checks the running lids and restores the damaged ones from the
+ *         read-only image.
+ *  @details The host and PHAL rewrite the lids of the PRESERVED partitions
+ *  and of DEVTREE, so those lids are checked by size against the image as
+ *  before. Their digest, recorded when the sync wrote them, is only checked
+ *  on the first check after the sync, and only if they were not rewritten
+ *  since. The READONLY lids recorded in the integrity index are checked by
+ *  digest on the first check after the sync, which catches damage that
+ *  keeps the size. Later checks only measure an fs-verity lid, which does
+ *  not read it, or a lid modified since it was recorded, the other lids are
+ *  checked by size and modification time. The lids are checked in
+ *  parallel.
+ *
+ *  @param[in] roDir      - The read-only image directory.
+ *  @param[in] runningDir - The running directory.
+ *  @param[in] jobs       - The number of parallel checks, 0 for one per CPU.
+ *  @return The check statistics, throws if the directories cannot be read.
+ */
+RecoverStats recoverLids(const std::filesystem::path& roDir,
+                         const std::filesystem::path& runningDir,
+                         unsigned jobs = 0);
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
@@ -0,0 +1,218 @@
+#include "lid_store.hpp"
+
+#include "digest.hpp"
+#include "hostfw_sync.hpp"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+/** @brief Prefix of the entries being written, skipped by the lookups */
+constexpr auto tmpPrefix = ".";
+
+/** @brief File of a set holding the stamp of its image */
+constexpr auto stampFile = ".stamp";
+
+/** @brief File of a set holding the digest of each of its lids */
+constexpr auto digestsFile = ".digests";
+
+/** @brief Writes a small file of a set. */
+void writeFile(const fs::path& path, const std::string& content)
+{
+    std::ofstream file(path);
+    file << content;
+    file.close();
+    if (!file)
+    {
+        throw std::runtime_error("Failed to write " + path.string());
+    }
+}
+
+} // namespace
+
+LidStore::LidStore(const fs::path& root, const std::string& set,
+                   const std::string& stamp) :
+    blobs(root / "blobs"), sets(root / "sets"), set(set), stamp(stamp)
+{
+    if (set.empty() || set.find('/') != std::string::npos ||
+        set.starts_with(tmpPrefix))
+    {
+        throw std::invalid_argument("Invalid lid set: " + set);
+    }
+    fs::create_directories(blobs);
+    fs::create_directories(sets);
+
+    std::ifstream file(sets / set / stampFile);
+    std::string published{std::istreambuf_iterator<char>(file),
+                          std::istreambuf_iterator<char>()};
+    current = file && !stamp.empty() && published == stamp;
+    if (current)
+    {
+        std::ifstream list(sets / set / digestsFile);
+        std::string lid;
+        std::string digest;
+        while (list >> lid >> digest)
+        {
+            digests.emplace(lid, digest);
+        }
+    }
+}
+
+std::string LidStore::imageStamp(const fs::path& image)
+{
+    struct stat st;
+    if (stat(image.c_str(), &st) < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to stat " + image.string());
+    }
+    return std::to_string(st.st_size) + " " + std::to_string(st.st_ino) +
+           " " + std::to_string(st.st_mtim.tv_sec) + "." +
+           std::to_string(st.st_mtim.tv_nsec);
+}
+
+fs::path LidStore::find(const std::string& lid) const
+{
+    auto digest = digests.find(lid);
+    if (!current || digest == digests.end())
+    {
+        return {};
+    }
+    std::error_code ec;
+    auto blob = blobs / digest->second;
+    if (!fs::is_regular_file(blob, ec))
+    {
+        return {};
+    }
+    return blob;
+}
+
+fs::path LidStore::store(const fs::path& file, uintmax_t& written)
+{
+    written = 0;
+    auto blob = blobs / fileDigest(file);
+    std::error_code ec;
+    if (fs::exists(blob, ec))
+    {
+        return blob;
+    }
+
+    // Blobs are written aside so that a blob name always refers to its
+    // complete content. Two lids of the same content may be stored at once.
+    auto tmp = blobs / (tmpPrefix + blob.filename().string() + "." +
+                        std::to_string(gettid()));
+    try
+    {
+        bool reflinked = false;
+        written = copyLid(file, tmp, reflinked);
+        fs::permissions(tmp, fs::perms::owner_read | fs::perms::group_read |
+                                 fs::perms::others_read);
+        fs::rename(tmp, blob);
+    }
+    catch (...)
+    {
+        fs::remove(tmp, ec);
+        throw;
+    }
+    return blob;
+}
+
+bool LidStore::link(const fs::path& blob, const fs::path& target)
+{
+    struct stat blobSt;
+    struct stat targetSt;
+    if (stat(blob.c_str(), &blobSt) < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to stat " + blob.string());
+    }
+    if (lstat(target.c_str(), &targetSt) == 0 &&
+        blobSt.st_dev == targetSt.st_dev && blobSt.st_ino == targetSt.st_ino)
+    {
+        return false;
+    }
+
+    auto tmp = target.parent_path() /
+               (tmpPrefix + target.filename().string() + ".link");
+    std::error_code ec;
+    fs::remove(tmp, ec);
+    fs::create_hard_link(blob, tmp);
+    fs::rename(tmp, target);
+    return true;
+}
+
+void LidStore::publish(const std::map<std::string, fs::path>& lids)
+{
+    auto staging = sets / (tmpPrefix + set);
+    fs::remove_all(staging);
+    fs::create_directory(staging);
+
+    // The links hold the blobs of the set, the digests name them.
+    digests.clear();
+    for (const auto& [lid, blob] : lids)
+    {
+        fs::create_hard_link(blob, staging / lid);
+        digests.emplace(lid, blob.filename().string());
+    }
+    std::string list;
+    for (const auto& [lid, digest] : digests)
+    {
+        list += lid + " " + digest + "\n";
+    }
+    writeFile(staging / digestsFile, list);
+    writeFile(staging / stampFile, stamp);
+
+    auto target = sets / set;
+    fs::remove_all(target);
+    fs::rename(staging, target);
+    current = !stamp.empty();
+}
+
+size_t LidStore::collectGarbage()
+{
+    size_t removed = 0;
+    std::error_code ec;
+
+    for (const auto& dir : fs::directory_iterator(sets))
+    {
+        if (dir.path().filename().string().starts_with(tmpPrefix))
+        {
+            fs::remove_all(dir.path(), ec);
+        }
+    }
+
+    for (const auto& blob : fs::directory_iterator(blobs))
+    {
+        // Each running lid and set entry is a hard link, the last link is
+        // the blob itself.
+        if (blob.path().filename().string().starts_with(tmpPrefix) ||
+            fs::hard_link_count(blob.path(), ec) == 1)
+        {
+            if (fs::remove(blob.path(), ec))
+            {
+                ++removed;
+            }
+        }
+    }
+    return removed;
+}
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+/** @brief Directory of the lid store on the eMMC */
+constexpr auto LID_STORE_DIR = "/media/hostfw/store";
+
+/** @class LidStore
+ *  @brief Content-addressed store of the read-only host firmware lids.
+ *  @details Each lid content is stored once under [root]/blobs/[sha256].
+ *  The running lids are hard links to the blobs, and so are the entries of
+ *  the lid set of each image, [root]/sets/[set]/[lid], e.g. one set for the
+ *  hostfw-a image and one for hostfw-b. A set also lists the digest of each
+ *  of its lids. A lid identical in both images is stored once, and
+ *  switching back to an image whose set is current only relinks the
+ *  running lids. A blob is dropped once nothing links to it.
+ *
+ *  The store is meant for the lids the host only reads, a write to a
+ *  running lid would change the blob for every set linking to it.
+ */
+class LidStore
+{
+  public:
+    LidStore() = delete;
+    LidStore(const LidStore&) = delete;
+    LidStore& operator=(const LidStore&) = delete;
+    LidStore(LidStore&&) = delete;
+    LidStore& operator=(LidStore&&) = delete;
+    ~LidStore() = default;
+
+    /** @brief Constructs LidStore, creating its directories.
+     *
+     *  @param[in] root  - The directory holding the store.
+     *  @param[in] set   - The lid set of the image being used, e.g. "a".
+     *  @param[in] stamp - Identifies the content of the image, e.g. the
+     *                     size and time of the image file. The set is
+     *                     trusted only if it was published with the same
+     *                     stamp.
+     */
+    LidStore(const std::filesystem::path& root, const std::string& set,
+             const std::string& stamp);
+
+    /** @brief Returns the blob of a lid of the current set, or an empty
+     *         path if the set is not current or lacks the lid.
+     */
+    std::filesystem::path find(const std::string& lid) const;
+
+    /** @brief Stores the content of a file, if not stored yet.
+     *
+     *  @param[in]  file    - The file.
+     *  @param[out] written - The bytes written to the store.
+     *  @return The blob.
+     */
+    std::filesystem::path store(const std::filesystem::path& file,
+                                uintmax_t& written);
+
+    /** @brief Replaces a file by a hard link to a blob, in a single rename.
+     *
+     *  @param[in] blob   - The blob.
+     *  @param[in] target - The file to replace.
+     *  @return False if the file already was a link to the blob.
+     */
+    static bool link(const std::filesystem::path& blob,
+                     const std::filesystem::path& target);
+
+    /** @brief Records the lids of the current set along with its stamp.
+     *  @details The set is built aside and renamed into place.
+     *
+     *  @param[in] lids - The blob of each lid.
+     */
+    void publish(const std::map<std::string, std::filesystem::path>& lids);
+
+    /** @brief Returns the stamp of an image file, from its size, inode and
+     *         modification time.
+     */
+    static std::string imageStamp(const std::filesystem::path& image);
+
+    /** @brief Removes the blobs nothing links to, along with the leftovers
+     *         of interrupted operations.
+     *
+     *  @return The number of blobs removed.
+     */
+    size_t collectGarbage();
+
+  private:
+    /** @brief The directory holding the blobs */
+    std::filesystem::path blobs;
+
+    /** @brief The directory holding the lid sets */
+    std::filesystem::path sets;
+
+    /** @brief The current set */
+    std::string set;
+
+    /** @brief The stamp of the image of the current set */
+    std::string stamp;
+
+    /** @brief Whether the current set was published with the stamp */
+    bool current = false;
+
+    /** @brief The digest of each lid of the current set */
+    std::map<std::string, std::string> digests;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
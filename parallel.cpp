@@ -0,0 +1,65 @@
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+void forEachParallel(size_t count, unsigned jobs,
+                     const std::function<void(size_t)>& task)
+{
+    std::atomic<size_t> next = 0;
+    std::mutex lock;
+    std::exception_ptr error;
+    auto worker = [&]() {
+        try
+        {
+            for (auto i = next++; i < count; i = next++)
+            {
+                task(i);
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard guard(lock);
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+            next = count;
+        }
+    };
+
+    if (jobs == 0)
+    {
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+    jobs = std::min<size_t>(jobs, std::max<size_t>(count, 1));
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < jobs; ++i)
+    {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers)
+    {
+        thread.join();
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
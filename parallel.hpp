@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+/** @brief Runs a task for each index of [0, count) on a pool of threads.
+ *  @details The first exception thrown by a task stops the pool, once the
+ *  tasks in progress are done, and is rethrown.
+ *
+ *  @param[in] count - The number of tasks.
+ *  @param[in] jobs  - The number of threads, 0 for one per CPU.
+ *  @param[in] task  - The task, called with its index.
+ */
+void forEachParallel(size_t count, unsigned jobs,
+                     const std::function<void(size_t)>& task);
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
@@ -0,0 +1,452 @@
+#include "config.h"
+
+#include "pnor_packager.hpp"
+
+#include "parallel.hpp"
+#include "tar_writer.hpp"
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+using EVP_PKEY_Ptr = std::unique_ptr<EVP_PKEY, decltype(&::EVP_PKEY_free)>;
+using EVP_MD_CTX_Ptr =
+    std::unique_ptr<EVP_MD_CTX, decltype(&::EVP_MD_CTX_free)>;
+using FILE_Ptr = std::unique_ptr<FILE, decltype(&::fclose)>;
+using BIO_MEM_Ptr = std::unique_ptr<BIO, decltype(&::BIO_free)>;
+
+/** @brief Magic number of a secure boot container header, see
+ *  https://github.com/open-power/skiboot/blob/master/libstb/container.h
+ */
+constexpr std::array<uint8_t, 4> SECURE_MAGIC = {0x17, 0x08, 0x20, 0x11};
+
+/** @brief Size of a secure boot container header */
+constexpr size_t SECURE_HEADER_SIZE = 4096;
+
+/** @brief The flags of an entry, in the order pflash --detail prints them */
+constexpr std::array<std::pair<uint8_t, const char*>, 7> miscFlagNames = {{
+    {FFS_MISCFLAGS_PRESERVED, "PRESERVED"},
+    {FFS_MISCFLAGS_READONLY, "READONLY"},
+    {FFS_MISCFLAGS_BACKUP, "BACKUP"},
+    {FFS_MISCFLAGS_REPROVISION, "REPROVISION"},
+    {FFS_MISCFLAGS_GOLDEN, "GOLDEN"},
+    {FFS_MISCFLAGS_CLEARECC, "CLEARECC"},
+    {FFS_MISCFLAGS_VOLATILE, "VOLATILE"},
+}};
+
+/** @brief Runs a command in a directory, throws if it fails. */
+void runCommand(const std::vector<std::string>& args, const fs::path& dir)
+{
+    std::vector<char*> argv;
+    for (const auto& arg : args)
+    {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    auto pid = fork();
+    if (pid < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to run " + args.front());
+    }
+    if (pid == 0)
+    {
+        if (chdir(dir.c_str()) == 0)
+        {
+            execvp(argv[0], argv.data());
+        }
+        std::perror(argv[0]);
+        _exit(127);
+    }
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to wait for " + args.front());
+        }
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        throw std::runtime_error(args.front() + " failed");
+    }
+}
+
+/** @brief Reads a PEM private key. */
+EVP_PKEY_Ptr readPrivateKey(const fs::path& privateKey)
+{
+    FILE_Ptr file(std::fopen(privateKey.c_str(), "r"), &::fclose);
+    if (!file)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to open " + privateKey.string());
+    }
+    EVP_PKEY_Ptr key(PEM_read_PrivateKey(file.get(), nullptr, nullptr, nullptr),
+                     &::EVP_PKEY_free);
+    if (!key)
+    {
+        throw std::runtime_error("Invalid private key " + privateKey.string());
+    }
+    return key;
+}
+
+/** @brief Returns the PEM public key of a private key, as openssl pkey
+ *         -pubout writes it.
+ */
+std::string publicKeyPem(EVP_PKEY* key)
+{
+    BIO_MEM_Ptr bio(BIO_new(BIO_s_mem()), &::BIO_free);
+    if (!bio || PEM_write_bio_PUBKEY(bio.get(), key) != 1)
+    {
+        throw std::runtime_error("Failed to write the public key");
+    }
+    char* data = nullptr;
+    auto size = BIO_get_mem_data(bio.get(), &data);
+    return std::string(data, size);
+}
+
+/** @class Signer
+ *  @brief Signs data as it streams by, as openssl dgst -sha256 -sign.
+ */
+class Signer
+{
+  public:
+    explicit Signer(EVP_PKEY* key) : ctx(EVP_MD_CTX_new(), &::EVP_MD_CTX_free)
+    {
+        if (!ctx || EVP_DigestSignInit(ctx.get(), nullptr, EVP_sha256(),
+                                       nullptr, key) != 1)
+        {
+            throw std::runtime_error("Failed to initialize the signature");
+        }
+    }
+
+    void update(const uint8_t* data, size_t size)
+    {
+        if (EVP_DigestSignUpdate(ctx.get(), data, size) != 1)
+        {
+            throw std::runtime_error("Failed to sign");
+        }
+    }
+
+    /** @brief Returns the signature of the data. */
+    std::string finish()
+    {
+        size_t size = 0;
+        if (EVP_DigestSignFinal(ctx.get(), nullptr, &size) != 1)
+        {
+            throw std::runtime_error("Failed to sign");
+        }
+        std::string signature(size, '\0');
+        if (EVP_DigestSignFinal(ctx.get(),
+                                reinterpret_cast<uint8_t*>(signature.data()),
+                                &size) != 1)
+        {
+            throw std::runtime_error("Failed to sign");
+        }
+        signature.resize(size);
+        return signature;
+    }
+
+  private:
+    EVP_MD_CTX_Ptr ctx;
+};
+
+/** @brief Writes a file, throws on failure. */
+void writeFile(const fs::path& file, const void* data, size_t size)
+{
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    out.write(static_cast<const char*>(data), size);
+    out.close();
+    if (!out)
+    {
+        throw std::runtime_error("Failed to write " + file.string());
+    }
+}
+
+/** @brief A temporary directory, removed with its content on destruction. */
+class ScratchDir
+{
+  public:
+    ScratchDir()
+    {
+        auto tmpl = fs::temp_directory_path() / "generate-tar.XXXXXX";
+        std::string path = tmpl.string();
+        if (!mkdtemp(path.data()))
+        {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to create " + path);
+        }
+        dir = path;
+    }
+
+    ScratchDir(const ScratchDir&) = delete;
+    ScratchDir& operator=(const ScratchDir&) = delete;
+
+    ~ScratchDir()
+    {
+        // The partition files are read-only, which does not prevent their
+        // removal.
+        std::error_code ec;
+        fs::remove_all(dir, ec);
+    }
+
+    const fs::path& path() const
+    {
+        return dir;
+    }
+
+  private:
+    fs::path dir;
+};
+
+} // namespace
+
+PnorToc makeToc(const Ffs& ffs)
+{
+    PnorToc ret;
+
+    auto version = ffs.find(PNOR_VERSION_PARTITION);
+    if (!version)
+    {
+        throw std::runtime_error("No VERSION partition");
+    }
+    auto data = ffs.readPartition(*version);
+    auto begin = data.begin();
+    if (data.size() >= SECURE_MAGIC.size() &&
+        std::equal(SECURE_MAGIC.begin(), SECURE_MAGIC.end(), data.begin()))
+    {
+        // Skip the secure boot header of a signed partition
+        begin += std::min(data.size(), SECURE_HEADER_SIZE);
+    }
+    std::istringstream lines(std::string(begin, std::find(begin, data.end(),
+                                                          '\0')));
+    std::getline(lines, ret.version);
+    std::string word;
+    while (lines >> word)
+    {
+        ret.extendedVersion += ret.extendedVersion.empty() ? "" : ",";
+        ret.extendedVersion += word;
+    }
+
+    ret.toc = "version=" + ret.version + "\n" +
+              "extended_version=" + ret.extendedVersion + "\n";
+    const auto& entries = ffs.entries();
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        const auto& part = entries[i];
+        if (part.name.find("BACKUP") != std::string::npos)
+        {
+            continue;
+        }
+
+        char line[128];
+        std::snprintf(line, sizeof(line),
+                      "partition%02zu=%s,0x%08llx,0x%08llx,%02x", i,
+                      part.name.c_str(),
+                      static_cast<unsigned long long>(part.offset),
+                      static_cast<unsigned long long>(part.offset + part.size),
+                      part.verCheck);
+        ret.toc += line;
+        if (part.ecc())
+        {
+            ret.toc += ",ECC";
+        }
+        for (const auto& [flag, name] : miscFlagNames)
+        {
+            if (part.miscFlags & flag)
+            {
+                ret.toc += ',';
+                ret.toc += name;
+            }
+        }
+        if (!(part.miscFlags &
+              (FFS_MISCFLAGS_READONLY | FFS_MISCFLAGS_PRESERVED)))
+        {
+            ret.toc += ",READWRITE";
+        }
+        ret.toc += '\n';
+        ret.partitions.push_back(part);
+    }
+    return ret;
+}
+
+void extractPartitions(const Ffs& ffs, const std::vector<FfsEntry>& partitions,
+                       const fs::path& dir, unsigned jobs)
+{
+    forEachParallel(partitions.size(), jobs, [&](size_t i) {
+        const auto& part = partitions[i];
+        if (part.name.empty() || part.name == "." || part.name == ".." ||
+            part.name.find('/') != std::string::npos)
+        {
+            throw std::runtime_error("Invalid partition name " + part.name);
+        }
+        auto data = ffs.readPartition(part);
+        auto file = dir / part.name;
+        writeFile(file, data.data(), data.size());
+        fs::permissions(file, fs::perms::owner_read | fs::perms::group_read);
+    });
+}
+
+fs::path defaultTarball(const fs::path& pnor, const std::string& imageType)
+{
+    auto name = pnor.filename().string();
+    if (pnor.extension() != ".pnor")
+    {
+        name += ".pnor";
+    }
+    name += "." + imageType + ".tar";
+    if (imageType == "static")
+    {
+        // The static layout tarball is compressed
+        name += ".gz";
+    }
+    return fs::current_path() / name;
+}
+
+void packagePnor(const PackageOptions& options)
+{
+    if (options.imageType != "squashfs" && options.imageType != "static")
+    {
+        throw std::invalid_argument("Invalid image type " + options.imageType);
+    }
+    auto tarball = options.tarball.empty()
+                       ? defaultTarball(options.pnor, options.imageType)
+                       : fs::absolute(options.tarball);
+    ScratchDir scratch;
+
+    std::cout << "Parsing PNOR TOC...\n";
+    Ffs ffs(options.pnor);
+    auto toc = makeToc(ffs);
+
+    if (options.imageType == "squashfs")
+    {
+        // The partitions are only needed in the squashfs image, the static
+        // layout packages the PNOR file itself.
+        auto pnorDir = scratch.path() / "pnor";
+        fs::create_directory(pnorDir);
+        std::cout << "Reading " << toc.partitions.size() << " partitions...\n";
+        extractPartitions(ffs, toc.partitions, pnorDir, options.jobs);
+        writeFile(pnorDir / PNOR_TOC_FILE, toc.toc.data(), toc.toc.size());
+        fs::permissions(pnorDir / PNOR_TOC_FILE,
+                        fs::perms::owner_read | fs::perms::group_read);
+
+        std::cout << "Creating SquashFS image...\n";
+        std::vector<std::string> args = {"mksquashfs", PNOR_TOC_FILE};
+        for (const auto& part : toc.partitions)
+        {
+            args.push_back(part.name);
+        }
+        args.push_back((scratch.path() / "pnor.xz.squashfs").string());
+        args.push_back("-all-root");
+        if (options.jobs != 0)
+        {
+            args.push_back("-processors");
+            args.push_back(std::to_string(options.jobs));
+        }
+        if (options.mtime)
+        {
+            // A reproducible squashfs image
+            args.push_back("-mkfs-time");
+            args.push_back(std::to_string(*options.mtime));
+            args.push_back("-all-time");
+            args.push_back(std::to_string(*options.mtime));
+        }
+        runCommand(args, pnorDir);
+    }
+
+    std::cout << "Creating MANIFEST for the image\n";
+    std::string manifest =
+        "purpose=xyz.openbmc_project.Software.Version.VersionPurpose.Host\n"
+        "version=" +
+        toc.version + "\nextended_version=" + toc.extendedVersion + "\n";
+    if (!options.machineName.empty())
+    {
+        manifest += "MachineName=" + options.machineName + "\n";
+    }
+    if (options.privateKey)
+    {
+        manifest += "KeyType=" + options.privateKey->stem().string() + "\n";
+        manifest += "HashType=RSA-SHA256\n";
+    }
+
+    // The files are signed as they are written to the tarball, and their
+    // signatures added at its end, as generate-tar adds them through a *.sig
+    // glob.
+    auto key = options.privateKey ? readPrivateKey(*options.privateKey)
+                                  : EVP_PKEY_Ptr(nullptr, &::EVP_PKEY_free);
+    std::map<std::string, std::string> signatures;
+    TarWriter tar(tarball, options.imageType == "static",
+                  options.mtime.value_or(std::time(nullptr)));
+    auto add = [&](const std::string& name, const auto& source) {
+        if (!key)
+        {
+            tar.add(name, source);
+            return;
+        }
+        Signer signer(key.get());
+        tar.add(name, source, [&signer](const uint8_t* data, size_t size) {
+            signer.update(data, size);
+        });
+        signatures.emplace(name + SIGNATURE_FILE_EXT, signer.finish());
+    };
+
+    add(MANIFEST_FILE, std::string_view(manifest));
+    std::string publicKey;
+    if (key)
+    {
+        publicKey = publicKeyPem(key.get());
+        add(PUBLICKEY_FILE_NAME, std::string_view(publicKey));
+    }
+    if (options.imageType == "squashfs")
+    {
+        add("pnor.xz.squashfs", scratch.path() / "pnor.xz.squashfs");
+    }
+    else
+    {
+        add(options.pnor.filename().string(), options.pnor);
+    }
+    for (const auto& [name, signature] : signatures)
+    {
+        tar.add(name, std::string_view(signature));
+    }
+    tar.close();
+
+    std::cout << (options.imageType == "static" ? "Static layout tarball at "
+                                                : "SquashFSTarball at ")
+              << tarball.string() << "\n";
+}
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "static/ffs.hpp"
+
+#include <ctime>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+/** @struct PnorToc
+ *  @brief The pnor.toc of a PNOR image and the version it carries.
+ */
+struct PnorToc
+{
+    /** @brief The first line of the VERSION partition */
+    std::string version;
+    /** @brief The words of the other lines of the VERSION partition,
+     *         comma separated
+     */
+    std::string extendedVersion;
+    /** @brief The pnor.toc content */
+    std::string toc;
+    /** @brief The partitions listed in the pnor.toc */
+    std::vector<FfsEntry> partitions;
+};
+
+/** @struct PackageOptions
+ *  @brief What generate-tar is asked to package.
+ */
+struct PackageOptions
+{
+    /** @brief The PNOR image */
+    std::filesystem::path pnor;
+    /** @brief The image type, "squashfs" or "static" */
+    std::string imageType;
+    /** @brief The tarball, see defaultTarball if empty */
+    std::filesystem::path tarball;
+    /** @brief The private key to sign the files with, if any */
+    std::optional<std::filesystem::path> privateKey;
+    /** @brief The target machine name, if not empty */
+    std::string machineName;
+    /** @brief The number of parallel jobs, 0 for one per CPU */
+    unsigned jobs = 0;
+    /** @brief The modification time of the packaged files, the current
+     *         time if not set
+     */
+    std::optional<time_t> mtime;
+};
+
+/** @brief Builds the pnor.toc of a PNOR image.
+ *  @details This is the pnor.toc generate-tar writes from the output of
+ *  pflash --info and pflash --detail, e.g.
+ *  partition05=SECBOOT,0x00381000,0x003a5000,00,ECC,PRESERVED
+ *  preceded by the version lines. The BACKUP partitions are left out.
+ *
+ *  @param[in] ffs - The PNOR image.
+ *  @return The pnor.toc and the version, throws on failure.
+ */
+PnorToc makeToc(const Ffs& ffs);
+
+/** @brief Writes the data of partitions to a directory, in parallel.
+ *  @details Each partition is written to a read-only file named after it,
+ *  with its ECC bytes stripped as pflash --read does.
+ *
+ *  @param[in] ffs        - The PNOR image.
+ *  @param[in] partitions - The partitions.
+ *  @param[in] dir        - The directory.
+ *  @param[in] jobs       - The number of threads, 0 for one per CPU.
+ */
+void extractPartitions(const Ffs& ffs, const std::vector<FfsEntry>& partitions,
+                       const std::filesystem::path& dir, unsigned jobs);
+
+/** @brief Returns the tarball generate-tar writes by default,
+ *         <PNOR FILE>.pnor.<image type>.tar[.gz] in the current directory.
+ */
+std::filesystem::path defaultTarball(const std::filesystem::path& pnor,
+                                     const std::string& imageType);
+
+/** @brief Packages a PNOR image and its MANIFEST in a tarball.
+ *  @details This does what generate-tar does with pflash, mksquashfs,
+ *  openssl and tar, reading the partition table once and the partitions in
+ *  parallel. The squashfs image is still built by mksquashfs. The tarball
+ *  is streamed, each file is signed as it is written to it, and the
+ *  signatures are added at its end.
+ *
+ *  @param[in] options - What to package.
+ */
+void packagePnor(const PackageOptions& options);
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
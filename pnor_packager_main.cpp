@@ -0,0 +1,55 @@
+#include "pnor_packager.hpp"
+
+#include <CLI/CLI.hpp>
+
+#include <exception>
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[])
+{
+    using namespace openpower::software::updater;
+
+    CLI::App app{"Generate a tarball with a PNOR image and its MANIFEST"};
+    PackageOptions options;
+    std::string privateKey;
+
+    app.add_option("-i,--image", options.imageType,
+                   "Generate a SquashFS image or use the static PNOR")
+        ->required()
+        ->check(CLI::IsMember({"squashfs", "static"}));
+    app.add_option("-f,--file", options.tarball,
+                   "The tarball, <PNOR FILE>.pnor.<image>.tar[.gz] in the "
+                   "current directory by default");
+    app.add_option("-s,--sign", privateKey,
+                   "Sign the files with this private key");
+    app.add_option("-m,--machine", options.machineName,
+                   "The target machine name of the image");
+    app.add_option("-j,--jobs", options.jobs,
+                   "The number of parallel jobs, one per CPU by default");
+    app.add_option("--mtime", options.mtime,
+                   "The modification time of the packaged files, in seconds "
+                   "since the epoch, SOURCE_DATE_EPOCH by default")
+        ->envname("SOURCE_DATE_EPOCH");
+    app.add_option("pnor", options.pnor, "The PNOR file")
+        ->required()
+        ->check(CLI::ExistingFile);
+    CLI11_PARSE(app, argc, argv);
+
+    if (!privateKey.empty())
+    {
+        options.privateKey = privateKey;
+    }
+
+    try
+    {
+        packagePnor(options);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Failed to package " << options.pnor.string() << ": "
+                  << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
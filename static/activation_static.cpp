@@ -1,6 +1,7 @@
 #include "activation_static.hpp"
 
 #include "item_updater.hpp"
+#include "pnor_flash.hpp"
 
 #include <phosphor-logging/log.hpp>
 
@@ -136,6 +137,32 @@ void ActivationStatic::finishActivation()
 {
     activationProgress->progress(90);
 
+    // Every block is read to be compared, the changed ones are read again
+    // to be verified, then the whole flash if the verification is enabled.
+    FlashIoCounts io;
+    FlashStats stats;
+    auto statsFile = pnorFilePath.string() + FLASH_STATS_SUFFIX;
+    if (loadFlashStats(statsFile, stats))
+    {
+        io.payload = stats.imageSize;
+        io.read = (2 * stats.blocks - stats.skipped) * stats.eraseSize +
+                  stats.verified;
+        io.written = stats.programmed * stats.eraseSize;
+        io.erased = stats.erased * stats.eraseSize;
+        std::error_code ec;
+        fs::remove(statsFile, ec);
+    }
+    else
+    {
+        std::error_code ec;
+        io.payload = fs::file_size(pnorFilePath, ec);
+        if (ec)
+        {
+            io.payload = 0;
+        }
+    }
+    flashIo.record("activation", io);
+
     // Set Redundancy Priority before setting to Active
     if (!redundancyPriority)
     {
@@ -0,0 +1,483 @@
+#include "ecc.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ECC_X86 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ECC_NEON 1
+#endif
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+namespace ecc
+{
+
+namespace
+{
+
+/** @brief The ECC matrix of the PNOR flash, see libflash/ecc.c in skiboot.
+ *  @details Bit i of the ECC byte of a word is the parity of the word,
+ *  read as a big endian 64-bit value, masked with row i.
+ */
+constexpr uint64_t matrix[8] = {
+    0x0000e8423c0f99ffull, 0x00e8423c0f99ff00ull, 0xe8423c0f99ff0000ull,
+    0x423c0f99ff0000e8ull, 0x3c0f99ff0000e842ull, 0x0f99ff0000e8423cull,
+    0x99ff0000e8423c0full, 0xff0000e8423c0f99ull,
+};
+
+constexpr uint8_t generateValue(uint64_t value)
+{
+    uint8_t ecc = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        ecc |= (std::popcount(matrix[i] & value) & 1) << i;
+    }
+    return ecc;
+}
+
+/** @brief ECC contribution of each byte value at each position of a word,
+ *         the ECC being linear.
+ */
+using ByteTables = std::array<std::array<uint8_t, 256>, WORD_SIZE>;
+
+constexpr ByteTables makeByteTables()
+{
+    ByteTables tables{};
+    for (size_t pos = 0; pos < WORD_SIZE; ++pos)
+    {
+        for (unsigned byte = 0; byte < 256; ++byte)
+        {
+            tables[pos][byte] = generateValue(uint64_t(byte)
+                                              << (8 * (WORD_SIZE - 1 - pos)));
+        }
+    }
+    return tables;
+}
+
+constexpr ByteTables byteTables = makeByteTables();
+
+/** @brief The byte tables split per nibble, for the SIMD table lookups */
+struct NibbleTables
+{
+    alignas(16) uint8_t low[WORD_SIZE][16];
+    alignas(16) uint8_t high[WORD_SIZE][16];
+};
+
+constexpr NibbleTables makeNibbleTables()
+{
+    NibbleTables tables{};
+    for (size_t pos = 0; pos < WORD_SIZE; ++pos)
+    {
+        for (unsigned nibble = 0; nibble < 16; ++nibble)
+        {
+            tables.low[pos][nibble] = byteTables[pos][nibble];
+            tables.high[pos][nibble] = byteTables[pos][nibble << 4];
+        }
+    }
+    return tables;
+}
+
+constexpr NibbleTables nibbleTables = makeNibbleTables();
+
+/** @brief Syndrome table values, below 64 the syndrome is a data bit */
+constexpr uint8_t SYNDROME_ECC_BIT = 64;
+constexpr uint8_t SYNDROME_UE = 0xff;
+
+/** @brief The bit in error for each syndrome, the XOR of the computed and
+ *         stored ECC bytes of a word.
+ */
+constexpr std::array<uint8_t, 256> makeSyndromes()
+{
+    std::array<uint8_t, 256> syndromes{};
+    for (auto& syndrome : syndromes)
+    {
+        syndrome = SYNDROME_UE;
+    }
+    for (uint8_t bit = 0; bit < 64; ++bit)
+    {
+        syndromes[generateValue(uint64_t(1) << bit)] = bit;
+    }
+    for (uint8_t bit = 0; bit < 8; ++bit)
+    {
+        syndromes[1 << bit] = SYNDROME_ECC_BIT + bit;
+    }
+    return syndromes;
+}
+
+constexpr std::array<uint8_t, 256> syndromes = makeSyndromes();
+
+void kernelReference(const uint8_t* data, uint8_t* ecc, size_t words)
+{
+    for (size_t w = 0; w < words; ++w)
+    {
+        ecc[w] = generate(data + w * WORD_SIZE);
+    }
+}
+
+void kernelTable(const uint8_t* data, uint8_t* ecc, size_t words)
+{
+    for (size_t w = 0; w < words; ++w, data += WORD_SIZE)
+    {
+        ecc[w] = byteTables[0][data[0]] ^ byteTables[1][data[1]] ^
+                 byteTables[2][data[2]] ^ byteTables[3][data[3]] ^
+                 byteTables[4][data[4]] ^ byteTables[5][data[5]] ^
+                 byteTables[6][data[6]] ^ byteTables[7][data[7]];
+    }
+}
+
+#ifdef ECC_X86
+
+/* The SIMD kernels transpose the words so that each register holds the
+ * bytes of one position of 16 words, then look the ECC contribution of
+ * each nibble up in the table of the position.
+ */
+
+__attribute__((target("ssse3"))) void
+    kernelSsse3(const uint8_t* data, uint8_t* ecc, size_t words)
+{
+    const auto pairs = _mm_setr_epi8(0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13,
+                                     6, 14, 7, 15);
+    const auto nibble = _mm_set1_epi8(0x0f);
+
+    size_t w = 0;
+    for (; w + 16 <= words; w += 16)
+    {
+        auto p = reinterpret_cast<const __m128i*>(data + w * WORD_SIZE);
+
+        // Pairs of words, byte positions interleaved
+        __m128i r[8];
+        for (int i = 0; i < 8; ++i)
+        {
+            r[i] = _mm_shuffle_epi8(_mm_loadu_si128(p + i), pairs);
+        }
+
+        // Positions 0-3 and 4-7 of 4 words
+        __m128i a[8];
+        for (int i = 0; i < 4; ++i)
+        {
+            a[2 * i] = _mm_unpacklo_epi16(r[2 * i], r[2 * i + 1]);
+            a[2 * i + 1] = _mm_unpackhi_epi16(r[2 * i], r[2 * i + 1]);
+        }
+
+        // Two positions of 8 words, words 0-7 then 8-15
+        __m128i b[8];
+        for (int i = 0; i < 2; ++i)
+        {
+            b[4 * i] = _mm_unpacklo_epi32(a[4 * i], a[4 * i + 2]);
+            b[4 * i + 1] = _mm_unpackhi_epi32(a[4 * i], a[4 * i + 2]);
+            b[4 * i + 2] = _mm_unpacklo_epi32(a[4 * i + 1], a[4 * i + 3]);
+            b[4 * i + 3] = _mm_unpackhi_epi32(a[4 * i + 1], a[4 * i + 3]);
+        }
+
+        auto acc = _mm_setzero_si128();
+        for (int i = 0; i < 4; ++i)
+        {
+            __m128i pos[2] = {_mm_unpacklo_epi64(b[i], b[i + 4]),
+                              _mm_unpackhi_epi64(b[i], b[i + 4])};
+            for (int j = 0; j < 2; ++j)
+            {
+                auto m = 2 * i + j;
+                auto low = _mm_and_si128(pos[j], nibble);
+                auto high = _mm_and_si128(_mm_srli_epi16(pos[j], 4), nibble);
+                auto lowTable = _mm_load_si128(
+                    reinterpret_cast<const __m128i*>(nibbleTables.low[m]));
+                auto highTable = _mm_load_si128(
+                    reinterpret_cast<const __m128i*>(nibbleTables.high[m]));
+                acc = _mm_xor_si128(acc, _mm_shuffle_epi8(lowTable, low));
+                acc = _mm_xor_si128(acc, _mm_shuffle_epi8(highTable, high));
+            }
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(ecc + w), acc);
+    }
+
+    kernelTable(data + w * WORD_SIZE, ecc + w, words - w);
+}
+
+__attribute__((target("avx2"))) void
+    kernelAvx2(const uint8_t* data, uint8_t* ecc, size_t words)
+{
+    // The lanes work on words 0-15 and 16-31 respectively.
+    const auto pairs = _mm256_setr_epi8(
+        0, 8, 1, 9, 2, 10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15, 0, 8, 1, 9, 2,
+        10, 3, 11, 4, 12, 5, 13, 6, 14, 7, 15);
+    const auto nibble = _mm256_set1_epi8(0x0f);
+
+    size_t w = 0;
+    for (; w + 32 <= words; w += 32)
+    {
+        auto p = reinterpret_cast<const __m128i*>(data + w * WORD_SIZE);
+
+        __m256i r[8];
+        for (int i = 0; i < 8; ++i)
+        {
+            auto lanes = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(p + i)),
+                _mm_loadu_si128(p + 8 + i), 1);
+            r[i] = _mm256_shuffle_epi8(lanes, pairs);
+        }
+
+        __m256i a[8];
+        for (int i = 0; i < 4; ++i)
+        {
+            a[2 * i] = _mm256_unpacklo_epi16(r[2 * i], r[2 * i + 1]);
+            a[2 * i + 1] = _mm256_unpackhi_epi16(r[2 * i], r[2 * i + 1]);
+        }
+
+        __m256i b[8];
+        for (int i = 0; i < 2; ++i)
+        {
+            b[4 * i] = _mm256_unpacklo_epi32(a[4 * i], a[4 * i + 2]);
+            b[4 * i + 1] = _mm256_unpackhi_epi32(a[4 * i], a[4 * i + 2]);
+            b[4 * i + 2] = _mm256_unpacklo_epi32(a[4 * i + 1], a[4 * i + 3]);
+            b[4 * i + 3] = _mm256_unpackhi_epi32(a[4 * i + 1], a[4 * i + 3]);
+        }
+
+        auto acc = _mm256_setzero_si256();
+        for (int i = 0; i < 4; ++i)
+        {
+            __m256i pos[2] = {_mm256_unpacklo_epi64(b[i], b[i + 4]),
+                              _mm256_unpackhi_epi64(b[i], b[i + 4])};
+            for (int j = 0; j < 2; ++j)
+            {
+                auto m = 2 * i + j;
+                auto low = _mm256_and_si256(pos[j], nibble);
+                auto high =
+                    _mm256_and_si256(_mm256_srli_epi16(pos[j], 4), nibble);
+                auto lowTable = _mm256_broadcastsi128_si256(_mm_load_si128(
+                    reinterpret_cast<const __m128i*>(nibbleTables.low[m])));
+                auto highTable = _mm256_broadcastsi128_si256(_mm_load_si128(
+                    reinterpret_cast<const __m128i*>(nibbleTables.high[m])));
+                acc = _mm256_xor_si256(acc,
+                                       _mm256_shuffle_epi8(lowTable, low));
+                acc = _mm256_xor_si256(acc,
+                                       _mm256_shuffle_epi8(highTable, high));
+            }
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(ecc + w), acc);
+    }
+
+    kernelSsse3(data + w * WORD_SIZE, ecc + w, words - w);
+}
+
+#endif
+
+#ifdef ECC_NEON
+
+void kernelNeon(const uint8_t* data, uint8_t* ecc, size_t words)
+{
+    const auto nibble = vdup_n_u8(0x0f);
+
+    uint8x8x2_t lowTables[WORD_SIZE];
+    uint8x8x2_t highTables[WORD_SIZE];
+    for (size_t m = 0; m < WORD_SIZE; ++m)
+    {
+        lowTables[m].val[0] = vld1_u8(nibbleTables.low[m]);
+        lowTables[m].val[1] = vld1_u8(nibbleTables.low[m] + 8);
+        highTables[m].val[0] = vld1_u8(nibbleTables.high[m]);
+        highTables[m].val[1] = vld1_u8(nibbleTables.high[m] + 8);
+    }
+
+    size_t w = 0;
+    for (; w + 8 <= words; w += 8)
+    {
+        auto p = data + w * WORD_SIZE;
+
+        // Positions j and j + 4 of words 0-3 and 4-7, interleaved
+        auto first = vld4_u8(p);
+        auto second = vld4_u8(p + 32);
+
+        uint8x8_t pos[WORD_SIZE];
+        for (int j = 0; j < 4; ++j)
+        {
+            auto split = vuzp_u8(first.val[j], second.val[j]);
+            pos[j] = split.val[0];
+            pos[j + 4] = split.val[1];
+        }
+
+        auto acc = vdup_n_u8(0);
+        for (size_t m = 0; m < WORD_SIZE; ++m)
+        {
+            auto low = vand_u8(pos[m], nibble);
+            auto high = vshr_n_u8(pos[m], 4);
+            acc = veor_u8(acc, vtbl2_u8(lowTables[m], low));
+            acc = veor_u8(acc, vtbl2_u8(highTables[m], high));
+        }
+        vst1_u8(ecc + w, acc);
+    }
+
+    kernelTable(data + w * WORD_SIZE, ecc + w, words - w);
+}
+
+#endif
+
+/** @brief Words processed per kernel call when encoding or decoding */
+constexpr size_t CHUNK_WORDS = 512;
+
+} // namespace
+
+const char* name(Impl impl)
+{
+    switch (impl)
+    {
+        case Impl::Reference:
+            return "reference";
+        case Impl::Table:
+            return "table";
+        case Impl::Ssse3:
+            return "ssse3";
+        case Impl::Avx2:
+            return "avx2";
+        case Impl::Neon:
+            return "neon";
+    }
+    return "unknown";
+}
+
+Kernel kernel(Impl impl)
+{
+    switch (impl)
+    {
+        case Impl::Reference:
+            return kernelReference;
+        case Impl::Table:
+            return kernelTable;
+#ifdef ECC_X86
+        case Impl::Ssse3:
+            return __builtin_cpu_supports("ssse3") ? kernelSsse3 : nullptr;
+        case Impl::Avx2:
+            return __builtin_cpu_supports("avx2") ? kernelAvx2 : nullptr;
+#endif
+#ifdef ECC_NEON
+        case Impl::Neon:
+            return kernelNeon;
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+std::vector<Impl> supported()
+{
+    std::vector<Impl> impls;
+    for (auto impl : {Impl::Reference, Impl::Table, Impl::Ssse3, Impl::Avx2,
+                      Impl::Neon})
+    {
+        if (kernel(impl))
+        {
+            impls.push_back(impl);
+        }
+    }
+    return impls;
+}
+
+Impl best()
+{
+    static const Impl impl = []() {
+        for (auto impl : {Impl::Avx2, Impl::Ssse3, Impl::Neon})
+        {
+            if (kernel(impl))
+            {
+                return impl;
+            }
+        }
+        return Impl::Table;
+    }();
+    return impl;
+}
+
+uint8_t generate(const uint8_t* data)
+{
+    uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    if constexpr (std::endian::native == std::endian::little)
+    {
+        value = __builtin_bswap64(value);
+    }
+    return generateValue(value);
+}
+
+void encode(const uint8_t* data, size_t size, uint8_t* out, Impl impl)
+{
+    auto compute = kernel(impl);
+    if (!compute)
+    {
+        compute = kernelTable;
+    }
+
+    uint8_t eccBytes[CHUNK_WORDS];
+    size_t words = size / WORD_SIZE;
+    for (size_t w = 0; w < words; w += CHUNK_WORDS)
+    {
+        auto count = std::min(CHUNK_WORDS, words - w);
+        compute(data + w * WORD_SIZE, eccBytes, count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            std::memcpy(out, data + (w + i) * WORD_SIZE, WORD_SIZE);
+            out[WORD_SIZE] = eccBytes[i];
+            out += ECC_WORD_SIZE;
+        }
+    }
+}
+
+DecodeStats decode(const uint8_t* in, size_t size, uint8_t* out, Impl impl)
+{
+    auto compute = kernel(impl);
+    if (!compute)
+    {
+        compute = kernelTable;
+    }
+
+    DecodeStats stats;
+    uint8_t stored[CHUNK_WORDS];
+    uint8_t computed[CHUNK_WORDS];
+    size_t words = size / ECC_WORD_SIZE;
+    for (size_t w = 0; w < words; w += CHUNK_WORDS)
+    {
+        auto count = std::min(CHUNK_WORDS, words - w);
+        auto chunk = out + w * WORD_SIZE;
+        for (size_t i = 0; i < count; ++i, in += ECC_WORD_SIZE)
+        {
+            std::memcpy(chunk + i * WORD_SIZE, in, WORD_SIZE);
+            stored[i] = in[WORD_SIZE];
+        }
+
+        compute(chunk, computed, count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (computed[i] == stored[i])
+            {
+                continue;
+            }
+            auto syndrome = syndromes[computed[i] ^ stored[i]];
+            if (syndrome == SYNDROME_UE)
+            {
+                ++stats.uncorrectable;
+                continue;
+            }
+            // A flipped ECC bit leaves the data intact. Bit 0 of the big
+            // endian value is the low bit of the last byte.
+            if (syndrome < SYNDROME_ECC_BIT)
+            {
+                chunk[i * WORD_SIZE + WORD_SIZE - 1 - syndrome / 8] ^=
+                    1 << (syndrome % 8);
+            }
+            ++stats.corrected;
+        }
+    }
+    return stats;
+}
+
+} // namespace ecc
+} // namespace updater
+} // namespace software
+} // namespace openpower
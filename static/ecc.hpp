@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+namespace ecc
+{
+
+/** @brief Bytes of data protected by one ECC byte */
+constexpr size_t WORD_SIZE = 8;
+
+/** @brief Bytes of an ECC protected word, its data followed by its ECC */
+constexpr size_t ECC_WORD_SIZE = WORD_SIZE + 1;
+
+/** @brief The implementations of the ECC kernel */
+enum class Impl
+{
+    Reference,
+    Table,
+    Ssse3,
+    Avx2,
+    Neon,
+};
+
+/** @brief ECC kernel, computes the ECC byte of each 8-byte word of data.
+ *
+ *  @param[in]  data  - The data, words * 8 bytes.
+ *  @param[out] ecc   - The ECC bytes, one per word.
+ *  @param[in]  words - The number of words.
+ */
+using Kernel = void (*)(const uint8_t* data, uint8_t* ecc, size_t words);
+
+/** @struct DecodeStats
+ *  @brief Outcome of decoding ECC protected data.
+ */
+struct DecodeStats
+{
+    /** @brief Words with a single bit error, corrected */
+    size_t corrected = 0;
+    /** @brief Words with multiple bit errors, copied as is */
+    size_t uncorrectable = 0;
+};
+
+/** @brief Returns the name of an implementation, e.g. "avx2". */
+const char* name(Impl impl);
+
+/** @brief Returns the kernel of an implementation, or nullptr if the
+ *         implementation is not built in or not supported by the CPU.
+ */
+Kernel kernel(Impl impl);
+
+/** @brief Returns the implementations the CPU supports. */
+std::vector<Impl> supported();
+
+/** @brief Returns the fastest implementation the CPU supports. */
+Impl best();
+
+/** @brief Computes the ECC byte of one word, the reference implementation.
+ *
+ *  @param[in] data - The 8 bytes of the word.
+ */
+uint8_t generate(const uint8_t* data);
+
+/** @brief Adds the ECC bytes to data.
+ *
+ *  @param[in]  data - The data, its size a multiple of 8 bytes.
+ *  @param[in]  size - The size of the data.
+ *  @param[out] out  - The ECC protected data, size / 8 * 9 bytes.
+ *  @param[in]  impl - The kernel implementation.
+ */
+void encode(const uint8_t* data, size_t size, uint8_t* out,
+            Impl impl = best());
+
+/** @brief Checks and strips the ECC bytes of ECC protected data.
+ *  @details Single bit errors are corrected.
+ *
+ *  @param[in]  in   - The ECC protected data, its size a multiple of 9
+ *                     bytes.
+ *  @param[in]  size - The size of the ECC protected data.
+ *  @param[out] out  - The data, size / 9 * 8 bytes.
+ *  @param[in]  impl - The kernel implementation.
+ *  @return The decoding statistics.
+ */
+DecodeStats decode(const uint8_t* in, size_t size, uint8_t* out,
+                   Impl impl = best());
+
+} // namespace ecc
+} // namespace updater
+} // namespace software
+} // namespace openpower
@@ -0,0 +1,288 @@
+#include "ffs.hpp"
+
+#include "ecc.hpp"
+
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+/** @brief Reads the big endian word at the given word index. */
+uint32_t be32At(const uint8_t* data, size_t index)
+{
+    uint32_t value;
+    std::memcpy(&value, data + index * sizeof(value), sizeof(value));
+    return be32toh(value);
+}
+
+/** @brief Returns true if the XOR of the words of a block, its checksum
+ *         included, is zero.
+ */
+bool checksumOK(const uint8_t* data, size_t size)
+{
+    uint32_t sum = 0;
+    for (size_t i = 0; i < size / sizeof(uint32_t); ++i)
+    {
+        sum ^= be32At(data, i);
+    }
+    return sum == 0;
+}
+
+/** @brief Offsets of the header words */
+enum HeaderWord
+{
+    hdrMagic = 0,
+    hdrVersion = 1,
+    hdrSize = 2,
+    hdrEntrySize = 3,
+    hdrEntryCount = 4,
+    hdrBlockSize = 5,
+    hdrBlockCount = 6,
+};
+
+/** @brief Offsets of the entry words, after the name */
+enum EntryWord
+{
+    entBase = 4,
+    entSize = 5,
+    entPid = 6,
+    entId = 7,
+    entType = 8,
+    entFlags = 9,
+    entActual = 10,
+};
+
+/** @brief Offset of the user data of an entry */
+constexpr size_t entUser = 60;
+
+/** @brief Supported FFS header version */
+constexpr uint32_t FFS_VERSION_1 = 1;
+
+/** @brief Reads exactly size bytes at offset. */
+void preadAll(int fd, const fs::path& flash, uint8_t* buffer, size_t size,
+              uint64_t offset)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        auto bytes = pread(fd, buffer + done, size - done, offset + done);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes < 0)
+        {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to read " + flash.string());
+        }
+        if (bytes == 0)
+        {
+            throw std::runtime_error("Short read of " + flash.string());
+        }
+        done += bytes;
+    }
+}
+
+} // namespace
+
+uint64_t fingerprint(const uint8_t* data, size_t size, uint64_t seed)
+{
+    constexpr uint64_t prime = 0x100000001b3;
+    for (size_t i = 0; i < size; ++i)
+    {
+        seed = (seed ^ data[i]) * prime;
+    }
+    return seed;
+}
+
+std::string FfsEntry::flags() const
+{
+    std::string ret = "[----------]";
+    auto set = [&ret](size_t pos, bool on, char flag) {
+        if (on)
+        {
+            ret[pos + 1] = flag;
+        }
+    };
+    set(0, ecc(), 'E');
+    set(1, verCheck & FFS_VERCHECK_SHA512V, 'L');
+    set(2, verCheck & FFS_VERCHECK_SHA512EC, 'I');
+    set(3, preserved(), 'P');
+    set(4, miscFlags & FFS_MISCFLAGS_READONLY, 'R');
+    set(5, miscFlags & FFS_MISCFLAGS_BACKUP, 'B');
+    set(6, reprovision(), 'F');
+    set(7, miscFlags & FFS_MISCFLAGS_GOLDEN, 'G');
+    set(8, miscFlags & FFS_MISCFLAGS_CLEARECC, 'C');
+    set(9, miscFlags & FFS_MISCFLAGS_VOLATILE, 'V');
+    return ret;
+}
+
+Ffs::Ffs(const fs::path& flash, uint64_t offset) :
+    flash(flash), fd(open(flash.c_str(), O_RDONLY | O_CLOEXEC))
+{
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to open " + flash.string());
+    }
+
+    try
+    {
+        uint8_t header[FFS_HDR_SIZE];
+        preadAll(fd, flash, header, sizeof(header), offset);
+        if (be32At(header, hdrMagic) != FFS_MAGIC)
+        {
+            throw std::runtime_error("No FFS header in " + flash.string());
+        }
+
+        // Read the header and its entries at once, the table is parsed from
+        // memory.
+        auto count = be32At(header, hdrEntryCount);
+        auto tocSize = FFS_HDR_SIZE + size_t(count) * FFS_ENTRY_SIZE;
+        std::vector<uint8_t> toc(tocSize);
+        preadAll(fd, flash, toc.data(), toc.size(), offset);
+        parts = parse(toc.data(), toc.size());
+        tocPrint = fingerprint(toc.data(), toc.size());
+        block = be32At(header, hdrBlockSize);
+    }
+    catch (...)
+    {
+        close(fd);
+        throw;
+    }
+}
+
+Ffs::~Ffs()
+{
+    close(fd);
+}
+
+std::vector<FfsEntry> Ffs::parse(const uint8_t* toc, size_t size)
+{
+    if (size < FFS_HDR_SIZE)
+    {
+        throw std::runtime_error("FFS header truncated");
+    }
+    if (be32At(toc, hdrMagic) != FFS_MAGIC ||
+        be32At(toc, hdrVersion) != FFS_VERSION_1)
+    {
+        throw std::runtime_error("Invalid FFS header");
+    }
+    if (!checksumOK(toc, FFS_HDR_SIZE))
+    {
+        throw std::runtime_error("FFS header checksum mismatch");
+    }
+
+    auto entrySize = be32At(toc, hdrEntrySize);
+    auto count = be32At(toc, hdrEntryCount);
+    auto blockSize = be32At(toc, hdrBlockSize);
+    auto blockCount = be32At(toc, hdrBlockCount);
+    if (entrySize != FFS_ENTRY_SIZE || blockSize == 0)
+    {
+        throw std::runtime_error("Unsupported FFS geometry");
+    }
+    if ((size - FFS_HDR_SIZE) / FFS_ENTRY_SIZE < count ||
+        uint64_t(count) * FFS_ENTRY_SIZE + FFS_HDR_SIZE >
+            uint64_t(be32At(toc, hdrSize)) * blockSize)
+    {
+        throw std::runtime_error("FFS entries truncated");
+    }
+
+    std::vector<FfsEntry> ret;
+    ret.reserve(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        auto data = toc + FFS_HDR_SIZE + size_t(i) * FFS_ENTRY_SIZE;
+        if (!checksumOK(data, FFS_ENTRY_SIZE))
+        {
+            throw std::runtime_error("FFS entry checksum mismatch, entry " +
+                                     std::to_string(i));
+        }
+
+        FfsEntry part;
+        part.name.assign(reinterpret_cast<const char*>(data),
+                         strnlen(reinterpret_cast<const char*>(data),
+                                 FFS_PART_NAME_MAX + 1));
+        part.offset = uint64_t(be32At(data, entBase)) * blockSize;
+        part.size = uint64_t(be32At(data, entSize)) * blockSize;
+        part.actual = be32At(data, entActual);
+        part.id = be32At(data, entId);
+        part.type = be32At(data, entType);
+
+        const auto user = data + entUser;
+        part.dataInteg = (uint16_t(user[2]) << 8) | user[3];
+        part.verCheck = user[4];
+        part.miscFlags = user[5];
+
+        if (part.offset + part.size > uint64_t(blockCount) * blockSize)
+        {
+            throw std::runtime_error("FFS entry out of the flash: " +
+                                     part.name);
+        }
+        ret.push_back(std::move(part));
+    }
+    return ret;
+}
+
+const FfsEntry* Ffs::find(const std::string& name) const
+{
+    for (const auto& part : parts)
+    {
+        if (part.name == name)
+        {
+            return &part;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<uint8_t> Ffs::read(uint64_t offset, size_t size) const
+{
+    std::vector<uint8_t> data(size);
+    preadAll(fd, flash, data.data(), size, offset);
+    return data;
+}
+
+std::vector<uint8_t> Ffs::readPartition(const FfsEntry& part) const
+{
+    auto size = part.actual;
+    if (size == 0 || size > part.size)
+    {
+        size = part.size;
+    }
+    auto data = read(part.offset, size);
+    if (!part.ecc())
+    {
+        return data;
+    }
+
+    std::vector<uint8_t> decoded(data.size() / ecc::ECC_WORD_SIZE *
+                                 ecc::WORD_SIZE);
+    auto stats = ecc::decode(data.data(), data.size(), decoded.data());
+    if (stats.uncorrectable > 0)
+    {
+        throw std::runtime_error("Uncorrectable ECC errors in partition " +
+                                 part.name);
+    }
+    return decoded;
+}
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
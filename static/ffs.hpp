@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+/** @brief Magic number of an FFS header, "PART" */
+constexpr uint32_t FFS_MAGIC = 0x50415254;
+
+/** @brief Size of the FFS header, without its entries */
+constexpr size_t FFS_HDR_SIZE = 48;
+
+/** @brief Size of an FFS entry */
+constexpr size_t FFS_ENTRY_SIZE = 128;
+
+/** @brief Maximum length of a partition name */
+constexpr size_t FFS_PART_NAME_MAX = 15;
+
+/** @brief FFS entry types */
+constexpr uint32_t FFS_TYPE_DATA = 1;
+constexpr uint32_t FFS_TYPE_LOGICAL = 2;
+constexpr uint32_t FFS_TYPE_PARTITION = 3;
+
+/** @brief Data integrity bit of an entry, the partition is ECC protected */
+constexpr uint16_t FFS_ENTRY_INTEG_ECC = 0x8000;
+
+/** @brief Version check bits of an entry */
+constexpr uint8_t FFS_VERCHECK_SHA512V = 0x80;
+constexpr uint8_t FFS_VERCHECK_SHA512EC = 0x40;
+
+/** @brief Miscellaneous flags of an entry */
+constexpr uint8_t FFS_MISCFLAGS_PRESERVED = 0x80;
+constexpr uint8_t FFS_MISCFLAGS_READONLY = 0x40;
+constexpr uint8_t FFS_MISCFLAGS_BACKUP = 0x20;
+constexpr uint8_t FFS_MISCFLAGS_REPROVISION = 0x10;
+constexpr uint8_t FFS_MISCFLAGS_VOLATILE = 0x08;
+constexpr uint8_t FFS_MISCFLAGS_CLEARECC = 0x04;
+constexpr uint8_t FFS_MISCFLAGS_GOLDEN = 0x01;
+
+/** @brief Initial value of a fingerprint, the FNV-1a offset basis */
+constexpr uint64_t FFS_FINGERPRINT_SEED = 0xcbf29ce484222325;
+
+/** @brief Computes a cheap fingerprint of data, FNV-1a 64 bits.
+ *  @details Chaining calls through the seed fingerprints several buffers.
+ *  This detects changes, it is no cryptographic digest.
+ *
+ *  @param[in] data - The data.
+ *  @param[in] size - The size of the data.
+ *  @param[in] seed - The fingerprint of the preceding data.
+ */
+uint64_t fingerprint(const uint8_t* data, size_t size,
+                     uint64_t seed = FFS_FINGERPRINT_SEED);
+
+/** @struct FfsEntry
+ *  @brief A partition of the FFS table of contents.
+ */
+struct FfsEntry
+{
+    /** @brief The partition name */
+    std::string name;
+    /** @brief The partition offset in bytes */
+    uint64_t offset = 0;
+    /** @brief The partition size in bytes */
+    uint64_t size = 0;
+    /** @brief The size in bytes of the data actually in the partition */
+    uint64_t actual = 0;
+    /** @brief The entry id */
+    uint32_t id = 0;
+    /** @brief The entry type, FFS_TYPE_* */
+    uint32_t type = 0;
+    /** @brief The data integrity bits, FFS_ENTRY_INTEG_* */
+    uint16_t dataInteg = 0;
+    /** @brief The version check bits, FFS_VERCHECK_* */
+    uint8_t verCheck = 0;
+    /** @brief The miscellaneous flags, FFS_MISCFLAGS_* */
+    uint8_t miscFlags = 0;
+
+    /** @brief Whether the partition is ECC protected */
+    bool ecc() const
+    {
+        return dataInteg & FFS_ENTRY_INTEG_ECC;
+    }
+
+    /** @brief Whether the partition is cleared on a factory reset */
+    bool reprovision() const
+    {
+        return miscFlags & FFS_MISCFLAGS_REPROVISION;
+    }
+
+    /** @brief Whether the partition is preserved across updates */
+    bool preserved() const
+    {
+        return miscFlags & FFS_MISCFLAGS_PRESERVED;
+    }
+
+    /** @brief Returns the flags the way pflash -i prints them,
+     *         e.g. "[E--P--F-C-]".
+     */
+    std::string flags() const;
+};
+
+/** @class Ffs
+ *  @brief Reader of a flash holding an FFS partition table.
+ *  @details The flash is opened once and its table of contents is parsed
+ *  on construction. The flash is either an MTD character device or a PNOR
+ *  image file, which allows to exercise the reader without hardware.
+ */
+class Ffs
+{
+  public:
+    Ffs() = delete;
+    Ffs(const Ffs&) = delete;
+    Ffs& operator=(const Ffs&) = delete;
+    Ffs(Ffs&&) = delete;
+    Ffs& operator=(Ffs&&) = delete;
+
+    /** @brief Constructs Ffs, reading the table of contents.
+     *
+     *  @param[in] flash  - The MTD device or PNOR image file.
+     *  @param[in] offset - The offset of the table of contents.
+     */
+    explicit Ffs(const std::filesystem::path& flash, uint64_t offset = 0);
+
+    ~Ffs();
+
+    /** @brief Returns the partitions, in table of contents order. */
+    const std::vector<FfsEntry>& entries() const
+    {
+        return parts;
+    }
+
+    /** @brief Returns the partition with the given name, or nullptr. */
+    const FfsEntry* find(const std::string& name) const;
+
+    /** @brief Returns the erase block size recorded in the header. */
+    uint32_t blockSize() const
+    {
+        return block;
+    }
+
+    /** @brief Returns the fingerprint of the table of contents, header and
+     *         entries as read from the flash.
+     */
+    uint64_t tocFingerprint() const
+    {
+        return tocPrint;
+    }
+
+    /** @brief Reads the data of a partition.
+     *  @details The actual size of the partition is read. The ECC bytes of
+     *  an ECC protected partition are checked, correcting single bit
+     *  errors, and stripped; throws on uncorrectable errors.
+     *
+     *  @param[in] part - The partition.
+     *  @return The partition data.
+     */
+    std::vector<uint8_t> readPartition(const FfsEntry& part) const;
+
+    /** @brief Reads raw bytes of the flash.
+     *
+     *  @param[in] offset - The offset to read from.
+     *  @param[in] size   - The number of bytes to read.
+     *  @return The bytes read.
+     */
+    std::vector<uint8_t> read(uint64_t offset, size_t size) const;
+
+    /** @brief Parses an FFS table of contents.
+     *
+     *  @param[in] toc  - The table of contents, header and entries.
+     *  @param[in] size - The size of the buffer.
+     *  @return The partitions, throws if the table is invalid.
+     */
+    static std::vector<FfsEntry> parse(const uint8_t* toc, size_t size);
+
+  private:
+    /** @brief The flash being read */
+    std::filesystem::path flash;
+
+    /** @brief The flash file descriptor */
+    int fd;
+
+    /** @brief The erase block size */
+    uint32_t block = 0;
+
+    /** @brief The fingerprint of the table of contents */
+    uint64_t tocPrint = 0;
+
+    /** @brief The partitions */
+    std::vector<FfsEntry> parts;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
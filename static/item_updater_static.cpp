@@ -3,6 +3,9 @@
 #include "item_updater_static.hpp"
 
 #include "activation_static.hpp"
+#include "ffs.hpp"
+#include "flash_io.hpp"
+#include "pnor_flash.hpp"
 #include "utils.hpp"
 #include "version.hpp"
 
@@ -10,11 +13,16 @@
 #include <phosphor-logging/log.hpp>
 #include <xyz/openbmc_project/Common/error.hpp>
 
-#include <array>
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
-#include <sstream>
+#include <iterator>
+#include <optional>
 #include <string>
 #include <tuple>
 
@@ -28,168 +36,207 @@ namespace fs = std::filesystem;
 namespace utils
 {
 
-template <typename... Ts>
-std::string concat_string(const Ts&... ts)
+using openpower::software::updater::ClearRange;
+using openpower::software::updater::Ffs;
+using openpower::software::updater::FlashDevice;
+using openpower::software::updater::FlashIoCounts;
+using openpower::software::updater::mtdDevice;
+
+// A signed version partition will have an extra 4K header starting with
+// the magic number 17082011 in big endian:
+// https://github.com/open-power/skiboot/blob/master/libstb/container.h#L47
+constexpr uint8_t MAGIC[] = {0x17, 0x08, 0x20, 0x11};
+constexpr auto MAGIC_SIZE = sizeof(MAGIC);
+static_assert(MAGIC_SIZE == 4);
+constexpr size_t HEADER_SIZE = 4096;
+
+// File caching the version string, see getPNORVersion(ffs, cache)
+constexpr auto VERSION_CACHE_FILE = "pnor-version";
+
+// Read the version string from the VERSION partition
+std::string getPNORVersion(const Ffs& ffs)
 {
-    std::stringstream s;
-    ((s << ts << " "), ...) << std::endl;
-    return s.str();
+    auto part = ffs.find("VERSION");
+    if (!part)
+    {
+        log<level::ERR>("No VERSION partition");
+        return {};
+    }
+
+    auto data = ffs.readPartition(*part);
+    auto begin = data.begin();
+    if (data.size() >= MAGIC_SIZE &&
+        std::memcmp(data.data(), MAGIC, MAGIC_SIZE) == 0)
+    {
+        // Skip the first 4K header
+        begin += std::min(data.size(), HEADER_SIZE);
+    }
+
+    return std::string(begin, std::find(begin, data.end(), '\0'));
 }
 
-// Helper function to run pflash command
-// Returns return code and the stdout
-template <typename... Ts>
-std::pair<int, std::string> pflash(const Ts&... ts)
+// Fingerprint the table of contents and the head of the VERSION partition.
+// The container header of a signed partition holds the digest of its
+// payload, so the first 4K stand for the whole partition. An unsigned
+// partition is only covered if it fits in those 4K, otherwise there is no
+// fingerprint and the partition is always read.
+std::optional<uint64_t> getVersionFingerprint(const Ffs& ffs)
 {
-    std::array<char, 512> buffer;
-    std::string cmd = concat_string("pflash", ts...);
-    std::stringstream result;
-    int rc;
-    FILE* pipe = popen(cmd.c_str(), "r");
-    if (!pipe)
+    auto part = ffs.find("VERSION");
+    if (!part)
     {
-        throw std::runtime_error("popen() failed!");
+        return std::nullopt;
     }
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr)
+
+    auto size = part->actual;
+    if (size == 0 || size > part->size)
     {
-        result << buffer.data();
+        size = part->size;
     }
-    rc = pclose(pipe);
-    return {rc, result.str()};
+    auto head = ffs.read(part->offset, std::min<uint64_t>(size, HEADER_SIZE));
+    bool isSigned = head.size() >= MAGIC_SIZE &&
+                    std::memcmp(head.data(), MAGIC, MAGIC_SIZE) == 0;
+    if (!isSigned && size > head.size())
+    {
+        return std::nullopt;
+    }
+    return openpower::software::updater::fingerprint(
+        head.data(), head.size(), ffs.tocFingerprint());
 }
 
-std::string getPNORVersion()
+// Read the version string, from the cache file if its fingerprint matches
+// the flash, else from the VERSION partition, updating the cache.
+// The cache file is the fingerprint in hex on the first line followed by the
+// version string.
+std::string getPNORVersion(const Ffs& ffs, const fs::path& cache)
 {
-    // A signed version partition will have an extra 4K header starting with
-    // the magic number 17082011 in big endian:
-    // https://github.com/open-power/skiboot/blob/master/libstb/container.h#L47
-
-    constexpr uint8_t MAGIC[] = {0x17, 0x08, 0x20, 0x11};
-    constexpr auto MAGIC_SIZE = sizeof(MAGIC);
-    static_assert(MAGIC_SIZE == 4);
-
-    auto tmp = fs::temp_directory_path();
-    std::string tmpDir(tmp / "versionXXXXXX");
-    if (!mkdtemp(tmpDir.data()))
+    auto print = getVersionFingerprint(ffs);
+    char printHex[17] = {};
+    if (print)
     {
-        log<level::ERR>("Failed to create temp dir");
-        return {};
+        snprintf(printHex, sizeof(printHex), "%016" PRIx64, *print);
+        std::ifstream file(cache);
+        std::string line;
+        if (file && std::getline(file, line) && line == printHex)
+        {
+            std::string version{std::istreambuf_iterator<char>(file),
+                                std::istreambuf_iterator<char>()};
+            if (!version.empty())
+            {
+                return version;
+            }
+        }
     }
 
-    fs::path versionFile = tmpDir;
-    versionFile /= "version";
-
-    auto [rc, r] =
-        pflash("-P VERSION -r", versionFile.string(), "2>&1 > /dev/null");
-    if (rc != 0)
+    auto version = getPNORVersion(ffs);
+    std::error_code ec;
+    if (!print || version.empty())
     {
-        log<level::ERR>("Failed to read VERSION", entry("RETURNCODE=%d", rc));
-        return {};
+        fs::remove(cache, ec);
+        return version;
     }
 
-    std::ifstream f(versionFile.c_str(), std::ios::in | std::ios::binary);
-    uint8_t magic[MAGIC_SIZE];
-    std::string version;
-
-    f.read(reinterpret_cast<char*>(magic), MAGIC_SIZE);
-    f.seekg(0, std::ios::beg);
-    if (std::memcmp(magic, MAGIC, MAGIC_SIZE) == 0)
+    // Replace the cache through a rename, a cache file is either the old or
+    // the new one.
+    auto tmp = cache;
+    tmp += ".tmp";
     {
-        // Skip the first 4K header
-        f.ignore(4096);
+        std::ofstream file(tmp, std::ios::out | std::ios::trunc);
+        file << printHex << '\n' << version;
+        file.close();
+        if (!file)
+        {
+            fs::remove(tmp, ec);
+            return version;
+        }
     }
-
-    getline(f, version, '\0');
-    f.close();
-
-    // Clear the temp dir
-    std::error_code ec;
-    fs::remove_all(tmpDir, ec);
+    fs::rename(tmp, cache, ec);
     if (ec)
     {
-        log<level::ERR>("Failed to remove temp dir",
-                        entry("DIR=%s", tmpDir.c_str()),
-                        entry("ERR=%s", ec.message().c_str()));
+        log<level::ERR>("Failed to cache the PNOR version",
+                        entry("FILE=%s", cache.c_str()),
+                        entry("ERROR=%s", ec.message().c_str()));
+        fs::remove(tmp, ec);
     }
-
     return version;
 }
 
-void pnorClear(const std::string& part, bool shouldEcc = true)
+std::string getPNORVersion()
 {
-    int rc;
-    std::tie(rc, std::ignore) =
-        utils::pflash("-P", part, shouldEcc ? "-c" : "-e", "-f >/dev/null");
-    if (rc != 0)
+    try
     {
-        log<level::ERR>("Failed to clear partition",
-                        entry("PART=%s", part.c_str()),
-                        entry("RETURNCODE=%d", rc));
+        Ffs ffs(mtdDevice("pnor"));
+        std::error_code ec;
+        fs::create_directories(PERSIST_DIR, ec);
+        return getPNORVersion(ffs, fs::path(PERSIST_DIR) / VERSION_CACHE_FILE);
     }
-    else
+    catch (const std::exception& e)
     {
-        log<level::INFO>("Clear partition successfully",
-                         entry("PART=%s", part.c_str()));
+        log<level::ERR>("Failed to read VERSION", entry("ERROR=%s", e.what()));
+        return {};
     }
 }
 
 // The pair contains the partition name and if it should use ECC clear
 using PartClear = std::pair<std::string, bool>;
 
-std::vector<PartClear> getPartsToClear(const std::string& info)
+// Get partitions that should be cleared from the table of contents
+std::vector<PartClear> getPartsToClear(const Ffs& ffs)
 {
     std::vector<PartClear> ret;
-    std::istringstream iss(info);
-    std::string line;
+    for (const auto& part : ffs.entries())
+    {
+        if (part.reprovision())
+        {
+            ret.emplace_back(part.name, part.ecc());
+        }
+    }
+    return ret;
+}
 
-    while (std::getline(iss, line))
+// Clear partitions in a single pass over the flash, with hiomapd suspended
+// only for the erase and program operations.
+FlashIoCounts pnorClear(sdbusplus::bus_t& bus, const Ffs& ffs,
+                        const std::vector<PartClear>& parts)
+{
+    std::vector<ClearRange> ranges;
+    for (const auto& [name, ecc] : parts)
     {
-        // Each line looks like
-        // ID=06 MVPD 0x0012d000..0x001bd000 (actual=0x00090000) [E--P--F-C-]
-        // Flag 'F' means REPROVISION
-        // Flag 'E' means ECC required
-        auto pos = line.find('[');
-        if (pos == std::string::npos)
+        auto part = ffs.find(name);
+        if (!part)
         {
+            log<level::ERR>("No such partition",
+                            entry("PART=%s", name.c_str()));
             continue;
         }
-        auto flags = line.substr(pos);
-        if (flags.find('F') != std::string::npos)
-        {
-            // This is a partition to be cleared
-            pos = line.find_first_of(' '); // After "ID=xx"
-            if (pos == std::string::npos)
-            {
-                continue;
-            }
-            line = line.substr(pos);           // Skipping "ID=xx"
-
-            pos = line.find_first_not_of(' '); // After spaces
-            if (pos == std::string::npos)
-            {
-                continue;
-            }
-            line = line.substr(pos);       // Skipping spaces
+        ranges.push_back({part->offset, part->size, ecc});
+    }
 
-            pos = line.find_first_of(' '); // The end of part name
-            if (pos == std::string::npos)
-            {
-                continue;
-            }
-            line = line.substr(0, pos); // The part name
+    FlashIoCounts io;
+    FlashDevice flash(mtdDevice("pnor"));
 
-            bool ecc = flags.find('E') != std::string::npos;
-            ret.emplace_back(line, ecc);
-        }
+    auto start = std::chrono::steady_clock::now();
+    hiomapdSuspend(bus);
+    try
+    {
+        auto stats = clearRanges(flash, std::move(ranges));
+        io.read = stats.read;
+        io.written = stats.written;
+        io.erased = stats.erased;
+        log<level::INFO>("Cleared partitions",
+                         entry("PARTITIONS=%zu", parts.size()),
+                         entry("ERASES=%" PRIu64, stats.erases));
     }
-    return ret;
-}
+    catch (const std::exception& e)
+    {
+        log<level::ERR>("Failed to clear partitions",
+                        entry("ERROR=%s", e.what()));
+    }
+    hiomapdResume(bus);
+    io.suspended = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
 
-// Get partitions that should be cleared
-std::vector<PartClear> getPartsToClear()
-{
-    const auto& [rc, pflashInfo] = pflash("-i | grep ^ID | grep 'F'");
-    return getPartsToClear(pflashInfo);
+    return io;
 }
 
 } // namespace utils
@@ -309,16 +356,17 @@ void ItemUpdaterStatic::processPNORImage()
 
 void ItemUpdaterStatic::reset()
 {
-    auto partitions = utils::getPartsToClear();
-
-    utils::hiomapdSuspend(bus);
-
-    for (auto p : partitions)
+    try
     {
-        utils::pnorClear(p.first, p.second);
+        Ffs ffs(mtdDevice("pnor"));
+        auto io = utils::pnorClear(bus, ffs, utils::getPartsToClear(ffs));
+        resetFlashIo.record("factory-reset", io);
+    }
+    catch (const std::exception& e)
+    {
+        log<level::ERR>("Failed to clear the PNOR partitions",
+                        entry("ERROR=%s", e.what()));
     }
-
-    utils::hiomapdResume(bus);
 }
 
 bool ItemUpdaterStatic::isVersionFunctional(const std::string& versionId)
@@ -360,11 +408,17 @@ void ItemUpdaterStatic::updateFunctionalAssociation(
 void GardResetStatic::reset()
 {
     // Clear guard partition
-    utils::hiomapdSuspend(bus);
-
-    utils::pnorClear("GUARD");
-
-    utils::hiomapdResume(bus);
+    try
+    {
+        Ffs ffs(mtdDevice("pnor"));
+        auto io = utils::pnorClear(bus, ffs, {{"GUARD", true}});
+        flashIo.record("guard-reset", io);
+    }
+    catch (const std::exception& e)
+    {
+        log<level::ERR>("Failed to clear the GUARD partition",
+                        entry("ERROR=%s", e.what()));
+    }
 }
 
 } // namespace updater
@@ -0,0 +1,484 @@
+#include "pnor_flash.hpp"
+
+#include "ecc.hpp"
+
+#include <fcntl.h>
+#include <mtd/mtd-user.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <phosphor-logging/log.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+using namespace phosphor::logging;
+namespace fs = std::filesystem;
+
+namespace
+{
+
+/** @brief Value of the bytes of an erased block */
+constexpr uint8_t ERASED = 0xff;
+
+bool isErased(const std::vector<uint8_t>& block)
+{
+    return std::all_of(block.begin(), block.end(),
+                       [](auto byte) { return byte == ERASED; });
+}
+
+/** @brief Reads up to size bytes, stopping at the end of the file. */
+size_t readFull(int fd, const fs::path& path, uint8_t* data, size_t size)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        auto bytes = ::read(fd, data + done, size - done);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes < 0)
+        {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to read " + path.string());
+        }
+        if (bytes == 0)
+        {
+            break;
+        }
+        done += bytes;
+    }
+    return done;
+}
+
+} // namespace
+
+FlashDevice::FlashDevice(const fs::path& path) :
+    path(path), fd(open(path.c_str(), O_RDWR | O_CLOEXEC))
+{
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to open " + path.string());
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        auto error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(),
+                                "Failed to stat " + path.string());
+    }
+
+    if (S_ISCHR(st.st_mode))
+    {
+        mtd_info_user info{};
+        if (ioctl(fd, MEMGETINFO, &info) < 0)
+        {
+            auto error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(),
+                                    "Failed to get MTD info of " +
+                                        path.string());
+        }
+        mtd = true;
+        flashSize = info.size;
+        blockSize = info.erasesize;
+    }
+    else
+    {
+        flashSize = st.st_size;
+    }
+
+    if (blockSize == 0 || flashSize % blockSize != 0)
+    {
+        close(fd);
+        throw std::runtime_error("Unsupported flash geometry of " +
+                                 path.string());
+    }
+}
+
+FlashDevice::~FlashDevice()
+{
+    close(fd);
+}
+
+void FlashDevice::read(uint64_t offset, uint8_t* data, size_t size) const
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        auto bytes = pread(fd, data + done, size - done, offset + done);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes <= 0)
+        {
+            throw std::system_error(bytes < 0 ? errno : EIO,
+                                    std::generic_category(),
+                                    "Failed to read " + path.string());
+        }
+        done += bytes;
+    }
+}
+
+void FlashDevice::write(uint64_t offset, const uint8_t* data, size_t size)
+{
+    size_t done = 0;
+    while (done < size)
+    {
+        auto bytes = pwrite(fd, data + done, size - done, offset + done);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes <= 0)
+        {
+            throw std::system_error(bytes < 0 ? errno : EIO,
+                                    std::generic_category(),
+                                    "Failed to write " + path.string());
+        }
+        done += bytes;
+    }
+}
+
+void FlashDevice::erase(uint64_t offset, uint64_t size)
+{
+    if (mtd)
+    {
+        erase_info_user info{};
+        info.start = offset;
+        info.length = size;
+        if (ioctl(fd, MEMERASE, &info) < 0)
+        {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to erase " + path.string());
+        }
+        return;
+    }
+
+    std::vector<uint8_t> blank(size, ERASED);
+    write(offset, blank.data(), blank.size());
+}
+
+FlashStats flashImage(const fs::path& image, FlashDevice& flash)
+{
+    auto fd = open(image.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to open " + image.string());
+    }
+
+    FlashStats stats;
+    stats.eraseSize = flash.eraseSize();
+    stats.blocks = flash.size() / flash.eraseSize();
+
+    std::vector<uint8_t> wanted(flash.eraseSize());
+    std::vector<uint8_t> current(flash.eraseSize());
+
+    try
+    {
+        struct stat st;
+        if (fstat(fd, &st) < 0)
+        {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to stat " + image.string());
+        }
+        stats.imageSize = st.st_size;
+        if (stats.imageSize > flash.size())
+        {
+            throw std::runtime_error("The image is larger than the flash");
+        }
+
+        for (uint64_t block = 0; block < stats.blocks; ++block)
+        {
+            auto offset = block * flash.eraseSize();
+
+            // The image is padded with erased bytes up to the flash size.
+            auto bytes = readFull(fd, image, wanted.data(), wanted.size());
+            std::fill(wanted.begin() + bytes, wanted.end(), ERASED);
+
+            flash.read(offset, current.data(), current.size());
+            if (current == wanted)
+            {
+                ++stats.skipped;
+                continue;
+            }
+
+            if (!isErased(current))
+            {
+                flash.erase(offset, flash.eraseSize());
+                ++stats.erased;
+            }
+            if (!isErased(wanted))
+            {
+                flash.write(offset, wanted.data(), wanted.size());
+                ++stats.programmed;
+            }
+
+            flash.read(offset, current.data(), current.size());
+            if (current != wanted)
+            {
+                throw std::runtime_error("Verification failed at offset " +
+                                         std::to_string(offset));
+            }
+        }
+    }
+    catch (...)
+    {
+        close(fd);
+        throw;
+    }
+    close(fd);
+
+    log<level::INFO>("Flashed PNOR image", entry("IMAGE=%s", image.c_str()),
+                     entry("BLOCKS=%" PRIu64, stats.blocks),
+                     entry("BLOCKS_SKIPPED=%" PRIu64, stats.skipped),
+                     entry("BLOCKS_ERASED=%" PRIu64, stats.erased),
+                     entry("BLOCKS_PROGRAMMED=%" PRIu64, stats.programmed));
+    return stats;
+}
+
+VerifyStats verifyImage(const fs::path& image, const FlashDevice& flash,
+                        std::chrono::milliseconds budget)
+{
+    auto fd = open(image.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to open " + image.string());
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // Whole erase blocks per read, in page aligned buffers.
+    const uint64_t eraseSize = flash.eraseSize();
+    auto chunkSize = std::max<uint64_t>(
+        VERIFY_CHUNK_SIZE / eraseSize * eraseSize, eraseSize);
+    auto buffer = [chunkSize]() {
+        void* ptr = nullptr;
+        if (posix_memalign(&ptr, 4096, chunkSize) != 0)
+        {
+            throw std::bad_alloc();
+        }
+        return std::unique_ptr<uint8_t, decltype(&free)>(
+            static_cast<uint8_t*>(ptr), free);
+    };
+
+    VerifyStats stats;
+    auto start = std::chrono::steady_clock::now();
+    try
+    {
+        auto wanted = buffer();
+        auto current = buffer();
+
+        while (stats.verified < flash.size())
+        {
+            if (budget.count() > 0 &&
+                std::chrono::steady_clock::now() - start > budget)
+            {
+                break;
+            }
+
+            auto size = std::min(chunkSize, flash.size() - stats.verified);
+            auto bytes = readFull(fd, image, wanted.get(), size);
+            std::fill(wanted.get() + bytes, wanted.get() + size, ERASED);
+            flash.read(stats.verified, current.get(), size);
+
+            if (std::memcmp(wanted.get(), current.get(), size) != 0)
+            {
+                for (uint64_t block = 0; block < size; block += eraseSize)
+                {
+                    if (std::memcmp(wanted.get() + block,
+                                    current.get() + block, eraseSize) != 0)
+                    {
+                        stats.verified += block;
+                        stats.mismatch = stats.verified;
+                        break;
+                    }
+                }
+                break;
+            }
+            stats.verified += size;
+        }
+    }
+    catch (...)
+    {
+        close(fd);
+        throw;
+    }
+    close(fd);
+
+    stats.complete = stats.verified == flash.size();
+    stats.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    return stats;
+}
+
+ClearStats clearRanges(FlashDevice& flash, std::vector<ClearRange> ranges)
+{
+    std::sort(ranges.begin(), ranges.end(),
+              [](const auto& a, const auto& b) { return a.offset < b.offset; });
+
+    // Merge the adjacent and overlapping ranges into runs to erase.
+    std::vector<std::pair<uint64_t, uint64_t>> runs;
+    for (const auto& range : ranges)
+    {
+        if (range.size == 0)
+        {
+            continue;
+        }
+        if (range.offset + range.size > flash.size())
+        {
+            throw std::runtime_error("Range out of the flash at offset " +
+                                     std::to_string(range.offset));
+        }
+        if (!runs.empty() && range.offset <= runs.back().second)
+        {
+            runs.back().second =
+                std::max(runs.back().second, range.offset + range.size);
+            continue;
+        }
+        runs.emplace_back(range.offset, range.offset + range.size);
+    }
+
+    ClearStats stats;
+    const uint64_t eraseSize = flash.eraseSize();
+    std::vector<uint8_t> buffer;
+
+    for (const auto& [start, end] : runs)
+    {
+        auto blockStart = start / eraseSize * eraseSize;
+        auto blockEnd = (end + eraseSize - 1) / eraseSize * eraseSize;
+
+        // Save what shares the first and last erase blocks with the run.
+        std::vector<uint8_t> head(start - blockStart);
+        std::vector<uint8_t> tail(blockEnd - end);
+        flash.read(blockStart, head.data(), head.size());
+        flash.read(end, tail.data(), tail.size());
+        stats.read += head.size() + tail.size();
+
+        flash.erase(blockStart, blockEnd - blockStart);
+        ++stats.erases;
+        stats.erased += blockEnd - blockStart;
+
+        if (!isErased(head))
+        {
+            flash.write(blockStart, head.data(), head.size());
+            stats.written += head.size();
+        }
+        if (!isErased(tail))
+        {
+            flash.write(end, tail.data(), tail.size());
+            stats.written += tail.size();
+        }
+    }
+
+    // An ECC clear leaves the data erased, each word then carries the ECC
+    // byte of 0xff data. The chunks are whole ECC words, so that the words
+    // stay aligned on the start of the range.
+    constexpr uint64_t chunkSize =
+        64 * 1024 / ecc::ECC_WORD_SIZE * ecc::ECC_WORD_SIZE;
+    for (const auto& range : ranges)
+    {
+        if (!range.ecc)
+        {
+            continue;
+        }
+        if (buffer.empty())
+        {
+            std::vector<uint8_t> erased(chunkSize / ecc::ECC_WORD_SIZE *
+                                            ecc::WORD_SIZE,
+                                        0xff);
+            buffer.resize(chunkSize);
+            ecc::encode(erased.data(), erased.size(), buffer.data());
+        }
+        for (uint64_t done = 0; done < range.size; done += chunkSize)
+        {
+            auto size = std::min(range.size - done, chunkSize);
+            flash.write(range.offset + done, buffer.data(), size);
+            stats.written += size;
+        }
+    }
+
+    return stats;
+}
+
+void saveFlashStats(const fs::path& file, const FlashStats& stats)
+{
+    std::ofstream out(file);
+    out << "blocks " << stats.blocks << "\n"
+        << "skipped " << stats.skipped << "\n"
+        << "erased " << stats.erased << "\n"
+        << "programmed " << stats.programmed << "\n"
+        << "erasesize " << stats.eraseSize << "\n"
+        << "imagesize " << stats.imageSize << "\n"
+        << "verified " << stats.verified << "\n";
+}
+
+bool loadFlashStats(const fs::path& file, FlashStats& stats)
+{
+    std::ifstream in(file);
+    if (!in)
+    {
+        return false;
+    }
+
+    std::string key;
+    uint64_t value = 0;
+    while (in >> key >> value)
+    {
+        if (key == "blocks")
+        {
+            stats.blocks = value;
+        }
+        else if (key == "skipped")
+        {
+            stats.skipped = value;
+        }
+        else if (key == "erased")
+        {
+            stats.erased = value;
+        }
+        else if (key == "programmed")
+        {
+            stats.programmed = value;
+        }
+        else if (key == "erasesize")
+        {
+            stats.eraseSize = value;
+        }
+        else if (key == "imagesize")
+        {
+            stats.imageSize = value;
+        }
+        else if (key == "verified")
+        {
+            stats.verified = value;
+        }
+    }
+    return true;
+}
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
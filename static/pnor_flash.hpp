@@ -0,0 +1,209 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+/** @brief Erase block size assumed for flash image files */
+constexpr uint32_t FLASH_FILE_ERASE_SIZE = 64 * 1024;
+
+/** @brief Suffix of the file the flashing statistics are saved to, next to
+ *         the PNOR image
+ */
+constexpr auto FLASH_STATS_SUFFIX = ".flashstats";
+
+/** @struct FlashStats
+ *  @brief Outcome of a differential flashing.
+ */
+struct FlashStats
+{
+    /** @brief Number of erase blocks of the flash */
+    uint64_t blocks = 0;
+    /** @brief Number of blocks already holding the image data */
+    uint64_t skipped = 0;
+    /** @brief Number of blocks erased */
+    uint64_t erased = 0;
+    /** @brief Number of blocks programmed */
+    uint64_t programmed = 0;
+    /** @brief The erase block size */
+    uint32_t eraseSize = 0;
+    /** @brief The image size */
+    uint64_t imageSize = 0;
+    /** @brief Bytes read back by the verification */
+    uint64_t verified = 0;
+};
+
+/** @struct VerifyStats
+ *  @brief Outcome of the verification of a flash against an image.
+ */
+struct VerifyStats
+{
+    /** @brief Bytes of the flash compared to the image */
+    uint64_t verified = 0;
+    /** @brief Offset of the first erase block not matching the image */
+    std::optional<uint64_t> mismatch;
+    /** @brief Whether the whole flash was compared within the budget */
+    bool complete = false;
+    /** @brief Time spent */
+    std::chrono::milliseconds elapsed{0};
+};
+
+/** @brief Size of the reads of the verification */
+constexpr size_t VERIFY_CHUNK_SIZE = 1024 * 1024;
+
+/** @struct ClearRange
+ *  @brief A flash range to clear, usually a partition.
+ */
+struct ClearRange
+{
+    /** @brief The range offset */
+    uint64_t offset = 0;
+    /** @brief The range size */
+    uint64_t size = 0;
+    /** @brief Whether the range is left ECC clean rather than erased */
+    bool ecc = false;
+};
+
+/** @struct ClearStats
+ *  @brief Outcome of a batch clearing.
+ */
+struct ClearStats
+{
+    /** @brief Number of erase operations, after merging adjacent ranges */
+    uint64_t erases = 0;
+    /** @brief Bytes erased, whole erase blocks */
+    uint64_t erased = 0;
+    /** @brief Bytes programmed, ECC fill and preserved block edges */
+    uint64_t written = 0;
+    /** @brief Bytes read to preserve the edges of partial blocks */
+    uint64_t read = 0;
+};
+
+/** @class FlashDevice
+ *  @brief Erase block access to a flash.
+ *  @details The flash is either an MTD character device, erased with the
+ *  MEMERASE ioctl, or a flash image file whose erased blocks are filled with
+ *  0xff.
+ */
+class FlashDevice
+{
+  public:
+    FlashDevice() = delete;
+    FlashDevice(const FlashDevice&) = delete;
+    FlashDevice& operator=(const FlashDevice&) = delete;
+    FlashDevice(FlashDevice&&) = delete;
+    FlashDevice& operator=(FlashDevice&&) = delete;
+
+    /** @brief Opens a flash for reading and writing.
+     *
+     *  @param[in] path - The MTD device or flash image file.
+     */
+    explicit FlashDevice(const std::filesystem::path& path);
+
+    ~FlashDevice();
+
+    /** @brief Returns the flash size in bytes. */
+    uint64_t size() const
+    {
+        return flashSize;
+    }
+
+    /** @brief Returns the erase block size in bytes. */
+    uint32_t eraseSize() const
+    {
+        return blockSize;
+    }
+
+    /** @brief Reads bytes of the flash. */
+    void read(uint64_t offset, uint8_t* data, size_t size) const;
+
+    /** @brief Programs bytes of erased blocks. */
+    void write(uint64_t offset, const uint8_t* data, size_t size);
+
+    /** @brief Erases whole erase blocks. */
+    void erase(uint64_t offset, uint64_t size);
+
+  private:
+    /** @brief The flash path */
+    std::filesystem::path path;
+
+    /** @brief The flash file descriptor */
+    int fd;
+
+    /** @brief Whether the flash is an MTD device */
+    bool mtd = false;
+
+    /** @brief The flash size */
+    uint64_t flashSize = 0;
+
+    /** @brief The erase block size */
+    uint32_t blockSize = FLASH_FILE_ERASE_SIZE;
+};
+
+/** @brief Writes a PNOR image to a flash, one erase block at a time.
+ *  @details Each block of the image is compared to the block on the flash,
+ *  identical blocks are left alone. A differing block is erased, unless it
+ *  is already blank, programmed unless the image block is blank, and read
+ *  back to verify it. The flash beyond the end of the image ends up erased,
+ *  as with a whole chip erase.
+ *
+ *  @param[in] image - The PNOR image file.
+ *  @param[in] flash - The flash to update.
+ *  @return The flashing statistics, throws on failure.
+ */
+FlashStats flashImage(const std::filesystem::path& image, FlashDevice& flash);
+
+/** @brief Reads a flash back and compares it to a PNOR image.
+ *  @details The flash and image are streamed in large reads aligned on
+ *  erase blocks, the image being padded with erased bytes up to the flash
+ *  size. The comparison stops at the first erase block that differs, or
+ *  once the time budget is spent.
+ *
+ *  @param[in] image  - The PNOR image file.
+ *  @param[in] flash  - The flash.
+ *  @param[in] budget - The time the verification may take, unlimited if
+ *                      zero.
+ *  @return The verification statistics, throws on I/O errors.
+ */
+VerifyStats verifyImage(const std::filesystem::path& image,
+                        const FlashDevice& flash,
+                        std::chrono::milliseconds budget = {});
+
+/** @brief Clears ranges of a flash in a single pass.
+ *  @details The ranges are sorted by offset and the adjacent ones merged,
+ *  so that each run is erased at once. The data sharing an erase block
+ *  with a run is preserved. The ECC ranges are then written with the ECC
+ *  bytes of erased data, leaving the data 0xff, as pflash -c does.
+ *
+ *  @param[in] flash  - The flash.
+ *  @param[in] ranges - The ranges to clear.
+ *  @return The clearing statistics, throws on failure.
+ */
+ClearStats clearRanges(FlashDevice& flash, std::vector<ClearRange> ranges);
+
+/** @brief Saves flashing statistics to a file. */
+void saveFlashStats(const std::filesystem::path& file,
+                    const FlashStats& stats);
+
+/** @brief Loads flashing statistics from a file.
+ *
+ *  @param[in]  file  - The statistics file.
+ *  @param[out] stats - The statistics read.
+ *  @return Whether the file was found and read.
+ */
+bool loadFlashStats(const std::filesystem::path& file, FlashStats& stats);
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
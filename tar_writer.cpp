@@ -0,0 +1,259 @@
+#include "tar_writer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+/** @brief Size of a tar block */
+constexpr size_t TAR_BLOCK_SIZE = 512;
+
+/** @brief Size of the read and compression buffers */
+constexpr size_t BUFFER_SIZE = 256 * 1024;
+
+/** @brief Size of the name field of a tar header */
+constexpr size_t TAR_NAME_SIZE = 100;
+
+/** @brief Name of the GNU entry holding the name of the next entry */
+constexpr auto GNU_LONGNAME = "././@LongLink";
+
+/** @brief Largest entry size a ustar header holds, 11 octal digits */
+constexpr uint64_t TAR_MAX_SIZE = 077777777777ULL;
+
+/** @brief Writes a value in octal into a header field, NUL terminated. */
+void putOctal(uint8_t* field, size_t size, uint64_t value)
+{
+    std::snprintf(reinterpret_cast<char*>(field), size, "%0*llo",
+                  static_cast<int>(size - 1),
+                  static_cast<unsigned long long>(value));
+}
+
+} // namespace
+
+TarWriter::TarWriter(const fs::path& archive, bool gzip, time_t mtime) :
+    archive(archive), tmpArchive(fs::path(archive) += ".tmp"), gzip(gzip),
+    mtime(mtime)
+{
+    out.open(tmpArchive, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        throw std::runtime_error("Failed to create " + tmpArchive.string());
+    }
+
+    if (gzip)
+    {
+        // gzip's default level, the gzip header has no name nor time
+        if (deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                         MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            out.close();
+            fs::remove(tmpArchive);
+            throw std::runtime_error("Failed to initialize zlib");
+        }
+        zbuffer.resize(BUFFER_SIZE);
+    }
+}
+
+TarWriter::~TarWriter()
+{
+    if (gzip)
+    {
+        deflateEnd(&zstream);
+    }
+    if (!closed)
+    {
+        out.close();
+        std::error_code ec;
+        fs::remove(tmpArchive, ec);
+    }
+}
+
+void TarWriter::add(const std::string& name, std::string_view data,
+                    const TarObserver& observer)
+{
+    header(name, data.size());
+    auto bytes = reinterpret_cast<const uint8_t*>(data.data());
+    write(bytes, data.size());
+    if (observer)
+    {
+        observer(bytes, data.size());
+    }
+    pad(data.size());
+}
+
+void TarWriter::add(const std::string& name, const fs::path& file,
+                    const TarObserver& observer)
+{
+    std::ifstream in(file, std::ios::binary);
+    if (!in)
+    {
+        throw std::runtime_error("Failed to open " + file.string());
+    }
+    auto size = fs::file_size(file);
+    header(name, size);
+
+    std::vector<uint8_t> buffer(BUFFER_SIZE);
+    uint64_t done = 0;
+    while (done < size)
+    {
+        in.read(reinterpret_cast<char*>(buffer.data()),
+                std::min<uint64_t>(buffer.size(), size - done));
+        auto bytes = static_cast<size_t>(in.gcount());
+        if (bytes == 0)
+        {
+            throw std::runtime_error("Short read of " + file.string());
+        }
+        write(buffer.data(), bytes);
+        if (observer)
+        {
+            observer(buffer.data(), bytes);
+        }
+        done += bytes;
+    }
+    pad(size);
+}
+
+void TarWriter::close()
+{
+    // The archive ends with two zero blocks
+    std::array<uint8_t, 2 * TAR_BLOCK_SIZE> end{};
+    write(end.data(), end.size());
+    if (gzip)
+    {
+        deflateOut(Z_FINISH);
+    }
+    out.close();
+    if (!out)
+    {
+        throw std::runtime_error("Failed to write " + tmpArchive.string());
+    }
+    fs::rename(tmpArchive, archive);
+    closed = true;
+}
+
+void TarWriter::header(const std::string& name, uint64_t size)
+{
+    if (name.empty())
+    {
+        throw std::invalid_argument("Empty tar entry name");
+    }
+    if (size > TAR_MAX_SIZE)
+    {
+        throw std::invalid_argument("Tar entry too large " + name);
+    }
+
+    if (name.size() > TAR_NAME_SIZE)
+    {
+        // A GNU longname entry holding the name, NUL terminated, precedes
+        // the entry, whose own header holds the name truncated.
+        headerBlock(GNU_LONGNAME, name.size() + 1, 'L');
+        write(reinterpret_cast<const uint8_t*>(name.c_str()), name.size() + 1);
+        pad(name.size() + 1);
+    }
+    headerBlock(name.substr(0, TAR_NAME_SIZE), size, '0');
+}
+
+void TarWriter::headerBlock(const std::string& name, uint64_t size,
+                            char type)
+{
+    std::array<uint8_t, TAR_BLOCK_SIZE> block{};
+    std::memcpy(&block[0], name.data(), name.size());
+    putOctal(&block[100], 8, 0644);
+    putOctal(&block[108], 8, 0);
+    putOctal(&block[116], 8, 0);
+    putOctal(&block[124], 12, size);
+    putOctal(&block[136], 12, static_cast<uint64_t>(mtime));
+    block[156] = type;
+    if (type == 'L')
+    {
+        // GNU tar writes its extensions with the old GNU magic
+        std::memcpy(&block[257], "ustar  ", 8);
+    }
+    else
+    {
+        std::memcpy(&block[257], "ustar", 6);
+        std::memcpy(&block[263], "00", 2);
+    }
+    std::memcpy(&block[265], "root", 4);
+    std::memcpy(&block[297], "root", 4);
+
+    // The checksum is computed with its own field filled with spaces
+    std::memset(&block[148], ' ', 8);
+    unsigned checksum = 0;
+    for (auto byte : block)
+    {
+        checksum += byte;
+    }
+    putOctal(&block[148], 7, checksum);
+    write(block.data(), block.size());
+}
+
+void TarWriter::write(const uint8_t* data, size_t size)
+{
+    if (!gzip)
+    {
+        out.write(reinterpret_cast<const char*>(data), size);
+        if (!out)
+        {
+            throw std::runtime_error("Failed to write " +
+                                     tmpArchive.string());
+        }
+        return;
+    }
+
+    zstream.next_in = const_cast<uint8_t*>(data);
+    zstream.avail_in = size;
+    deflateOut(Z_NO_FLUSH);
+}
+
+void TarWriter::pad(uint64_t size)
+{
+    static const std::array<uint8_t, TAR_BLOCK_SIZE> zeros{};
+    auto remainder = size % TAR_BLOCK_SIZE;
+    if (remainder != 0)
+    {
+        write(zeros.data(), TAR_BLOCK_SIZE - remainder);
+    }
+}
+
+void TarWriter::deflateOut(int flush)
+{
+    int ret = Z_OK;
+    do
+    {
+        zstream.next_out = zbuffer.data();
+        zstream.avail_out = zbuffer.size();
+        ret = deflate(&zstream, flush);
+        if (ret == Z_STREAM_ERROR)
+        {
+            throw std::runtime_error("Failed to compress " +
+                                     tmpArchive.string());
+        }
+        out.write(reinterpret_cast<const char*>(zbuffer.data()),
+                  zbuffer.size() - zstream.avail_out);
+        if (!out)
+        {
+            throw std::runtime_error("Failed to write " +
+                                     tmpArchive.string());
+        }
+    } while (zstream.avail_out == 0 ||
+             (flush == Z_FINISH && ret != Z_STREAM_END));
+}
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <zlib.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+/** @brief Called with the data of an entry as it is written */
+using TarObserver = std::function<void(const uint8_t*, size_t)>;
+
+/** @class TarWriter
+ *  @brief Writer of a ustar archive, gzip compressed or not.
+ *  @details The entries are streamed to the archive as they are added, the
+ *  data of a file is read once. The entries are regular files owned by
+ *  root, with mode 0644 and a fixed modification time, so that the same
+ *  content gives the same archive. The archive is written aside and renamed
+ *  in place by close, it is removed if the writer is destroyed before. A
+ *  name longer than a header holds is written in a GNU longname entry.
+ */
+class TarWriter
+{
+  public:
+    TarWriter() = delete;
+    TarWriter(const TarWriter&) = delete;
+    TarWriter& operator=(const TarWriter&) = delete;
+    TarWriter(TarWriter&&) = delete;
+    TarWriter& operator=(TarWriter&&) = delete;
+
+    /** @brief Constructs TarWriter, creating the archive.
+     *
+     *  @param[in] archive - The archive file.
+     *  @param[in] gzip    - Whether to gzip compress the archive.
+     *  @param[in] mtime   - The modification time of the entries.
+     */
+    TarWriter(const std::filesystem::path& archive, bool gzip, time_t mtime);
+
+    ~TarWriter();
+
+    /** @brief Adds an entry from memory.
+     *
+     *  @param[in] name     - The entry name.
+     *  @param[in] data     - The entry data.
+     *  @param[in] observer - Called with the data as it is written.
+     */
+    void add(const std::string& name, std::string_view data,
+             const TarObserver& observer = {});
+
+    /** @brief Adds an entry from a file.
+     *
+     *  @param[in] name     - The entry name.
+     *  @param[in] file     - The file.
+     *  @param[in] observer - Called with the data as it is written.
+     */
+    void add(const std::string& name, const std::filesystem::path& file,
+             const TarObserver& observer = {});
+
+    /** @brief Ends the archive and renames it in place, throws on failure. */
+    void close();
+
+  private:
+    /** @brief Writes the header of an entry, preceded by a GNU longname
+     *         entry if its name does not fit in the header.
+     */
+    void header(const std::string& name, uint64_t size);
+
+    /** @brief Writes a header block. */
+    void headerBlock(const std::string& name, uint64_t size, char type);
+
+    /** @brief Writes data to the archive, compressing it if needed. */
+    void write(const uint8_t* data, size_t size);
+
+    /** @brief Pads the entry data to a whole block. */
+    void pad(uint64_t size);
+
+    /** @brief Writes the pending compressed data. */
+    void deflateOut(int flush);
+
+    /** @brief The archive file */
+    std::filesystem::path archive;
+
+    /** @brief The file being written, renamed to the archive by close */
+    std::filesystem::path tmpArchive;
+
+    /** @brief The archive stream */
+    std::ofstream out;
+
+    /** @brief Whether the archive is gzip compressed */
+    bool gzip;
+
+    /** @brief The zlib stream if the archive is compressed */
+    z_stream zstream{};
+
+    /** @brief The compressed data pending a write */
+    std::vector<uint8_t> zbuffer;
+
+    /** @brief The modification time of the entries */
+    time_t mtime;
+
+    /** @brief Whether the archive was closed */
+    bool closed = false;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
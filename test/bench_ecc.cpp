@@ -0,0 +1,70 @@
+#include "static/ecc.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+using namespace openpower::software::updater;
+
+namespace
+{
+
+/** @brief Size of the data of a 64MiB PNOR worth of ECC words */
+constexpr size_t dataSize = 64 * 1024 * 1024 / ecc::ECC_WORD_SIZE *
+                            ecc::WORD_SIZE;
+
+constexpr int rounds = 5;
+
+/** @brief Returns the best throughput in GB/s of the data processed by a
+ *         function.
+ */
+double measure(const std::function<void()>& func)
+{
+    double best = 0;
+    for (int i = 0; i < rounds; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        best = std::max(best, dataSize / elapsed.count() / 1e9);
+    }
+    return best;
+}
+
+} // namespace
+
+int main()
+{
+    std::vector<uint8_t> data(dataSize);
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = i * 2654435761u >> 24;
+    }
+    std::vector<uint8_t> eccBytes(dataSize / ecc::WORD_SIZE);
+    std::vector<uint8_t> encoded(dataSize / ecc::WORD_SIZE *
+                                 ecc::ECC_WORD_SIZE);
+    std::vector<uint8_t> decoded(dataSize);
+
+    std::printf("%-10s %12s %12s %12s\n", "impl", "kernel", "encode",
+                "decode");
+    for (auto impl : ecc::supported())
+    {
+        auto kernel = ecc::kernel(impl);
+        auto kernelRate = measure([&]() {
+            kernel(data.data(), eccBytes.data(), eccBytes.size());
+        });
+        auto encodeRate = measure([&]() {
+            ecc::encode(data.data(), data.size(), encoded.data(), impl);
+        });
+        auto decodeRate = measure([&]() {
+            ecc::decode(encoded.data(), encoded.size(), decoded.data(), impl);
+        });
+        std::printf("%-10s %7.2f GB/s %7.2f GB/s %7.2f GB/s\n",
+                    ecc::name(impl), kernelRate, encodeRate, decodeRate);
+    }
+
+    return data == decoded ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+#include "functions.hpp"
+
+#include <stdlib.h>
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace functions::process_hostfirmware;
+
+namespace
+{
+
+/** @brief Number of synthetic lids */
+constexpr int lidCount = 10000;
+
+constexpr int rounds = 5;
+
+/** @brief Returns the best time in milliseconds of a function. */
+double measure(const std::function<void()>& func)
+{
+    double best = 0;
+    for (int i = 0; i < rounds; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        best = i == 0 ? elapsed.count() : std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+} // namespace
+
+int main()
+{
+    char tmpl[] = "/tmp/bench_links.XXXXXX";
+    std::filesystem::path dir = mkdtemp(tmpl);
+
+    // The extensions of a system with several alternatives, half of the
+    // lids need a well-known name.
+    const std::vector<std::string> extensions{
+        ".BALCONES_XML", ".BLUERIDGE_2U_XML", ".BONNELL_XML", ".EVEREST_XML",
+        ".FUJI_XML",     ".RAINIER_2U_XML",   ".P10"};
+    std::ofstream{dir / "81e00994.lid"};
+    for (int i = 0; i < lidCount; ++i)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%08x%s", 0x81e00000 + i,
+                      i % 2 ? ".P10" : ".lid");
+        std::ofstream{dir / name};
+    }
+
+    int errors = 0;
+    auto errorCallback = [&errors](const auto&, auto&) { ++errors; };
+    // The first run creates the links, later runs only read the directory.
+    auto start = std::chrono::steady_clock::now();
+    writeLinks(dir, extensions, errorCallback);
+    std::chrono::duration<double, std::milli> createdMs =
+        std::chrono::steady_clock::now() - start;
+    auto unchangedMs =
+        measure([&]() { writeLinks(dir, extensions, errorCallback); });
+
+    std::printf("%-28s %10s\n", "links", "time");
+    std::printf("%-28s %7.2f ms\n", "writeLinks, created", createdMs.count());
+    std::printf("%-28s %7.2f ms\n", "writeLinks, unchanged", unchangedMs);
+
+    std::filesystem::remove_all(dir);
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdlib.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+/** @class TempDirTest
+ *  @brief Test fixture owning a temporary directory, removed with its
+ *         content after each test.
+ */
+class TempDirTest : public testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        char tmpDir[] = "/tmp/openpower_test.XXXXXX";
+        ASSERT_NE(nullptr, mkdtemp(tmpDir));
+        dir = tmpDir;
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(dir);
+    }
+
+    /** @brief Writes a file, replacing its content. */
+    static void writeFile(const std::filesystem::path& path,
+                          std::string_view content)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(content.data(), content.size());
+    }
+
+    /** @brief Writes a file of bytes, replacing its content. */
+    static void writeFile(const std::filesystem::path& path,
+                          const std::vector<uint8_t>& content)
+    {
+        writeFile(path,
+                  std::string_view(reinterpret_cast<const char*>(
+                                       content.data()),
+                                   content.size()));
+    }
+
+    /** @brief Returns the content of a file, empty if it cannot be read. */
+    static std::string readFile(const std::filesystem::path& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return {std::istreambuf_iterator<char>(file),
+                std::istreambuf_iterator<char>()};
+    }
+
+    /** @brief Returns the content of a file as bytes. */
+    static std::vector<uint8_t> readBytes(const std::filesystem::path& path)
+    {
+        auto content = readFile(path);
+        return {content.begin(), content.end()};
+    }
+
+    /** @brief The temporary directory */
+    std::filesystem::path dir;
+};
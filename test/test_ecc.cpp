@@ -0,0 +1,130 @@
+#include "static/ecc.hpp"
+
+#include <cstdint>
+#include <random>
+#include <set>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace openpower::software::updater;
+
+namespace
+{
+
+std::vector<uint8_t> randomData(size_t size)
+{
+    std::mt19937 gen(size);
+    std::uniform_int_distribution<int> dist(0, 255);
+    std::vector<uint8_t> data(size);
+    for (auto& byte : data)
+    {
+        byte = dist(gen);
+    }
+    return data;
+}
+
+} // namespace
+
+TEST(TestEcc, knownWords)
+{
+    std::vector<uint8_t> zeroes(ecc::WORD_SIZE, 0);
+    EXPECT_EQ(0, ecc::generate(zeroes.data()));
+
+    std::vector<uint8_t> ones(ecc::WORD_SIZE, 0xff);
+    EXPECT_EQ(0, ecc::generate(ones.data()));
+
+    // The last byte of the word is the low byte of the big endian value,
+    // row 0 of the matrix masks it with 0xff.
+    std::vector<uint8_t> low = {0, 0, 0, 0, 0, 0, 0, 0x01};
+    EXPECT_EQ(0x01, ecc::generate(low.data()) & 0x01);
+}
+
+TEST(TestEcc, singleBitSyndromesAreUnique)
+{
+    std::set<uint8_t> syndromes;
+    for (int bit = 0; bit < 64; ++bit)
+    {
+        std::vector<uint8_t> word(ecc::WORD_SIZE, 0);
+        word[bit / 8] = 1 << (bit % 8);
+        auto syndrome = ecc::generate(word.data());
+        EXPECT_NE(0, syndrome);
+        // Not mistaken for a flipped ECC bit
+        EXPECT_NE(0, syndrome & (syndrome - 1));
+        syndromes.insert(syndrome);
+    }
+    EXPECT_EQ(64, syndromes.size());
+}
+
+TEST(TestEcc, kernelsMatchReference)
+{
+    // Odd word counts exercise the scalar tails of the SIMD kernels.
+    for (size_t words : {1, 15, 16, 33, 1000, 4099})
+    {
+        auto data = randomData(words * ecc::WORD_SIZE);
+        std::vector<uint8_t> expected(words);
+        ecc::kernel(ecc::Impl::Reference)(data.data(), expected.data(), words);
+
+        for (auto impl : ecc::supported())
+        {
+            std::vector<uint8_t> result(words);
+            ecc::kernel(impl)(data.data(), result.data(), words);
+            EXPECT_EQ(expected, result)
+                << ecc::name(impl) << ", " << words << " words";
+        }
+    }
+}
+
+TEST(TestEcc, encodeDecode)
+{
+    auto data = randomData(4096);
+
+    for (auto impl : ecc::supported())
+    {
+        std::vector<uint8_t> encoded(data.size() / 8 * 9);
+        ecc::encode(data.data(), data.size(), encoded.data(), impl);
+
+        std::vector<uint8_t> decoded(data.size());
+        auto stats = ecc::decode(encoded.data(), encoded.size(),
+                                 decoded.data(), impl);
+        EXPECT_EQ(data, decoded) << ecc::name(impl);
+        EXPECT_EQ(0, stats.corrected);
+        EXPECT_EQ(0, stats.uncorrectable);
+    }
+}
+
+TEST(TestEcc, correctSingleBitErrors)
+{
+    auto data = randomData(ecc::WORD_SIZE);
+    std::vector<uint8_t> encoded(ecc::ECC_WORD_SIZE);
+    ecc::encode(data.data(), data.size(), encoded.data());
+
+    // Every data and ECC bit
+    for (size_t bit = 0; bit < ecc::ECC_WORD_SIZE * 8; ++bit)
+    {
+        auto corrupted = encoded;
+        corrupted[bit / 8] ^= 1 << (bit % 8);
+
+        std::vector<uint8_t> decoded(ecc::WORD_SIZE);
+        auto stats = ecc::decode(corrupted.data(), corrupted.size(),
+                                 decoded.data());
+        EXPECT_EQ(data, decoded) << "bit " << bit;
+        EXPECT_EQ(1, stats.corrected);
+        EXPECT_EQ(0, stats.uncorrectable);
+    }
+}
+
+TEST(TestEcc, detectDoubleBitErrors)
+{
+    auto data = randomData(ecc::WORD_SIZE * 4);
+    std::vector<uint8_t> encoded(ecc::ECC_WORD_SIZE * 4);
+    ecc::encode(data.data(), data.size(), encoded.data());
+
+    // Two bits of the second word
+    encoded[ecc::ECC_WORD_SIZE + 1] ^= 0x11;
+
+    std::vector<uint8_t> decoded(data.size());
+    auto stats = ecc::decode(encoded.data(), encoded.size(), decoded.data());
+    EXPECT_EQ(0, stats.corrected);
+    EXPECT_EQ(1, stats.uncorrectable);
+}
@@ -0,0 +1,365 @@
+#include "pnor_packager.hpp"
+#include "static/ecc.hpp"
+#include "static/ffs.hpp"
+
+#include <endian.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace openpower::software::updater;
+namespace fs = std::filesystem;
+
+using PartClear = std::pair<std::string, bool>;
+namespace utils
+{
+extern std::string getPNORVersion(const Ffs& ffs);
+extern std::string getPNORVersion(const Ffs& ffs, const fs::path& cache);
+extern std::vector<PartClear> getPartsToClear(const Ffs& ffs);
+} // namespace utils
+
+class FfsTest : public testing::Test
+{
+  protected:
+    static constexpr uint32_t blockSize = 0x1000;
+    static constexpr uint32_t blockCount = 64;
+
+    struct Part
+    {
+        std::string name;
+        uint32_t base;
+        uint32_t size;
+        uint32_t type;
+        uint16_t dataInteg;
+        uint8_t miscFlags;
+        std::vector<uint8_t> data;
+    };
+
+    void SetUp() override
+    {
+        char tmpFile[] = "/tmp/ffs_test.XXXXXX";
+        auto fd = mkstemp(tmpFile);
+        close(fd);
+        image = tmpFile;
+
+        parts = {
+            {"part", 0, 1, FFS_TYPE_PARTITION, 0, 0, {}},
+            {"HBEL", 1, 4, FFS_TYPE_DATA, FFS_ENTRY_INTEG_ECC,
+             FFS_MISCFLAGS_REPROVISION | FFS_MISCFLAGS_CLEARECC, {}},
+            {"GUARD", 5, 2, FFS_TYPE_DATA, FFS_ENTRY_INTEG_ECC,
+             FFS_MISCFLAGS_PRESERVED | FFS_MISCFLAGS_REPROVISION |
+                 FFS_MISCFLAGS_CLEARECC,
+             {}},
+            {"NVRAM", 7, 8, FFS_TYPE_DATA, 0,
+             FFS_MISCFLAGS_PRESERVED | FFS_MISCFLAGS_REPROVISION, {}},
+            {"HBB", 15, 16, FFS_TYPE_DATA, FFS_ENTRY_INTEG_ECC,
+             FFS_MISCFLAGS_READONLY, {}},
+            {"VERSION", 31, 2, FFS_TYPE_DATA, 0, FFS_MISCFLAGS_READONLY, {}},
+        };
+    }
+
+    void TearDown() override
+    {
+        fs::remove(image);
+    }
+
+    static void putBe32(std::vector<uint8_t>& buf, size_t offset,
+                        uint32_t value)
+    {
+        value = htobe32(value);
+        std::memcpy(buf.data() + offset, &value, sizeof(value));
+    }
+
+    static void checksum(std::vector<uint8_t>& buf, size_t offset,
+                         size_t size)
+    {
+        uint32_t sum = 0;
+        for (size_t i = offset; i < offset + size - 4; i += 4)
+        {
+            uint32_t word;
+            std::memcpy(&word, buf.data() + i, sizeof(word));
+            sum ^= be32toh(word);
+        }
+        putBe32(buf, offset + size - 4, sum);
+    }
+
+    void writeImage()
+    {
+        std::vector<uint8_t> buf(blockSize * blockCount, 0xff);
+        std::fill(buf.begin(), buf.begin() + blockSize, 0);
+
+        putBe32(buf, 0, FFS_MAGIC);
+        putBe32(buf, 4, 1);
+        putBe32(buf, 8, 1);
+        putBe32(buf, 12, FFS_ENTRY_SIZE);
+        putBe32(buf, 16, parts.size());
+        putBe32(buf, 20, blockSize);
+        putBe32(buf, 24, blockCount);
+        checksum(buf, 0, FFS_HDR_SIZE);
+
+        for (size_t i = 0; i < parts.size(); ++i)
+        {
+            const auto& part = parts[i];
+            auto offset = FFS_HDR_SIZE + i * FFS_ENTRY_SIZE;
+            std::memcpy(buf.data() + offset, part.name.data(),
+                        part.name.size());
+            putBe32(buf, offset + 16, part.base);
+            putBe32(buf, offset + 20, part.size);
+            putBe32(buf, offset + 28, i);
+            putBe32(buf, offset + 32, part.type);
+            putBe32(buf, offset + 40,
+                     part.data.empty() ? part.size * blockSize
+                                       : part.data.size());
+            buf[offset + 62] = part.dataInteg >> 8;
+            buf[offset + 63] = part.dataInteg & 0xff;
+            buf[offset + 65] = part.miscFlags;
+            checksum(buf, offset, FFS_ENTRY_SIZE);
+
+            std::copy(part.data.begin(), part.data.end(),
+                      buf.begin() + part.base * blockSize);
+        }
+
+        std::ofstream file(image, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(buf.data()), buf.size());
+    }
+
+    void setVersion(const std::string& version, bool signedHeader = false)
+    {
+        auto& data = parts.back().data;
+        data.clear();
+        if (signedHeader)
+        {
+            data.resize(4096, 0);
+            data[0] = 0x17;
+            data[1] = 0x08;
+            data[2] = 0x20;
+            data[3] = 0x11;
+        }
+        data.insert(data.end(), version.begin(), version.end());
+        data.push_back('\0');
+    }
+
+    fs::path image;
+    std::vector<Part> parts;
+};
+
+TEST_F(FfsTest, parseEntries)
+{
+    writeImage();
+    Ffs ffs(image);
+
+    ASSERT_EQ(parts.size(), ffs.entries().size());
+    EXPECT_EQ(blockSize, ffs.blockSize());
+
+    auto guard = ffs.find("GUARD");
+    ASSERT_NE(nullptr, guard);
+    EXPECT_EQ(5 * blockSize, guard->offset);
+    EXPECT_EQ(2 * blockSize, guard->size);
+    EXPECT_EQ(FFS_TYPE_DATA, guard->type);
+    EXPECT_TRUE(guard->ecc());
+    EXPECT_TRUE(guard->preserved());
+    EXPECT_TRUE(guard->reprovision());
+    EXPECT_EQ("[E--P--F-C-]", guard->flags());
+
+    auto hbb = ffs.find("HBB");
+    ASSERT_NE(nullptr, hbb);
+    EXPECT_FALSE(hbb->reprovision());
+    EXPECT_EQ("[E---R-----]", hbb->flags());
+
+    EXPECT_EQ(nullptr, ffs.find("MISSING"));
+}
+
+TEST_F(FfsTest, partsToClear)
+{
+    writeImage();
+    Ffs ffs(image);
+
+    auto clear = utils::getPartsToClear(ffs);
+    ASSERT_EQ(3, clear.size());
+    EXPECT_EQ(PartClear("HBEL", true), clear[0]);
+    EXPECT_EQ(PartClear("GUARD", true), clear[1]);
+    EXPECT_EQ(PartClear("NVRAM", false), clear[2]);
+}
+
+TEST_F(FfsTest, readVersion)
+{
+    setVersion("open-power-v2.7\n\top-build-v2.7");
+    writeImage();
+    Ffs ffs(image);
+
+    EXPECT_EQ("open-power-v2.7\n\top-build-v2.7", utils::getPNORVersion(ffs));
+}
+
+TEST_F(FfsTest, readSignedVersion)
+{
+    setVersion("open-power-v2.7", true);
+    writeImage();
+    Ffs ffs(image);
+
+    EXPECT_EQ("open-power-v2.7", utils::getPNORVersion(ffs));
+}
+
+TEST_F(FfsTest, tocFingerprint)
+{
+    writeImage();
+    auto print = Ffs(image).tocFingerprint();
+    EXPECT_EQ(print, Ffs(image).tocFingerprint());
+
+    parts[3].miscFlags &= ~FFS_MISCFLAGS_REPROVISION;
+    writeImage();
+    EXPECT_NE(print, Ffs(image).tocFingerprint());
+}
+
+TEST_F(FfsTest, readCachedVersion)
+{
+    auto cache = image;
+    cache += ".version";
+
+    setVersion("open-power-v2.7", true);
+    writeImage();
+    {
+        Ffs ffs(image);
+        EXPECT_EQ("open-power-v2.7", utils::getPNORVersion(ffs, cache));
+        ASSERT_TRUE(fs::exists(cache));
+    }
+
+    // The cache is used as long as the fingerprint matches
+    std::string print;
+    {
+        std::ifstream file(cache);
+        std::getline(file, print);
+    }
+    {
+        std::ofstream file(cache);
+        file << print << "\ncached";
+    }
+    {
+        Ffs ffs(image);
+        EXPECT_EQ("cached", utils::getPNORVersion(ffs, cache));
+    }
+
+    // A new VERSION partition invalidates the cache
+    setVersion("open-power-v2.8", true);
+    parts.back().data[8] = 1;
+    writeImage();
+    {
+        Ffs ffs(image);
+        EXPECT_EQ("open-power-v2.8", utils::getPNORVersion(ffs, cache));
+        EXPECT_EQ("open-power-v2.8", utils::getPNORVersion(ffs, cache));
+    }
+    fs::remove(cache);
+}
+
+TEST_F(FfsTest, readEccPartition)
+{
+    // 8 data bytes followed by an ECC byte
+    std::vector<uint8_t> expected = {1, 2,  3,  4,  5,  6,  7,  8,
+                                     9, 10, 11, 12, 13, 14, 15, 16};
+    parts[1].data.resize(expected.size() / 8 * 9);
+    ecc::encode(expected.data(), expected.size(), parts[1].data.data());
+
+    // A single bit error is corrected
+    parts[1].data[3] ^= 0x10;
+    writeImage();
+    Ffs ffs(image);
+
+    EXPECT_EQ(expected, ffs.readPartition(*ffs.find("HBEL")));
+}
+
+TEST_F(FfsTest, readEccPartitionUncorrectable)
+{
+    std::vector<uint8_t> data(16, 0x5a);
+    parts[1].data.resize(data.size() / 8 * 9);
+    ecc::encode(data.data(), data.size(), parts[1].data.data());
+    parts[1].data[10] ^= 0x03;
+    writeImage();
+    Ffs ffs(image);
+
+    EXPECT_THROW(ffs.readPartition(*ffs.find("HBEL")), std::runtime_error);
+}
+
+TEST_F(FfsTest, badChecksum)
+{
+    writeImage();
+    {
+        // Corrupt the name of the second entry
+        std::fstream file(image,
+                          std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(FFS_HDR_SIZE + FFS_ENTRY_SIZE);
+        file.put('X');
+    }
+    EXPECT_THROW(Ffs ffs(image), std::runtime_error);
+}
+
+TEST_F(FfsTest, noHeader)
+{
+    std::ofstream file(image, std::ios::binary);
+    file << std::string(blockSize, '\xff');
+    file.close();
+
+    EXPECT_THROW(Ffs ffs(image), std::runtime_error);
+}
+
+TEST_F(FfsTest, missingFlash)
+{
+    EXPECT_THROW(Ffs ffs("/nonexistent/pnor"), std::system_error);
+}
+
+TEST_F(FfsTest, packagerToc)
+{
+    setVersion("open-power-v2.7\n\top-build-v2.7\n\tbuildroot-1", true);
+    parts.push_back({"BACKUP_PART", 33, 1, FFS_TYPE_PARTITION, 0,
+                     FFS_MISCFLAGS_BACKUP, {}});
+    writeImage();
+    Ffs ffs(image);
+
+    auto toc = makeToc(ffs);
+    EXPECT_EQ("open-power-v2.7", toc.version);
+    EXPECT_EQ("op-build-v2.7,buildroot-1", toc.extendedVersion);
+    EXPECT_EQ("version=open-power-v2.7\n"
+              "extended_version=op-build-v2.7,buildroot-1\n"
+              "partition00=part,0x00000000,0x00001000,00,READWRITE\n"
+              "partition01=HBEL,0x00001000,0x00005000,00,ECC,REPROVISION,"
+              "CLEARECC,READWRITE\n"
+              "partition02=GUARD,0x00005000,0x00007000,00,ECC,PRESERVED,"
+              "REPROVISION,CLEARECC\n"
+              "partition03=NVRAM,0x00007000,0x0000f000,00,PRESERVED,"
+              "REPROVISION\n"
+              "partition04=HBB,0x0000f000,0x0001f000,00,ECC,READONLY\n"
+              "partition05=VERSION,0x0001f000,0x00021000,00,READONLY\n",
+              toc.toc);
+    EXPECT_EQ(parts.size() - 1, toc.partitions.size());
+}
+
+TEST_F(FfsTest, packagerExtract)
+{
+    std::vector<uint8_t> expected(64, 0x5a);
+    parts[1].data.resize(expected.size() / 8 * 9);
+    ecc::encode(expected.data(), expected.size(), parts[1].data.data());
+    setVersion("open-power-v2.7");
+    writeImage();
+    Ffs ffs(image);
+
+    char tmpDir[] = "/tmp/ffs_extract.XXXXXX";
+    fs::path dir = mkdtemp(tmpDir);
+    // The erased ECC partitions of the image have no valid ECC
+    extractPartitions(ffs, {*ffs.find("HBEL"), *ffs.find("NVRAM"),
+                            *ffs.find("VERSION")},
+                      dir, 3);
+
+    EXPECT_EQ(3, std::distance(fs::directory_iterator(dir),
+                               fs::directory_iterator()));
+    std::ifstream hbel(dir / "HBEL", std::ios::binary);
+    std::vector<uint8_t> data{std::istreambuf_iterator<char>(hbel),
+                              std::istreambuf_iterator<char>()};
+    EXPECT_EQ(expected, data);
+    EXPECT_EQ(8 * blockSize, fs::file_size(dir / "NVRAM"));
+    fs::remove_all(dir);
+}
@@ -255,212 +255,277 @@ TEST(MaybeCall, emptyInterfacesEmptyCallback)
     EXPECT_FALSE(found);
 }
 
-TEST(WriteLink, testLinkNoDelete)
+TEST(WriteLinks, testNoLinks)
 {
     std::array<char, 15> tmpl{"/tmp/tmpXXXXXX"};
     std::filesystem::path workdir = mkdtemp(&tmpl[0]);
     bool called = false;
-    auto callback = [&called](const auto&, auto&) { called = true; };
-    std::filesystem::path linkPath = workdir / "link";
-    std::filesystem::path targetPath = workdir / "target";
-    std::ofstream link{linkPath};
-    functions::process_hostfirmware::writeLink(linkPath.filename(), targetPath,
-                                               callback);
+    auto errorCallback = [&called](const auto&, auto&) { called = true; };
+
+    std::vector<std::string> extensions;
+    auto stats = functions::process_hostfirmware::writeLinks(
+        workdir, extensions, errorCallback);
     std::filesystem::remove_all(workdir);
+    EXPECT_EQ(stats.created, 0);
+    EXPECT_EQ(stats.untouched, 0);
     EXPECT_FALSE(called);
 }
 
-TEST(WriteLink, testLinkDelete)
+TEST(WriteLinks, testNoExtensions)
 {
     std::array<char, 15> tmpl{"/tmp/tmpXXXXXX"};
     std::filesystem::path workdir = mkdtemp(&tmpl[0]);
     bool called = false;
-    auto callback = [&called](const auto&, auto&) { called = true; };
-    auto linkPath = workdir / "link";
-    auto targetPath = workdir / "target";
-    std::ofstream link{linkPath}, target{targetPath};
-    functions::process_hostfirmware::writeLink(linkPath.filename(), targetPath,
-                                               callback);
+    auto errorCallback = [&called](const auto&, auto&) { called = true; };
+
+    std::ofstream file{workdir / "foo.foo"};
+    std::vector<std::string> extensions;
+    auto stats = functions::process_hostfirmware::writeLinks(
+        workdir, extensions, errorCallback);
+    EXPECT_FALSE(std::filesystem::exists(workdir / "foo"));
     std::filesystem::remove_all(workdir);
+    EXPECT_EQ(stats.created, 0);
     EXPECT_FALSE(called);
 }
 
-TEST(WriteLink, testLinkFailDeleteDir)
+TEST(WriteLinks, testEmptyErrorCallback)
 {
     std::array<char, 15> tmpl{"/tmp/tmpXXXXXX"};
     std::filesystem::path workdir = mkdtemp(&tmpl[0]);
-    std::error_code ec;
-    std::filesystem::path callbackPath;
-    auto callback = [&ec, &callbackPath](const auto& p, auto& _ec) {
-        ec = _ec;
-        callbackPath = p;
-    };
-    auto targetPath = workdir / "target";
-    std::filesystem::create_directory(targetPath);
-    auto linkPath = workdir / "link";
-    auto filePath = targetPath / "file";
-    std::ofstream link{linkPath}, file{filePath};
-    functions::process_hostfirmware::writeLink(linkPath.filename(), targetPath,
-                                               callback);
+
+    std::vector<std::string> extensions{".foo"s};
+    auto dir = workdir / "baz";
+    functions::process_hostfirmware::LinkStats stats;
+    EXPECT_NO_THROW(
+        stats = functions::process_hostfirmware::writeLinks(
+            dir, extensions,
+            functions::process_hostfirmware::ErrorCallbackType()));
     std::filesystem::remove_all(workdir);
-    EXPECT_EQ(ec.value(), ENOTEMPTY);
-    EXPECT_EQ(callbackPath, targetPath);
+    EXPECT_EQ(stats.created, 0);
 }
 
-TEST(WriteLink, testLinkPathNotExist)
+TEST(WriteLinks, testLinksWritten)
 {
     std::array<char, 15> tmpl{"/tmp/tmpXXXXXX"};
     std::filesystem::path workdir = mkdtemp(&tmpl[0]);
-    std::error_code ec;
-    std::filesystem::path callbackPath;
-    auto callback = [&ec, &callbackPath](const auto& p, auto& _ec) {
-        ec = _ec;
-        callbackPath = p;
-    };
-    auto linkPath = workdir / "baz";
-    auto targetPath = workdir / "foo/bar/foo";
-    functions::process_hostfirmware::writeLink(linkPath.filename(), targetPath,
-                                               callback);
+    bool called = false;
+    auto errorCallback = [&called](const auto&, auto&) { called = true; };
+
+    std::ofstream toc{workdir / "81e00994.lid"}, foo{workdir / "foo.foo"},
+        bar{workdir / "bar.bar"}, hidden{workdir / ".foo"};
+    std::ofstream stale{workdir / "foo"};
+    std::vector<std::string> extensions{".foo"s};
+    auto stats = functions::process_hostfirmware::writeLinks(
+        workdir, extensions, errorCallback);
+
+    EXPECT_EQ(stats.created, 1);
+    EXPECT_EQ(stats.replaced, 1);
+    EXPECT_EQ(std::filesystem::read_symlink(workdir / "pnor.toc"),
+              "81e00994.lid");
+    EXPECT_EQ(std::filesystem::read_symlink(workdir / "foo"), "foo.foo");
+    EXPECT_FALSE(std::filesystem::exists(workdir / "bar"));
+    EXPECT_FALSE(std::filesystem::exists(workdir / ".foo.tmp"));
+
+    // Nothing is written once the links are in place
+    stats = functions::process_hostfirmware::writeLinks(workdir, extensions,
+                                                        errorCallback);
     std::filesystem::remove_all(workdir);
-    EXPECT_EQ(ec.value(), ENOENT);
-    EXPECT_EQ(callbackPath, targetPath);
+    EXPECT_EQ(stats.created, 0);
+    EXPECT_EQ(stats.replaced, 0);
+    EXPECT_EQ(stats.untouched, 2);
+    EXPECT_FALSE(called);
 }
 
-TEST(FindLinks, testNoLinks)
+TEST(WriteLinks, testEnoent)
 {
     std::array<char, 15> tmpl{"/tmp/tmpXXXXXX"};
     std::filesystem::path workdir = mkdtemp(&tmpl[0]);
-
-    bool callbackCalled = false, errorCallbackCalled = false;
-    auto callback = [&callbackCalled](const auto&, const auto&, const auto&) {
-        callbackCalled = true;
-    };
-    auto errorCallback = [&errorCallbackCalled](const auto&, auto&) {
-        errorCallbackCalled = true;
+    std::error_code ec;
+    std::filesystem::path callbackPath;
+    auto errorCallback = [&ec, &callbackPath](const auto& p, auto& _ec) {
+        ec = _ec;
+        callbackPath = p;
     };
 
-    std::vector<std::string> extensions;
-    functions::process_hostfirmware::findLinks(workdir, extensions,
-                                               errorCallback, callback);
+    std::vector<std::string> extensions{".foo"s};
+    auto dir = workdir / "baz";
+    auto stats = functions::process_hostfirmware::writeLinks(
+        dir, extensions, errorCallback);
     std::filesystem::remove_all(workdir);
-    EXPECT_FALSE(errorCallbackCalled);
-    EXPECT_FALSE(callbackCalled);
+    EXPECT_EQ(stats.created, 0);
+    EXPECT_EQ(ec.value(), ENOENT);
+    EXPECT_EQ(callbackPath, dir);
 }
 
-TEST(FindLinks, testOneFound)
+TEST(ReconcileLinks, testOnlyDifferenceApplied)
 {
     std::array<char, 15> tmpl{"/tmp/tmpXXXXXX"};
     std::filesystem::path workdir = mkdtemp(&tmpl[0]);
-    std::filesystem::path callbackPath, callbackLink;
-
-    bool errorCallbackCalled = false;
-    auto callback = [&callbackPath, &callbackLink](
-                        const auto& p1, const auto& p2, const auto&) {
-        callbackPath = p1;
-        callbackLink = p2;
-    };
-    auto errorCallback = [&errorCallbackCalled](const auto&, auto&) {
-        errorCallbackCalled = true;
-    };
+    bool called = false;
+    auto errorCallback = [&called](const auto&, auto&) { called = true; };
 
-    auto filePath = workdir / "foo.foo";
-    std::ofstream file{filePath};
-    std::vector<std::string> extensions{".foo"s};
-    functions::process_hostfirmware::findLinks(workdir, extensions,
-                                               errorCallback, callback);
+    std::filesystem::create_symlink("1.lid", workdir / "same");
+    std::filesystem::create_symlink("1.lid", workdir / "other");
+    std::ofstream file{workdir / "file"};
+    std::map<std::string, std::string> links{{"same", "1.lid"},
+                                             {"other", "2.lid"},
+                                             {"file", "3.lid"},
+                                             {"new", "4.lid"}};
+    auto stats = functions::process_hostfirmware::reconcileLinks(
+        workdir, links, false, errorCallback);
+
+    EXPECT_EQ(stats.created, 1);
+    EXPECT_EQ(stats.replaced, 1);
+    EXPECT_EQ(stats.untouched, 2);
+    EXPECT_EQ(std::filesystem::read_symlink(workdir / "other"), "2.lid");
+    EXPECT_EQ(std::filesystem::read_symlink(workdir / "new"), "4.lid");
+    EXPECT_FALSE(std::filesystem::is_symlink(workdir / "file"));
+
+    stats = functions::process_hostfirmware::reconcileLinks(
+        workdir, links, true, errorCallback);
     std::filesystem::remove_all(workdir);
-    EXPECT_FALSE(errorCallbackCalled);
-    EXPECT_EQ(callbackLink, workdir / "foo");
-    EXPECT_EQ(callbackPath, filePath.filename());
+    EXPECT_EQ(stats.replaced, 1);
+    EXPECT_EQ(stats.untouched, 3);
+    EXPECT_FALSE(called);
 }
 
-TEST(FindLinks, testNoExtensions)
+TEST(ReconcileLinks, testReplaceEmptyDir)
 {
     std::array<char, 15> tmpl{"/tmp/tmpXXXXXX"};
     std::filesystem::path workdir = mkdtemp(&tmpl[0]);
-    std::filesystem::path callbackPath, callbackLink;
-
-    bool errorCallbackCalled = false, callbackCalled = false;
-    auto callback = [&callbackCalled](const auto&, const auto&, const auto&) {
-        callbackCalled = true;
-    };
-    auto errorCallback = [&errorCallbackCalled](const auto&, auto&) {
-        errorCallbackCalled = true;
-    };
+    bool called = false;
+    auto errorCallback = [&called](const auto&, auto&) { called = true; };
 
-    auto filePath = workdir / "foo.foo";
-    std::ofstream file{filePath};
-    std::vector<std::string> extensions;
-    functions::process_hostfirmware::findLinks(workdir, extensions,
-                                               errorCallback, callback);
+    std::filesystem::create_directory(workdir / "link");
+    std::map<std::string, std::string> links{{"link", "target"}};
+    auto stats = functions::process_hostfirmware::reconcileLinks(
+        workdir, links, true, errorCallback);
+    EXPECT_EQ(std::filesystem::read_symlink(workdir / "link"), "target");
     std::filesystem::remove_all(workdir);
-    EXPECT_FALSE(errorCallbackCalled);
-    EXPECT_FALSE(callbackCalled);
+    EXPECT_EQ(stats.replaced, 1);
+    EXPECT_FALSE(called);
 }
 
-TEST(FindLinks, testEnoent)
+TEST(ReconcileLinks, testFailNonEmptyDir)
 {
     std::array<char, 15> tmpl{"/tmp/tmpXXXXXX"};
     std::filesystem::path workdir = mkdtemp(&tmpl[0]);
-
     std::error_code ec;
-    bool called = false;
     std::filesystem::path callbackPath;
-    auto callback = [&called](const auto&, const auto&, const auto&) {
-        called = true;
-    };
     auto errorCallback = [&ec, &callbackPath](const auto& p, auto& _ec) {
         ec = _ec;
         callbackPath = p;
     };
 
-    std::vector<std::string> extensions;
-    auto dir = workdir / "baz";
-    functions::process_hostfirmware::findLinks(dir, extensions, errorCallback,
-                                               callback);
+    std::filesystem::create_directory(workdir / "link");
+    std::ofstream file{workdir / "link" / "file"};
+    std::map<std::string, std::string> links{{"link", "target"}};
+    auto stats = functions::process_hostfirmware::reconcileLinks(
+        workdir, links, true, errorCallback);
+    EXPECT_FALSE(std::filesystem::is_symlink(workdir / ".link.tmp"));
     std::filesystem::remove_all(workdir);
-    EXPECT_EQ(ec.value(), ENOENT);
-    EXPECT_EQ(callbackPath, dir);
-    EXPECT_FALSE(called);
+    EXPECT_EQ(stats.replaced, 0);
+    EXPECT_EQ(ec.value(), ENOTEMPTY);
+    EXPECT_EQ(callbackPath, workdir / "link");
 }
 
-TEST(FindLinks, testEmptyCallback)
+TEST(ParseElements, testFilteredByExtension)
+{
+    auto elementsJson = R"({
+        "version": 1,
+        "lids": [
+            {"element_name": "A.P10", "short_lid_name": "81e00001",
+             "extra": {"element_name": "X.P10", "short_lid_name": "ignored"}},
+            {"element_name": "A.P10.iplTime", "short_lid_name": "81e00002"},
+            {"element_name": "B.P9", "short_lid_name": "81e00003"},
+            {"element_name": "B.P9.iplTime", "short_lid_name": "81e00004"},
+            {"element_name": "C", "short_lid_name": "81e00005"},
+            {"element_name": "D.iplTime", "short_lid_name": "81e00006"},
+            {"element_name": "E.P10"}
+        ]
+    })"s;
+    std::vector<std::string> extensions{".P10"s};
+    functions::process_hostfirmware::HostFirmwareElements elements;
+    EXPECT_TRUE(functions::process_hostfirmware::parseElements(
+        elementsJson, extensions, elements));
+
+    functions::process_hostfirmware::HostFirmwareElements expected{
+        {"A.P10"s, "81e00001"s},
+        {"A.P10.iplTime"s, "81e00002"s},
+        {"C"s, "81e00005"s},
+        {"D.iplTime"s, "81e00006"s}};
+    EXPECT_EQ(elements, expected);
+
+    EXPECT_FALSE(functions::process_hostfirmware::parseElements(
+        "{\"lids\": [", extensions, elements));
+}
+
+TEST(ReadElements, testCache)
 {
     std::array<char, 15> tmpl{"/tmp/tmpXXXXXX"};
     std::filesystem::path workdir = mkdtemp(&tmpl[0]);
-
-    bool called = false;
-    std::filesystem::path callbackPath;
-    auto errorCallback = [&called](const auto&, auto&) { called = true; };
-
-    auto filePath = workdir / "foo.foo";
-    std::ofstream file{filePath};
-
-    std::vector<std::string> extensions{".foo"s};
-    functions::process_hostfirmware::findLinks(
-        workdir, extensions, errorCallback,
-        functions::process_hostfirmware::LinkCallbackType());
+    auto jsonPath = workdir / "elements.json";
+    auto cachePath = workdir / "cache" / "elements.cache";
+    std::ofstream{jsonPath} << R"({"lids": [
+        {"element_name": "A.P10", "short_lid_name": "81e00001"},
+        {"element_name": "B.P11", "short_lid_name": "81e00002"}]})";
+
+    std::vector<std::string> p10{".P10"s};
+    std::vector<std::string> p11{".P11"s};
+    auto elements = functions::process_hostfirmware::readElements(
+        jsonPath, p10, cachePath);
+    ASSERT_TRUE(elements);
+    ASSERT_EQ(elements->size(), 1);
+    EXPECT_EQ((*elements)[0].second, "81e00001");
+    EXPECT_TRUE(std::filesystem::exists(cachePath));
+
+    // The cache is keyed by the extensions and the content of the json
+    EXPECT_EQ(functions::process_hostfirmware::readElements(jsonPath, p10,
+                                                            cachePath),
+              elements);
+    elements = functions::process_hostfirmware::readElements(jsonPath, p11,
+                                                             cachePath);
+    ASSERT_TRUE(elements);
+    EXPECT_EQ((*elements)[0].second, "81e00002");
+
+    auto mtime = std::filesystem::last_write_time(jsonPath);
+    std::ofstream{jsonPath} << R"({"lids": [
+        {"element_name": "A.P10", "short_lid_name": "81e00001"},
+        {"element_name": "B.P11", "short_lid_name": "81e00003"}]})";
+    std::filesystem::last_write_time(jsonPath, mtime);
+    elements = functions::process_hostfirmware::readElements(jsonPath, p11,
+                                                             cachePath);
     std::filesystem::remove_all(workdir);
-    EXPECT_FALSE(called);
-    EXPECT_NO_THROW();
+    ASSERT_TRUE(elements);
+    EXPECT_EQ((*elements)[0].second, "81e00003");
 }
 
-TEST(FindLinks, testEmptyErrorCallback)
+TEST(CompatibleNames, testRoundTrip)
 {
     std::array<char, 15> tmpl{"/tmp/tmpXXXXXX"};
     std::filesystem::path workdir = mkdtemp(&tmpl[0]);
+    auto cachePath = workdir / "run" / "compatible-names";
 
-    bool called = false;
-    auto callback = [&called](const auto&, const auto&, const auto&) {
-        called = true;
-    };
+    EXPECT_FALSE(functions::process_hostfirmware::loadCompatibleNames(
+        cachePath, ":1.42"));
+
+    std::vector<std::string> names{"foo"s, "bar"s};
+    functions::process_hostfirmware::saveCompatibleNames(cachePath, ":1.42",
+                                                         names);
+    EXPECT_EQ(functions::process_hostfirmware::loadCompatibleNames(
+                  cachePath, ":1.42"),
+              names);
+
+    // A restarted entity manager may publish other names
+    EXPECT_FALSE(functions::process_hostfirmware::loadCompatibleNames(
+        cachePath, ":1.43"));
+
+    functions::process_hostfirmware::saveCompatibleNames(cachePath, ":1.43",
+                                                         {});
+    auto empty = functions::process_hostfirmware::loadCompatibleNames(
+        cachePath, ":1.43");
+    ASSERT_TRUE(empty);
+    EXPECT_TRUE(empty->empty());
 
-    std::vector<std::string> extensions;
-    auto dir = workdir / "baz";
-    functions::process_hostfirmware::findLinks(
-        dir, extensions, functions::process_hostfirmware::ErrorCallbackType(),
-        callback);
     std::filesystem::remove_all(workdir);
-    EXPECT_FALSE(called);
-    EXPECT_NO_THROW();
 }
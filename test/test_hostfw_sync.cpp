@@ -0,0 +1,152 @@
+#include "mmc/hostfw_sync.hpp"
+#include "temp_dir.hpp"
+
+#include <sys/stat.h>
+
+#include <filesystem>
+#include <string>
+
+#include <gtest/gtest.h>
+
+using namespace openpower::software::updater;
+namespace fs = std::filesystem;
+
+class HostFirmwareSyncTest : public TempDirTest
+{
+  protected:
+    void SetUp() override
+    {
+        TempDirTest::SetUp();
+        ro = dir / "running-ro";
+        running = dir / "running";
+        fs::create_directories(ro);
+        fs::create_directories(running);
+
+        writeFile(ro / HOSTFW_TOC_LID,
+                  "partition01=HBB,0x00000000,0x00100000,00,ECC\n"
+                  "partition05=SECBOOT,0x00381000,0x003a5000,00,ECC,"
+                  "PRESERVED\n"
+                  "partition06=GUARD,0x003a5000,0x003aa000,00,ECC,PRESERVED,"
+                  "CLEARECC\n");
+        writeFile(ro / "81e00610.lid", "hbb");
+        writeFile(ro / "81e00630.lid", "secboot");
+        writeFile(ro / "81e00640.lid", "guard");
+    }
+
+    fs::path ro;
+    fs::path running;
+};
+
+TEST_F(HostFirmwareSyncTest, tocPartitions)
+{
+    auto names = tocPartitions(ro / HOSTFW_TOC_LID, "PRESERVED");
+    ASSERT_EQ(2, names.size());
+    EXPECT_EQ("SECBOOT", names[0]);
+    EXPECT_EQ("GUARD", names[1]);
+
+    EXPECT_TRUE(tocPartitions(ro / HOSTFW_TOC_LID, "READONLY").empty());
+    EXPECT_TRUE(tocPartitions(ro / "missing.lid", "PRESERVED").empty());
+}
+
+TEST_F(HostFirmwareSyncTest, sameContent)
+{
+    writeFile(dir / "a", "content");
+    writeFile(dir / "b", "content");
+    writeFile(dir / "c", "contenT");
+    writeFile(dir / "d", "content2");
+
+    EXPECT_TRUE(sameContent(dir / "a", dir / "b"));
+    EXPECT_FALSE(sameContent(dir / "a", dir / "c"));
+    EXPECT_FALSE(sameContent(dir / "a", dir / "d"));
+}
+
+TEST_F(HostFirmwareSyncTest, copiesAll)
+{
+    auto stats = syncHostFirmware(ro, running, 2);
+
+    EXPECT_EQ(4, stats.files);
+    EXPECT_EQ(4, stats.copied);
+    EXPECT_EQ(0, stats.unchanged);
+    for (const auto& lid : {"81e00610.lid", "81e00630.lid", "81e00640.lid"})
+    {
+        EXPECT_EQ(readFile(ro / lid), readFile(running / lid));
+    }
+}
+
+TEST_F(HostFirmwareSyncTest, copiesOnlyChangedLids)
+{
+    syncHostFirmware(ro, running);
+    struct stat before;
+    ASSERT_EQ(0, stat((running / "81e00610.lid").c_str(), &before));
+
+    writeFile(ro / "81e00630.lid", "SECBOOT");
+    writeFile(running / "partlabel", "a");
+    fs::create_symlink("81e00610.lid", running / "HBB");
+    fs::create_symlink("81e00690.lid", running / "OCC");
+
+    auto stats = syncHostFirmware(ro, running);
+    EXPECT_EQ(1, stats.copied);
+    EXPECT_EQ(3, stats.unchanged);
+    EXPECT_EQ(2, stats.removed);
+    EXPECT_EQ("SECBOOT", readFile(running / "81e00630.lid"));
+    EXPECT_FALSE(fs::exists(running / "partlabel"));
+    EXPECT_FALSE(fs::is_symlink(running / "OCC"));
+
+    // The link to a lid of the new set is kept
+    ASSERT_TRUE(fs::is_symlink(running / "HBB"));
+    EXPECT_EQ("81e00610.lid", fs::read_symlink(running / "HBB"));
+
+    // The unchanged lid is the same file
+    struct stat after;
+    ASSERT_EQ(0, stat((running / "81e00610.lid").c_str(), &after));
+    EXPECT_EQ(before.st_ino, after.st_ino);
+}
+
+TEST_F(HostFirmwareSyncTest, keepsPreservedLids)
+{
+    syncHostFirmware(ro, running);
+    writeFile(running / "81e00630.lid", "SECBOOX");
+    writeFile(running / "81e00640.lid", "guard records");
+    fs::create_symlink("81e00630.lid", running / "SECBOOT");
+    fs::create_symlink("81e00640.lid", running / "GUARD");
+
+    auto stats = syncHostFirmware(ro, running);
+    EXPECT_EQ(1, stats.preserved);
+    EXPECT_EQ("SECBOOX", readFile(running / "81e00630.lid"));
+
+    // The size of the GUARD lid changed, it is replaced and reported
+    ASSERT_EQ(1, stats.mismatches.size());
+    EXPECT_EQ("81e00640.lid", stats.mismatches[0].file);
+    EXPECT_EQ(13, stats.mismatches[0].current);
+    EXPECT_EQ(5, stats.mismatches[0].expected);
+    EXPECT_EQ("guard", readFile(running / "81e00640.lid"));
+
+    // A sync run again, as when the label was not saved, finds the
+    // preserved lids through the links carried over
+    writeFile(running / "81e00640.lid", "GUARD");
+    stats = syncHostFirmware(ro, running);
+    EXPECT_EQ(2, stats.preserved);
+    EXPECT_EQ("SECBOOX", readFile(running / "81e00630.lid"));
+    EXPECT_EQ("GUARD", readFile(running / "81e00640.lid"));
+}
+
+TEST_F(HostFirmwareSyncTest, swapsInStagedSet)
+{
+    syncHostFirmware(ro, running);
+    writeFile(running / ".hidden", "kept");
+    fs::create_directories(running / "subdir");
+    writeFile(running / "subdir" / "file", "kept");
+
+    // A set left over by an interrupted sync is started over
+    auto staging = dir / ".running.staging";
+    fs::create_directories(staging);
+    writeFile(staging / "81e00610.lid", "partial");
+
+    writeFile(ro / "81e00610.lid", "HBB");
+    auto stats = syncHostFirmware(ro, running);
+    EXPECT_EQ(1, stats.copied);
+    EXPECT_EQ("HBB", readFile(running / "81e00610.lid"));
+    EXPECT_EQ("kept", readFile(running / ".hidden"));
+    EXPECT_EQ("kept", readFile(running / "subdir" / "file"));
+    EXPECT_FALSE(fs::exists(staging));
+}
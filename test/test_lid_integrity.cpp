@@ -0,0 +1,146 @@
+#include "mmc/hostfw_sync.hpp"
+#include "mmc/lid_integrity.hpp"
+#include "temp_dir.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+#include <gtest/gtest.h>
+
+using namespace openpower::software::updater;
+namespace fs = std::filesystem;
+
+class LidIntegrityTest : public TempDirTest
+{
+  protected:
+    void SetUp() override
+    {
+        TempDirTest::SetUp();
+        ro = dir / "ro";
+        running = dir / "running";
+        fs::create_directories(ro);
+
+        writeFile(ro / HOSTFW_TOC_LID,
+                  "partition01=HBB,0x00000000,0x00100000,00,ECC,READONLY\n"
+                  "partition02=GUARD,0x00100000,0x00105000,00,ECC,"
+                  "PRESERVED\n"
+                  "partition03=HBEL,0x00105000,0x00125000,00,ECC\n");
+        writeFile(ro / "81e00610.lid", "hostboot-base");
+        writeFile(ro / "81e00640.lid", "guard");
+        writeFile(ro / "81e00650.lid", "hbel");
+        fs::create_symlink("81e00610.lid", ro / "HBB");
+        fs::create_symlink("81e00640.lid", ro / "GUARD");
+
+        syncHostFirmware(ro, running, 2);
+        // setup-host-firmware creates the links of the running directory
+        fs::create_symlink("81e00610.lid", running / "HBB");
+        fs::create_symlink("81e00640.lid", running / "GUARD");
+    }
+
+    fs::path ro;
+    fs::path running;
+};
+
+TEST_F(LidIntegrityTest, syncRecordsWrittenLids)
+{
+    // The READONLY lid and the preserved lid, not the writable one
+    auto index = loadIntegrityIndex(running / INTEGRITY_INDEX_FILE);
+    ASSERT_EQ(2, index.size());
+    EXPECT_EQ(measureLid(ro / "81e00610.lid"), index["81e00610.lid"]);
+    EXPECT_EQ(13, index["81e00610.lid"].size);
+    EXPECT_EQ(lidModificationTime(running / "81e00610.lid"),
+              index["81e00610.lid"].mtime);
+    EXPECT_EQ(measureLid(ro / "81e00640.lid"), index["81e00640.lid"]);
+
+    saveIntegrityIndex(dir / "index", index);
+    auto loaded = loadIntegrityIndex(dir / "index");
+    EXPECT_EQ(index, loaded);
+    EXPECT_EQ(index["81e00610.lid"].mtime, loaded["81e00610.lid"].mtime);
+    saveIntegrityIndex(dir / "index", {});
+    EXPECT_FALSE(fs::exists(dir / "index"));
+    EXPECT_TRUE(loadIntegrityIndex(dir / "index").empty());
+}
+
+TEST_F(LidIntegrityTest, intactLidsAreLeftAlone)
+{
+    // The host rewrites the preserved lids, only their size is checked
+    writeFile(running / "81e00640.lid", "GUARD");
+
+    auto stats = recoverLids(ro, running, 2);
+    EXPECT_EQ(1, stats.sizeChecked);
+    EXPECT_EQ(1, stats.digestChecked);
+    EXPECT_TRUE(stats.mismatches.empty());
+    EXPECT_EQ("GUARD", readFile(running / "81e00640.lid"));
+}
+
+TEST_F(LidIntegrityTest, sameSizeCorruptionIsRestored)
+{
+    writeFile(running / "81e00610.lid", "hostboot-bad!");
+
+    auto stats = recoverLids(ro, running, 2);
+    ASSERT_EQ(1, stats.mismatches.size());
+    EXPECT_EQ("81e00610.lid", stats.mismatches[0].lid);
+    EXPECT_EQ("digest", stats.mismatches[0].reason);
+    EXPECT_TRUE(stats.mismatches[0].restored);
+    EXPECT_EQ("hostboot-base", readFile(running / "81e00610.lid"));
+}
+
+TEST_F(LidIntegrityTest, preservedSizeMismatchIsRestored)
+{
+    writeFile(running / "81e00640.lid", "guard-grown");
+
+    auto stats = recoverLids(ro, running, 2);
+    ASSERT_EQ(1, stats.mismatches.size());
+    EXPECT_EQ("size", stats.mismatches[0].reason);
+    EXPECT_EQ(11, stats.mismatches[0].current);
+    EXPECT_EQ(5, stats.mismatches[0].expected);
+    EXPECT_EQ("guard", readFile(running / "81e00640.lid"));
+}
+
+TEST_F(LidIntegrityTest, lidsAreReadOnceAfterSync)
+{
+    auto stats = recoverLids(ro, running, 2);
+    EXPECT_EQ(2, stats.digestChecked);
+    EXPECT_TRUE(fs::exists(running / INTEGRITY_VERIFIED_FILE));
+
+    // Unmodified lids are then only checked by size and modification time
+    stats = recoverLids(ro, running, 2);
+    EXPECT_EQ(2, stats.sizeChecked);
+    EXPECT_EQ(0, stats.digestChecked);
+
+    // A modified READONLY lid is measured again
+    auto hbb = running / "81e00610.lid";
+    writeFile(hbb, "hostboot-bad!");
+    fs::last_write_time(hbb,
+                        fs::last_write_time(hbb) + std::chrono::seconds(1));
+    stats = recoverLids(ro, running, 2);
+    EXPECT_EQ(1, stats.digestChecked);
+    ASSERT_EQ(1, stats.mismatches.size());
+    EXPECT_EQ("digest", stats.mismatches[0].reason);
+    EXPECT_EQ("hostboot-base", readFile(hbb));
+
+    // The index follows the restored lid
+    stats = recoverLids(ro, running, 2);
+    EXPECT_EQ(0, stats.digestChecked);
+    EXPECT_TRUE(stats.mismatches.empty());
+
+    // A sync starts over
+    syncHostFirmware(ro, running, 2);
+    EXPECT_FALSE(fs::exists(running / INTEGRITY_VERIFIED_FILE));
+}
+
+TEST_F(LidIntegrityTest, preservedCorruptionIsRestoredAfterSync)
+{
+    // Damage that keeps the size and the modification time
+    auto guard = running / "81e00640.lid";
+    auto mtime = fs::last_write_time(guard);
+    writeFile(guard, "gu@rd");
+    fs::last_write_time(guard, mtime);
+
+    auto stats = recoverLids(ro, running, 2);
+    ASSERT_EQ(1, stats.mismatches.size());
+    EXPECT_EQ("81e00640.lid", stats.mismatches[0].lid);
+    EXPECT_EQ("digest", stats.mismatches[0].reason);
+    EXPECT_EQ("guard", readFile(guard));
+}
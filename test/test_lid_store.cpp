@@ -0,0 +1,136 @@
+#include "mmc/hostfw_sync.hpp"
+#include "mmc/lid_store.hpp"
+#include "temp_dir.hpp"
+
+#include <sys/stat.h>
+
+#include <filesystem>
+#include <map>
+#include <string>
+
+#include <gtest/gtest.h>
+
+using namespace openpower::software::updater;
+namespace fs = std::filesystem;
+
+class LidStoreTest : public TempDirTest
+{
+  protected:
+    void SetUp() override
+    {
+        TempDirTest::SetUp();
+        fs::create_directories(dir / "a");
+        fs::create_directories(dir / "b");
+        fs::create_directories(dir / "running");
+    }
+
+    /** @brief Writes an image with a READONLY HBB, a preserved GUARD and a
+     *         writable HBEL partition.
+     */
+    void writeImage(const fs::path& image, const std::string& hbb)
+    {
+        writeFile(image / HOSTFW_TOC_LID,
+                  "partition01=HBB,0x00000000,0x00100000,00,ECC,READONLY\n"
+                  "partition02=GUARD,0x00100000,0x00105000,00,ECC,"
+                  "PRESERVED\n"
+                  "partition03=HBEL,0x00105000,0x00125000,00,ECC\n");
+        writeFile(image / "81e00610.lid", hbb);
+        writeFile(image / "81e00640.lid", "guard");
+        writeFile(image / "81e00650.lid", "hbel");
+        fs::create_symlink("81e00610.lid", image / "HBB");
+    }
+
+    size_t countBlobs()
+    {
+        return std::distance(fs::directory_iterator(dir / "store" / "blobs"),
+                             fs::directory_iterator{});
+    }
+
+    static ino_t inode(const fs::path& path)
+    {
+        struct stat st;
+        EXPECT_EQ(0, stat(path.c_str(), &st));
+        return st.st_ino;
+    }
+
+};
+
+TEST_F(LidStoreTest, storeDeduplicates)
+{
+    writeFile(dir / "a" / "1.lid", "same");
+    writeFile(dir / "b" / "1.lid", "same");
+    LidStore store(dir / "store", "a", "stamp");
+
+    uintmax_t written = 0;
+    auto blob = store.store(dir / "a" / "1.lid", written);
+    EXPECT_EQ(4, written);
+    EXPECT_EQ(blob, store.store(dir / "b" / "1.lid", written));
+    EXPECT_EQ(0, written);
+    EXPECT_EQ(1, countBlobs());
+
+    EXPECT_TRUE(LidStore::link(blob, dir / "running" / "1.lid"));
+    EXPECT_FALSE(LidStore::link(blob, dir / "running" / "1.lid"));
+    EXPECT_EQ(inode(blob), inode(dir / "running" / "1.lid"));
+
+    // Nothing links to the blob once the running lid is gone
+    EXPECT_EQ(0, store.collectGarbage());
+    fs::remove(dir / "running" / "1.lid");
+    EXPECT_EQ(1, store.collectGarbage());
+    EXPECT_EQ(0, countBlobs());
+}
+
+TEST_F(LidStoreTest, publishedSetIsFoundWithItsStamp)
+{
+    writeFile(dir / "a" / "1.lid", "one");
+    {
+        LidStore store(dir / "store", "a", "stamp1");
+        EXPECT_TRUE(store.find("1.lid").empty());
+        uintmax_t written = 0;
+        store.publish({{"1.lid", store.store(dir / "a" / "1.lid", written)}});
+        EXPECT_FALSE(store.find("1.lid").empty());
+        EXPECT_EQ(0, store.collectGarbage());
+    }
+
+    EXPECT_FALSE(LidStore(dir / "store", "a", "stamp1").find("1.lid").empty());
+    EXPECT_TRUE(LidStore(dir / "store", "a", "stamp2").find("1.lid").empty());
+    EXPECT_TRUE(LidStore(dir / "store", "b", "stamp1").find("1.lid").empty());
+    EXPECT_THROW(LidStore(dir / "store", "../a", "stamp1"),
+                 std::invalid_argument);
+}
+
+TEST_F(LidStoreTest, syncLinksReadOnlyLids)
+{
+    writeImage(dir / "a", "hbb-a");
+    writeImage(dir / "b", "hbb-b");
+    auto running = dir / "running";
+
+    {
+        LidStore store(dir / "store", "a", "a1");
+        auto stats = syncHostFirmware(dir / "a", running, 2, &store);
+        EXPECT_EQ(1, stats.linked);
+        EXPECT_EQ(3, stats.copied);
+    }
+    EXPECT_EQ("hbb-a", readFile(running / "81e00610.lid"));
+    EXPECT_EQ(3, fs::hard_link_count(running / "81e00610.lid"));
+    EXPECT_EQ(1, fs::hard_link_count(running / "81e00650.lid"));
+
+    // Switching sides keeps the blobs of both images
+    {
+        LidStore store(dir / "store", "b", "b1");
+        auto stats = syncHostFirmware(dir / "b", running, 2, &store);
+        EXPECT_EQ(1, stats.linked);
+    }
+    EXPECT_EQ("hbb-b", readFile(running / "81e00610.lid"));
+    EXPECT_EQ(2, countBlobs());
+
+    // Switching back relinks the lid of the published set, which is trusted
+    // as long as the stamp matches: the image lid is not read.
+    writeFile(dir / "a" / "81e00610.lid", "unread");
+    {
+        LidStore store(dir / "store", "a", "a1");
+        auto stats = syncHostFirmware(dir / "a", running, 2, &store);
+        EXPECT_EQ(1, stats.linked);
+        EXPECT_EQ(0, stats.bytesWritten);
+    }
+    EXPECT_EQ("hbb-a", readFile(running / "81e00610.lid"));
+}
@@ -0,0 +1,121 @@
+#include "temp_dir.hpp"
+#include "ubi/partition_store.hpp"
+
+#include <filesystem>
+#include <string>
+
+#include <gtest/gtest.h>
+
+using namespace openpower::software::updater;
+namespace fs = std::filesystem;
+
+class PartitionStoreTest : public TempDirTest
+{
+  protected:
+    void SetUp() override
+    {
+        TempDirTest::SetUp();
+        fs::create_directories(dir / "v1");
+        fs::create_directories(dir / "v2");
+    }
+
+    size_t countBlobs()
+    {
+        return std::distance(fs::directory_iterator(dir / "store" / "blobs"),
+                             fs::directory_iterator{});
+    }
+
+};
+
+TEST_F(PartitionStoreTest, digest)
+{
+    writeFile(dir / "file", "abc");
+    EXPECT_EQ(
+        PartitionStore::digest(dir / "file"),
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+}
+
+TEST_F(PartitionStoreTest, importSharesUnchangedPartitions)
+{
+    writeFile(dir / "v1" / "pnor.toc", "version=1");
+    writeFile(dir / "v1" / "HBB", "hostboot base");
+    writeFile(dir / "v1" / "HBI", "hostboot extended");
+    writeFile(dir / "v2" / "pnor.toc", "version=2");
+    writeFile(dir / "v2" / "HBB", "hostboot base");
+    writeFile(dir / "v2" / "HBI", "hostboot extended");
+
+    PartitionStore store(dir / "store");
+    auto stats = store.importVersion("11111111", dir / "v1");
+    EXPECT_EQ(stats.files, 3);
+    EXPECT_EQ(stats.newBlobs, 3);
+    EXPECT_EQ(stats.bytesShared, 0);
+
+    stats = store.importVersion("22222222", dir / "v2");
+    EXPECT_EQ(stats.files, 3);
+    EXPECT_EQ(stats.newBlobs, 1);
+    EXPECT_EQ(stats.bytesWritten, 9);
+    EXPECT_EQ(stats.bytesShared, 30);
+    EXPECT_EQ(countBlobs(), 4);
+
+    auto v2 = store.versionPath("22222222");
+    EXPECT_EQ(readFile(v2 / "pnor.toc"), "version=2");
+    EXPECT_EQ(readFile(v2 / "HBI"), "hostboot extended");
+    EXPECT_TRUE(fs::equivalent(v2 / "HBB", store.versionPath("11111111") /
+                                               "HBB"));
+    EXPECT_EQ(fs::hard_link_count(v2 / "HBB"), 3);
+}
+
+TEST_F(PartitionStoreTest, removeDropsUnreferencedBlobs)
+{
+    writeFile(dir / "v1" / "pnor.toc", "version=1");
+    writeFile(dir / "v1" / "HBB", "hostboot base");
+    writeFile(dir / "v2" / "pnor.toc", "version=2");
+    writeFile(dir / "v2" / "HBB", "hostboot base");
+
+    PartitionStore store(dir / "store");
+    store.importVersion("11111111", dir / "v1");
+    store.importVersion("22222222", dir / "v2");
+    EXPECT_EQ(countBlobs(), 3);
+
+    store.removeVersion("11111111");
+    EXPECT_FALSE(fs::exists(store.versionPath("11111111")));
+    EXPECT_EQ(countBlobs(), 2);
+    EXPECT_EQ(readFile(store.versionPath("22222222") / "HBB"),
+              "hostboot base");
+    EXPECT_EQ(fs::hard_link_count(store.versionPath("22222222") / "HBB"), 2);
+}
+
+TEST_F(PartitionStoreTest, reimportReplacesIndex)
+{
+    writeFile(dir / "v1" / "pnor.toc", "version=1");
+    writeFile(dir / "v1" / "HBB", "hostboot base");
+
+    PartitionStore store(dir / "store");
+    store.importVersion("11111111", dir / "v1");
+    writeFile(dir / "v1" / "HBB", "hostboot fixed");
+    store.importVersion("11111111", dir / "v1");
+    store.collectGarbage();
+
+    EXPECT_EQ(readFile(store.versionPath("11111111") / "HBB"),
+              "hostboot fixed");
+    EXPECT_EQ(countBlobs(), 2);
+}
+
+TEST_F(PartitionStoreTest, garbageCollectsInterruptedImports)
+{
+    PartitionStore store(dir / "store");
+    fs::create_directories(dir / "store" / "versions" / ".11111111");
+    writeFile(dir / "store" / "blobs" / ".0123", "partial");
+
+    EXPECT_EQ(store.collectGarbage(), 1);
+    EXPECT_FALSE(fs::exists(dir / "store" / "versions" / ".11111111"));
+    EXPECT_EQ(countBlobs(), 0);
+}
+
+TEST_F(PartitionStoreTest, invalidVersionId)
+{
+    PartitionStore store(dir / "store");
+    EXPECT_THROW(store.versionPath("../etc"), std::invalid_argument);
+    EXPECT_THROW(store.versionPath(".11111111"), std::invalid_argument);
+    EXPECT_THROW(store.versionPath(""), std::invalid_argument);
+}
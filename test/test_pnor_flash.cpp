@@ -0,0 +1,198 @@
+#include "static/pnor_flash.hpp"
+#include "temp_dir.hpp"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace openpower::software::updater;
+namespace fs = std::filesystem;
+
+class PnorFlashTest : public TempDirTest
+{
+  protected:
+    static constexpr size_t blocks = 8;
+    static constexpr size_t flashSize = blocks * FLASH_FILE_ERASE_SIZE;
+
+    void SetUp() override
+    {
+        TempDirTest::SetUp();
+        flash = dir / "flash";
+        image = dir / "image.pnor";
+    }
+
+    /** @brief Returns content where each block is filled with its index */
+    static std::vector<uint8_t> pattern(size_t size)
+    {
+        std::vector<uint8_t> content(size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            content[i] = i / FLASH_FILE_ERASE_SIZE;
+        }
+        return content;
+    }
+
+    fs::path flash;
+    fs::path image;
+};
+
+TEST_F(PnorFlashTest, blankFlash)
+{
+    writeFile(flash, std::vector<uint8_t>(flashSize, 0xff));
+    auto content = pattern(flashSize);
+    writeFile(image, content);
+
+    FlashDevice device(flash);
+    auto stats = flashImage(image, device);
+
+    EXPECT_EQ(blocks, stats.blocks);
+    EXPECT_EQ(0, stats.skipped);
+    EXPECT_EQ(0, stats.erased);
+    EXPECT_EQ(blocks, stats.programmed);
+    EXPECT_EQ(content, readBytes(flash));
+}
+
+TEST_F(PnorFlashTest, onlyChangedBlocks)
+{
+    auto content = pattern(flashSize);
+    writeFile(flash, content);
+
+    // Change one byte of the third block, and blank the last one
+    content[2 * FLASH_FILE_ERASE_SIZE + 10] = 0x42;
+    std::fill(content.end() - FLASH_FILE_ERASE_SIZE, content.end(), 0xff);
+    writeFile(image, content);
+
+    FlashDevice device(flash);
+    auto stats = flashImage(image, device);
+
+    EXPECT_EQ(blocks - 2, stats.skipped);
+    EXPECT_EQ(2, stats.erased);
+    EXPECT_EQ(1, stats.programmed);
+    EXPECT_EQ(content, readBytes(flash));
+}
+
+TEST_F(PnorFlashTest, shortImageErasesTail)
+{
+    writeFile(flash, pattern(flashSize));
+    auto content = pattern(flashSize);
+    content.resize(2 * FLASH_FILE_ERASE_SIZE + 100);
+    writeFile(image, content);
+
+    FlashDevice device(flash);
+    auto stats = flashImage(image, device);
+
+    EXPECT_EQ(2, stats.skipped);
+    EXPECT_EQ(blocks - 2, stats.erased);
+    EXPECT_EQ(1, stats.programmed);
+
+    content.resize(flashSize, 0xff);
+    EXPECT_EQ(content, readBytes(flash));
+}
+
+TEST_F(PnorFlashTest, imageTooLarge)
+{
+    writeFile(flash, std::vector<uint8_t>(flashSize, 0xff));
+    writeFile(image, pattern(flashSize + 1));
+
+    FlashDevice device(flash);
+    EXPECT_THROW(flashImage(image, device), std::runtime_error);
+}
+
+TEST_F(PnorFlashTest, saveAndLoadStats)
+{
+    FlashStats stats;
+    stats.blocks = 1024;
+    stats.skipped = 1000;
+    stats.erased = 20;
+    stats.programmed = 24;
+    stats.eraseSize = FLASH_FILE_ERASE_SIZE;
+    stats.imageSize = 64 * 1024 * 1024;
+
+    auto file = dir / "stats";
+    saveFlashStats(file, stats);
+
+    FlashStats loaded;
+    ASSERT_TRUE(loadFlashStats(file, loaded));
+    EXPECT_EQ(stats.blocks, loaded.blocks);
+    EXPECT_EQ(stats.skipped, loaded.skipped);
+    EXPECT_EQ(stats.erased, loaded.erased);
+    EXPECT_EQ(stats.programmed, loaded.programmed);
+    EXPECT_EQ(stats.eraseSize, loaded.eraseSize);
+    EXPECT_EQ(stats.imageSize, loaded.imageSize);
+
+    EXPECT_FALSE(loadFlashStats(dir / "missing", loaded));
+}
+
+TEST_F(PnorFlashTest, clearRangesMergesAdjacent)
+{
+    auto content = pattern(flashSize);
+    writeFile(flash, content);
+
+    // Two adjacent ranges starting mid-block, then an ECC range
+    constexpr auto block = FLASH_FILE_ERASE_SIZE;
+    std::vector<ClearRange> ranges = {
+        {5 * block, block, true},
+        {block + 0x1000, 0x2000, false},
+        {block + 0x3000, block - 0x3000, false},
+    };
+
+    FlashDevice device(flash);
+    auto stats = clearRanges(device, ranges);
+
+    EXPECT_EQ(2, stats.erases);
+    EXPECT_EQ(2 * block, stats.erased);
+    EXPECT_EQ(0x1000, stats.read);
+    EXPECT_EQ(0x1000 + block, stats.written);
+
+    std::fill(content.begin() + block + 0x1000, content.begin() + 2 * block,
+              0xff);
+    // The ECC range is erased data, each ninth byte its ECC byte
+    for (size_t i = 0; i < block; ++i)
+    {
+        content[5 * block + i] = i % 9 == 8 ? 0x00 : 0xff;
+    }
+    EXPECT_EQ(content, readBytes(flash));
+}
+
+TEST_F(PnorFlashTest, clearRangesOutOfFlash)
+{
+    writeFile(flash, pattern(flashSize));
+
+    FlashDevice device(flash);
+    EXPECT_THROW(clearRanges(device, {{flashSize - 0x1000, 0x2000, false}}),
+                 std::runtime_error);
+}
+
+TEST_F(PnorFlashTest, verifyMatchingFlash)
+{
+    auto content = pattern(flashSize - 100);
+    writeFile(image, content);
+    content.resize(flashSize, 0xff);
+    writeFile(flash, content);
+
+    FlashDevice device(flash);
+    auto stats = verifyImage(image, device);
+
+    EXPECT_TRUE(stats.complete);
+    EXPECT_FALSE(stats.mismatch);
+    EXPECT_EQ(flashSize, stats.verified);
+}
+
+TEST_F(PnorFlashTest, verifyReportsFirstMismatch)
+{
+    auto content = pattern(flashSize);
+    writeFile(image, content);
+    content[5 * FLASH_FILE_ERASE_SIZE + 7] ^= 0x01;
+    content[6 * FLASH_FILE_ERASE_SIZE] ^= 0x01;
+    writeFile(flash, content);
+
+    FlashDevice device(flash);
+    auto stats = verifyImage(image, device);
+
+    EXPECT_FALSE(stats.complete);
+    ASSERT_TRUE(stats.mismatch);
+    EXPECT_EQ(5 * FLASH_FILE_ERASE_SIZE, *stats.mismatch);
+    EXPECT_EQ(5 * FLASH_FILE_ERASE_SIZE, stats.verified);
+}
@@ -0,0 +1,98 @@
+#include "tar_writer.hpp"
+#include "temp_dir.hpp"
+
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+#include <gtest/gtest.h>
+
+using namespace openpower::software::updater;
+namespace fs = std::filesystem;
+
+class TarWriterTest : public TempDirTest
+{};
+
+TEST_F(TarWriterTest, writesUstarEntries)
+{
+    auto file = dir / "image";
+    std::ofstream(file, std::ios::binary) << std::string(600, 'x');
+
+    std::string observed;
+    auto observer = [&observed](const uint8_t* data, size_t size) {
+        observed.append(reinterpret_cast<const char*>(data), size);
+    };
+    {
+        TarWriter tar(dir / "out.tar", false, 1700000000);
+        tar.add("MANIFEST", std::string_view("version=1\n"), observer);
+        tar.add("image", file, observer);
+        tar.close();
+    }
+    EXPECT_EQ("version=1\n" + std::string(600, 'x'), observed);
+    EXPECT_FALSE(fs::exists(dir / "out.tar.tmp"));
+
+    // Two headers, the data padded to whole blocks and the two end blocks
+    auto tar = readFile(dir / "out.tar");
+    ASSERT_EQ(512 * (1 + 1 + 1 + 2 + 2), tar.size());
+    EXPECT_EQ("MANIFEST", std::string(tar.c_str()));
+    EXPECT_EQ("00000000012", tar.substr(124, 11));
+    EXPECT_EQ("14524770400", tar.substr(136, 11));
+    EXPECT_EQ(std::string("ustar\0" "00", 8), tar.substr(257, 8));
+    EXPECT_EQ("version=1\n", tar.substr(512, 10));
+    EXPECT_EQ("image", std::string(tar.c_str() + 1024));
+    EXPECT_EQ("00000001130", tar.substr(1024 + 124, 11));
+
+    unsigned checksum = 0;
+    for (size_t i = 0; i < 512; ++i)
+    {
+        checksum += i >= 148 && i < 156 ? ' ' : uint8_t(tar[i]);
+    }
+    EXPECT_EQ(checksum, std::strtoul(tar.substr(148, 7).c_str(), nullptr, 8));
+}
+
+TEST_F(TarWriterTest, longNameUsesGnuLongname)
+{
+    std::string name(120, 'n');
+    {
+        TarWriter tar(dir / "out.tar", false, 0);
+        tar.add(name, std::string_view("data"));
+        tar.close();
+    }
+
+    // The longname header and its data, then the entry header and data
+    auto tar = readFile(dir / "out.tar");
+    ASSERT_EQ(512 * (2 + 2 + 2), tar.size());
+    EXPECT_EQ("././@LongLink", std::string(tar.c_str()));
+    EXPECT_EQ('L', tar[156]);
+    EXPECT_EQ("00000000171", tar.substr(124, 11));
+    EXPECT_EQ(name, std::string(tar.c_str() + 512));
+    EXPECT_EQ(name.substr(0, 100), tar.substr(1024, 100));
+    EXPECT_EQ('0', tar[1024 + 156]);
+    EXPECT_EQ("data", tar.substr(1536, 4));
+}
+
+TEST_F(TarWriterTest, gzipIsReproducible)
+{
+    for (auto name : {"first.tar.gz", "second.tar.gz"})
+    {
+        TarWriter tar(dir / name, true, 0);
+        tar.add("data", std::string_view(std::string(100000, 'a')));
+        tar.close();
+    }
+    auto first = readFile(dir / "first.tar.gz");
+    ASSERT_GT(first.size(), 2);
+    EXPECT_EQ('\x1f', first[0]);
+    EXPECT_EQ('\x8b', first[1]);
+    EXPECT_LT(first.size(), 100000);
+    EXPECT_EQ(first, readFile(dir / "second.tar.gz"));
+}
+
+TEST_F(TarWriterTest, unclosedArchiveIsRemoved)
+{
+    {
+        TarWriter tar(dir / "out.tar", false, 0);
+        tar.add("data", std::string_view("data"));
+    }
+    EXPECT_FALSE(fs::exists(dir / "out.tar"));
+    EXPECT_FALSE(fs::exists(dir / "out.tar.tmp"));
+}
@@ -1,7 +1,10 @@
 #include "activation_ubi.hpp"
 
-#include "item_updater.hpp"
-#include "serialize.hpp"
+#include "flash_io.hpp"
+#include "item_updater_ubi.hpp"
+#include "partition_store.hpp"
+
+#include <sys/statvfs.h>
 
 #include <phosphor-logging/log.hpp>
 
@@ -16,9 +19,29 @@ namespace updater
 namespace softwareServer = sdbusplus::xyz::openbmc_project::Software::server;
 using namespace phosphor::logging;
 
+namespace
+{
+
+/** @brief Returns the bytes used on the filesystem holding a path, 0 if the
+ *         path does not exist. */
+uint64_t usedBytes(const char* path)
+{
+    struct statvfs st;
+    if (statvfs(path, &st) != 0)
+    {
+        return 0;
+    }
+    return static_cast<uint64_t>(st.f_blocks - st.f_bfree) * st.f_frsize;
+}
+
+} // namespace
+
 uint8_t RedundancyPriorityUbi::priority(uint8_t value)
 {
-    storeToFile(parent.versionId, value);
+    // Store this priority together with the ones shifted by freePriority()
+    auto& store = static_cast<ItemUpdaterUbi&>(parent.parent).priorityStore;
+    PriorityStore::Transaction transaction(store);
+    store.store(parent.versionId, value);
     return RedundancyPriority::priority(value);
 }
 
@@ -117,6 +140,8 @@ void ActivationUbi::startActivation()
             std::make_unique<ActivationBlocksTransition>(bus, path);
     }
 
+    storeUsedBefore = usedBytes(PARTITION_STORE_DIR);
+
     constexpr auto ubimountService = "obmc-flash-bios-ubimount@";
     auto ubimountServiceFile =
         std::string(ubimountService) + versionId + ".service";
@@ -165,6 +190,31 @@ void ActivationUbi::finishActivation()
 {
     activationProgress->progress(90);
 
+    // A squashfs volume holds the whole image, the partition store only the
+    // partitions no other version had.
+    FlashIoCounts io;
+    std::error_code ec;
+    io.payload = std::filesystem::file_size(
+        std::filesystem::path(IMG_DIR) / versionId / squashFSImage, ec);
+    if (ec)
+    {
+        io.payload = 0;
+    }
+    if (std::filesystem::is_directory(
+            std::filesystem::path(PARTITION_STORE_DIR) / "versions" /
+                versionId,
+            ec))
+    {
+        auto used = usedBytes(PARTITION_STORE_DIR);
+        io.written = used > storeUsedBefore ? used - storeUsedBefore : 0;
+    }
+    else
+    {
+        io.written = io.payload;
+    }
+    io.erased = eraseFootprint("pnor", io.written);
+    flashIo.record("activation", io);
+
     // Set Redundancy Priority before setting to Active
     if (!redundancyPriority)
     {
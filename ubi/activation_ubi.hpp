@@ -2,6 +2,7 @@
 
 #include "activation.hpp"
 
+#include <cstdint>
 #include <string>
 
 namespace openpower
@@ -60,6 +61,10 @@ class ActivationUbi : public Activation
      *created as part of the activation process. **/
     bool ubiVolumesCreated = false;
 
+    /** @brief Bytes used in the partition store when the activation
+     *         started, to account for the partitions it actually wrote. */
+    uint64_t storeUsedBefore = 0;
+
     void unitStateChange(sdbusplus::message_t& msg) override;
     void startActivation() override;
     void finishActivation() override;
@@ -3,7 +3,6 @@
 #include "item_updater_ubi.hpp"
 
 #include "activation_ubi.hpp"
-#include "serialize.hpp"
 #include "utils.hpp"
 #include "version.hpp"
 #include "xyz/openbmc_project/Common/error.hpp"
@@ -12,10 +11,14 @@
 #include <phosphor-logging/log.hpp>
 #include <xyz/openbmc_project/Software/Version/server.hpp>
 
+#include <cerrno>
+#include <chrono>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <queue>
 #include <string>
+#include <thread>
 
 namespace openpower
 {
@@ -30,6 +33,141 @@ namespace server = sdbusplus::xyz::openbmc_project::Software::server;
 using namespace sdbusplus::xyz::openbmc_project::Common::Error;
 using namespace phosphor::logging;
 
+namespace
+{
+
+/** @brief Returns the bytes held by the regular files under a path. */
+uint64_t diskUsage(const std::filesystem::path& path)
+{
+    std::error_code ec;
+    if (std::filesystem::is_regular_file(path, ec))
+    {
+        return std::filesystem::file_size(path, ec);
+    }
+
+    uint64_t total = 0;
+    for (const auto& entry :
+         std::filesystem::recursive_directory_iterator(path, ec))
+    {
+        if (entry.is_regular_file(ec))
+        {
+            total += entry.file_size(ec);
+        }
+    }
+    return total;
+}
+
+} // namespace
+
+bool Trash::isTrash(const std::filesystem::path& path)
+{
+    return path.filename().string().starts_with(prefix);
+}
+
+void Trash::add(const std::filesystem::path& path)
+{
+    entries.push_back(path);
+}
+
+void Trash::prepare()
+{
+    for (const auto& item : entries)
+    {
+        // Renames only work within a filesystem, so each directory gets its
+        // own trash.
+        std::error_code ec;
+        auto dir = std::filesystem::canonical(item.parent_path(), ec);
+        if (ec)
+        {
+            continue;
+        }
+        auto trashDir = dirs.find(dir);
+        if (trashDir == dirs.end())
+        {
+            auto pattern = (dir / prefix).string() + "XXXXXX";
+            if (!mkdtemp(pattern.data()))
+            {
+                log<level::ERR>("Failed to create trash directory",
+                                entry("DIR=%s", dir.c_str()),
+                                entry("ERROR=%s", strerror(errno)));
+                continue;
+            }
+            trashDir = dirs.emplace(dir, pattern).first;
+        }
+        moves.emplace(item, trashDir->second / item.filename());
+    }
+}
+
+void Trash::moveAll()
+{
+    for (const auto& item : entries)
+    {
+        std::error_code ec;
+        auto move = moves.find(item);
+        if (move != moves.end())
+        {
+            std::filesystem::rename(item, move->second, ec);
+            if (!ec)
+            {
+                continue;
+            }
+        }
+        // Fall back to removing the entry in place.
+        std::filesystem::remove_all(item, ec);
+    }
+    entries.clear();
+    moves.clear();
+}
+
+void Trash::purge()
+{
+    std::vector<std::filesystem::path> trashDirs;
+    for (auto& [dir, trashDir] : dirs)
+    {
+        trashDirs.push_back(std::move(trashDir));
+    }
+    dirs.clear();
+    removeAsync(std::move(trashDirs));
+}
+
+void Trash::purgeLeftovers(const std::vector<std::filesystem::path>& dirs)
+{
+    std::vector<std::filesystem::path> trashDirs;
+    for (const auto& dir : dirs)
+    {
+        std::error_code ec;
+        for (const auto& iter : std::filesystem::directory_iterator(dir, ec))
+        {
+            if (isTrash(iter.path()))
+            {
+                trashDirs.push_back(iter.path());
+            }
+        }
+    }
+    removeAsync(std::move(trashDirs));
+}
+
+void Trash::removeAsync(std::vector<std::filesystem::path> trashDirs)
+{
+    if (trashDirs.empty())
+    {
+        return;
+    }
+    std::thread([trashDirs = std::move(trashDirs)]() {
+        for (const auto& dir : trashDirs)
+        {
+            std::error_code ec;
+            std::filesystem::remove_all(dir, ec);
+            if (ec)
+            {
+                log<level::ERR>("Failed to empty trash directory",
+                                entry("DIR=%s", dir.c_str()),
+                                entry("ERROR=%s", ec.message().c_str()));
+            }
+        }
+    }).detach();
+}
+
 std::unique_ptr<Activation> ItemUpdaterUbi::createActivationObject(
     const std::string& path, const std::string& versionId,
     const std::string& extVersion,
@@ -66,8 +204,6 @@ void ItemUpdaterUbi::processPNORImage()
     // to get Active Software Versions.
     for (const auto& iter : std::filesystem::directory_iterator(MEDIA_DIR))
     {
-        auto activationState = server::Activation::Activations::Active;
-
         static const auto PNOR_RO_PREFIX_LEN = strlen(PNOR_RO_PREFIX);
         static const auto PNOR_RW_PREFIX_LEN = strlen(PNOR_RW_PREFIX);
 
@@ -78,78 +214,12 @@ void ItemUpdaterUbi::processPNORImage()
             // The versionId is extracted from the path
             // for example /media/pnor-ro-2a1022fe.
             auto id = iter.path().native().substr(PNOR_RO_PREFIX_LEN);
-            auto pnorTOC = iter.path() / PNOR_TOC_FILE;
-            if (!std::filesystem::is_regular_file(pnorTOC))
+            if (!addReadOnlyVolume(id))
             {
                 log<level::ERR>("Failed to read pnorTOC.",
-                                entry("FILENAME=%s", pnorTOC.c_str()));
+                                entry("DIRNAME=%s", iter.path().c_str()));
                 ItemUpdaterUbi::erase(id);
-                continue;
-            }
-            auto keyValues = Version::getValue(
-                pnorTOC, {{"version", ""}, {"extended_version", ""}});
-            auto& version = keyValues.at("version");
-            if (version.empty())
-            {
-                log<level::ERR>("Failed to read version from pnorTOC",
-                                entry("FILENAME=%s", pnorTOC.c_str()));
-                activationState = server::Activation::Activations::Invalid;
-            }
-
-            auto& extendedVersion = keyValues.at("extended_version");
-            if (extendedVersion.empty())
-            {
-                log<level::ERR>("Failed to read extendedVersion from pnorTOC",
-                                entry("FILENAME=%s", pnorTOC.c_str()));
-                activationState = server::Activation::Activations::Invalid;
-            }
-
-            auto purpose = server::Version::VersionPurpose::Host;
-            auto path = std::filesystem::path(SOFTWARE_OBJPATH) / id;
-            AssociationList associations = {};
-
-            if (activationState == server::Activation::Activations::Active)
-            {
-                // Create an association to the host inventory item
-                associations.emplace_back(std::make_tuple(
-                    ACTIVATION_FWD_ASSOCIATION, ACTIVATION_REV_ASSOCIATION,
-                    HOST_INVENTORY_PATH));
-
-                // Create an active association since this image is active
-                createActiveAssociation(path);
             }
-
-            // All updateable firmware components must expose the updateable
-            // association.
-            createUpdateableAssociation(path);
-
-            // Create Activation instance for this version.
-            activations.insert(
-                std::make_pair(id, std::make_unique<ActivationUbi>(
-                                       bus, path, *this, id, extendedVersion,
-                                       activationState, associations)));
-
-            // If Active, create RedundancyPriority instance for this version.
-            if (activationState == server::Activation::Activations::Active)
-            {
-                uint8_t priority = std::numeric_limits<uint8_t>::max();
-                if (!restoreFromFile(id, priority))
-                {
-                    log<level::ERR>("Unable to restore priority from file.",
-                                    entry("VERSIONID=%s", id.c_str()));
-                }
-                activations.find(id)->second->redundancyPriority =
-                    std::make_unique<RedundancyPriorityUbi>(
-                        bus, path, *(activations.find(id)->second), priority);
-            }
-
-            // Create Version instance for this version.
-            auto versionPtr = std::make_unique<Version>(
-                bus, path, *this, id, version, purpose, "",
-                std::bind(&ItemUpdaterUbi::erase, this, std::placeholders::_1));
-            versionPtr->deleteObject =
-                std::make_unique<Delete>(bus, path, *versionPtr);
-            versions.insert(std::make_pair(id, std::move(versionPtr)));
         }
         else if (0 == iter.path().native().compare(0, PNOR_RW_PREFIX_LEN,
                                                    PNOR_RW_PREFIX))
@@ -174,6 +244,228 @@ void ItemUpdaterUbi::processPNORImage()
     return;
 }
 
+bool ItemUpdaterUbi::addReadOnlyVolume(const std::string& id)
+{
+    if (activations.find(id) != activations.end())
+    {
+        // Already known, e.g. mounted by its own activation.
+        return true;
+    }
+
+    auto activationState = server::Activation::Activations::Active;
+
+    auto pnorTOC = std::filesystem::path(PNOR_RO_PREFIX + id) / PNOR_TOC_FILE;
+    if (!std::filesystem::is_regular_file(pnorTOC))
+    {
+        return false;
+    }
+    auto keyValues = Version::getValue(
+        pnorTOC, {{"version", ""}, {"extended_version", ""}});
+    auto& version = keyValues.at("version");
+    if (version.empty())
+    {
+        log<level::ERR>("Failed to read version from pnorTOC",
+                        entry("FILENAME=%s", pnorTOC.c_str()));
+        activationState = server::Activation::Activations::Invalid;
+    }
+
+    auto& extendedVersion = keyValues.at("extended_version");
+    if (extendedVersion.empty())
+    {
+        log<level::ERR>("Failed to read extendedVersion from pnorTOC",
+                        entry("FILENAME=%s", pnorTOC.c_str()));
+        activationState = server::Activation::Activations::Invalid;
+    }
+
+    auto purpose = server::Version::VersionPurpose::Host;
+    auto path = std::filesystem::path(SOFTWARE_OBJPATH) / id;
+    AssociationList associations = {};
+
+    if (activationState == server::Activation::Activations::Active)
+    {
+        // Create an association to the host inventory item
+        associations.emplace_back(std::make_tuple(ACTIVATION_FWD_ASSOCIATION,
+                                                  ACTIVATION_REV_ASSOCIATION,
+                                                  HOST_INVENTORY_PATH));
+
+        // Create an active association since this image is active
+        createActiveAssociation(path);
+    }
+
+    // All updateable firmware components must expose the updateable
+    // association.
+    createUpdateableAssociation(path);
+
+    // Create Activation instance for this version.
+    activations.insert(std::make_pair(
+        id, std::make_unique<ActivationUbi>(bus, path, *this, id,
+                                            extendedVersion, activationState,
+                                            associations)));
+
+    // If Active, create RedundancyPriority instance for this version.
+    if (activationState == server::Activation::Activations::Active)
+    {
+        uint8_t priority = std::numeric_limits<uint8_t>::max();
+        if (!priorityStore.restore(id, priority))
+        {
+            log<level::ERR>("Unable to restore priority from file.",
+                            entry("VERSIONID=%s", id.c_str()));
+        }
+        activations.find(id)->second->redundancyPriority =
+            std::make_unique<RedundancyPriorityUbi>(
+                bus, path, *(activations.find(id)->second), priority);
+    }
+
+    // Create Version instance for this version.
+    auto versionPtr = std::make_unique<Version>(
+        bus, path, *this, id, version, purpose, "",
+        std::bind(&ItemUpdaterUbi::erase, this, std::placeholders::_1));
+    versionPtr->deleteObject = std::make_unique<Delete>(bus, path, *versionPtr);
+    versions.insert(std::make_pair(id, std::move(versionPtr)));
+    return true;
+}
+
+void ItemUpdaterUbi::addOrDeferReadOnlyVolume(const std::string& id)
+{
+    if (addReadOnlyVolume(id))
+    {
+        pendingVolumes.erase(id);
+        return;
+    }
+
+    // The mount point is created before the volume is mounted on it, the
+    // volume is looked at again on the next changes.
+    pendingVolumes.insert(id);
+}
+
+void ItemUpdaterUbi::removeReadOnlyVolume(const std::string& id)
+{
+    auto it = activations.find(id);
+    if (it == activations.end() ||
+        it->second->activation() == server::Activation::Activations::Activating)
+    {
+        // Either already erased or being (re)written by its activation.
+        return;
+    }
+
+    log<level::INFO>("Read-only volume disappeared, removing its version",
+                     entry("VERSIONID=%s", id.c_str()));
+
+    // The volume is gone already, only the D-Bus objects remain to be
+    // removed.
+    ItemUpdater::erase(id);
+}
+
+void ItemUpdaterUbi::processFilesystemChanges(
+    const std::vector<WatchChange>& changes)
+{
+    static const auto roPrefix =
+        std::filesystem::path(PNOR_RO_PREFIX).filename().string();
+
+    for (const auto& id : std::set<std::string>(pendingVolumes))
+    {
+        if (std::filesystem::is_directory(PNOR_RO_PREFIX + id))
+        {
+            addOrDeferReadOnlyVolume(id);
+        }
+        else
+        {
+            pendingVolumes.erase(id);
+        }
+    }
+
+    for (const auto& change : changes)
+    {
+        switch (change.event)
+        {
+            case WatchEvent::Overflow:
+            {
+                // Reconcile the whole state: drop the versions whose volume
+                // vanished, then pick up the new ones. Unlike the startup
+                // scan, a volume without a TOC is not erased, it may still
+                // be getting mounted.
+                std::vector<std::string> gone;
+                for (const auto& [id, activation] : activations)
+                {
+                    if (activation->activation() ==
+                            server::Activation::Activations::Active &&
+                        !std::filesystem::is_directory(PNOR_RO_PREFIX + id))
+                    {
+                        gone.push_back(id);
+                    }
+                }
+                for (const auto& id : gone)
+                {
+                    removeReadOnlyVolume(id);
+                }
+                for (const auto& iter :
+                     std::filesystem::directory_iterator(MEDIA_DIR))
+                {
+                    auto name = iter.path().filename().string();
+                    if (name.starts_with(roPrefix) && iter.is_directory())
+                    {
+                        addOrDeferReadOnlyVolume(name.substr(roPrefix.size()));
+                    }
+                }
+                auto id = determineId(PNOR_RO_ACTIVE_PATH);
+                if (!id.empty())
+                {
+                    updateFunctionalAssociation(id);
+                }
+                break;
+            }
+            case WatchEvent::VolumeAdded:
+                if (change.name.starts_with(roPrefix))
+                {
+                    addOrDeferReadOnlyVolume(
+                        change.name.substr(roPrefix.size()));
+                }
+                break;
+            case WatchEvent::VolumeRemoved:
+                if (change.name.starts_with(roPrefix))
+                {
+                    auto id = change.name.substr(roPrefix.size());
+                    pendingVolumes.erase(id);
+                    removeReadOnlyVolume(id);
+                }
+                break;
+            case WatchEvent::ImageRemoved:
+            {
+                // An uploaded image that is gone can no longer be activated.
+                auto it = activations.find(change.name);
+                if (it != activations.end() &&
+                    it->second->activation() ==
+                        server::Activation::Activations::Ready)
+                {
+                    log<level::INFO>("Image directory removed",
+                                     entry("VERSIONID=%s",
+                                           change.name.c_str()));
+                    it->second->activation(
+                        server::Activation::Activations::Invalid);
+                }
+                break;
+            }
+            case WatchEvent::ActiveLinkChanged:
+                // Update the functional association on a RO active image
+                // symlink change
+                if (std::filesystem::path(PNOR_RO_ACTIVE_PATH).filename() ==
+                    change.name)
+                {
+                    auto id = determineId(PNOR_RO_ACTIVE_PATH);
+                    if (!id.empty())
+                    {
+                        updateFunctionalAssociation(id);
+                    }
+                }
+                break;
+            case WatchEvent::ImageAdded:
+                // New images are picked up through their Version D-Bus
+                // object instead.
+                break;
+        }
+    }
+}
+
 int ItemUpdaterUbi::validateSquashFSImage(const std::string& filePath)
 {
     auto file = std::filesystem::path(filePath) / squashFSImage;
@@ -210,48 +502,71 @@ void ItemUpdaterUbi::removeReadWritePartition(const std::string& versionId)
     bus.call_noreply(method);
 }
 
-void ItemUpdaterUbi::reset()
+void ItemUpdaterUbi::purgeTrash()
 {
-    utils::hiomapdSuspend(bus);
-
-    constexpr static auto patchDir = "/usr/local/share/pnor";
-    if (std::filesystem::is_directory(patchDir))
+    std::vector<std::filesystem::path> dirs = {"/usr/local/share/pnor",
+                                               PNOR_PRSV};
+    for (const auto& it : activations)
     {
-        for (const auto& iter : std::filesystem::directory_iterator(patchDir))
-        {
-            std::filesystem::remove_all(iter);
-        }
+        dirs.emplace_back(PNOR_RW_PREFIX + it.first);
     }
+    Trash::purgeLeftovers(dirs);
+}
 
-    // Clear the read-write partitions.
-    for (const auto& it : activations)
-    {
-        auto rwDir = PNOR_RW_PREFIX + it.first;
-        if (std::filesystem::is_directory(rwDir))
+void ItemUpdaterUbi::reset()
+{
+    // Enumerate what to delete and create the trash directories up front,
+    // so that the host access to the flash is only suspended for the
+    // renames.
+    Trash trash;
+    FlashIoCounts io;
+
+    auto discard = [&trash, &io](const std::filesystem::path& dir,
+                                 const char* keep = nullptr) {
+        std::error_code ec;
+        if (!std::filesystem::is_directory(dir, ec))
         {
-            for (const auto& iter : std::filesystem::directory_iterator(rwDir))
-            {
-                std::filesystem::remove_all(iter);
-            }
+            return;
         }
-    }
-
-    // Clear the preserved partition, except for SECBOOT that contains keys
-    // provisioned for the system.
-    if (std::filesystem::is_directory(PNOR_PRSV))
-    {
-        for (const auto& iter : std::filesystem::directory_iterator(PNOR_PRSV))
+        for (const auto& iter : std::filesystem::directory_iterator(dir, ec))
         {
-            auto secbootPartition = "SECBOOT";
-            if (iter.path().stem() == secbootPartition)
+            if (Trash::isTrash(iter.path()) ||
+                (keep && iter.path().stem() == keep))
             {
                 continue;
             }
-            std::filesystem::remove_all(iter);
+            // The files removed from the volumes are accounted as erased,
+            // UBIFS reclaims their erase blocks.
+            io.erased += diskUsage(iter);
+            trash.add(iter.path());
         }
+    };
+
+    constexpr static auto patchDir = "/usr/local/share/pnor";
+    discard(patchDir);
+
+    // Clear the read-write partitions.
+    for (const auto& it : activations)
+    {
+        discard(PNOR_RW_PREFIX + it.first);
     }
 
+    // Clear the preserved partition, except for SECBOOT that contains keys
+    // provisioned for the system.
+    discard(PNOR_PRSV, "SECBOOT");
+
+    trash.prepare();
+
+    auto start = std::chrono::steady_clock::now();
+    utils::hiomapdSuspend(bus);
+    trash.moveAll();
     utils::hiomapdResume(bus);
+    io.suspended = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+
+    trash.purge();
+
+    resetFlashIo.record("factory-reset", io);
 }
 
 bool ItemUpdaterUbi::isVersionFunctional(const std::string& versionId)
@@ -280,6 +595,9 @@ bool ItemUpdaterUbi::isVersionFunctional(const std::string& versionId)
 
 void ItemUpdaterUbi::freePriority(uint8_t value, const std::string& versionId)
 {
+    // Persist all the shifted priorities in a single update
+    PriorityStore::Transaction transaction(priorityStore);
+
     //  Versions with the lowest priority in front
     std::priority_queue<std::pair<int, std::string>,
                         std::vector<std::pair<int, std::string>>,
@@ -303,7 +621,7 @@ void ItemUpdaterUbi::freePriority(uint8_t value, const std::string& versionId)
         {
             // Increase priority by 1 and update its value
             ++value;
-            storeToFile(versionsPQ.top().second, value);
+            priorityStore.store(versionsPQ.top().second, value);
             auto it = activations.find(versionsPQ.top().second);
             it->second->redundancyPriority.get()->sdbusplus::xyz::
                 openbmc_project::Software::server::RedundancyPriority::priority(
@@ -321,7 +639,7 @@ bool ItemUpdaterUbi::erase(std::string entryId)
     }
 
     // Remove priority persistence file
-    removeFile(entryId);
+    priorityStore.remove(entryId);
 
     // Removing read-only and read-write partitions
     removeReadWritePartition(entryId);
@@ -424,14 +742,25 @@ void GardResetUbi::reset()
     auto path = std::filesystem::path(PNOR_PRSV_ACTIVE_PATH);
     path /= "GUARD";
 
-    utils::hiomapdSuspend(bus);
-
+    FlashIoCounts io;
+    Trash trash;
     if (std::filesystem::is_regular_file(path))
     {
-        std::filesystem::remove(path);
+        io.erased = diskUsage(path);
+        trash.add(path);
     }
+    trash.prepare();
 
+    auto start = std::chrono::steady_clock::now();
+    utils::hiomapdSuspend(bus);
+    trash.moveAll();
     utils::hiomapdResume(bus);
+    io.suspended = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+
+    trash.purge();
+
+    flashIo.record("guard-reset", io);
 }
 
 } // namespace updater
@@ -1,8 +1,14 @@
 #pragma once
 
 #include "item_updater.hpp"
+#include "serialize.hpp"
+#include "watch.hpp"
 
+#include <filesystem>
+#include <map>
+#include <set>
 #include <string>
+#include <vector>
 
 namespace openpower
 {
@@ -11,6 +17,64 @@ namespace software
 namespace updater
 {
 
+/** @class Trash
+ *  @brief Deletes directory entries in two steps: a rename into a trash
+ *         directory next to them, then the actual removal in the background.
+ *  @details Used to keep the removal work out of the window during which
+ *  hiomapd is suspended. The trash directories are hidden entries of the
+ *  directories they serve, named with a ".trash-" prefix, so that
+ *  leftovers of an interrupted removal are found again on startup.
+ */
+class Trash
+{
+  public:
+    /** @brief Returns whether a directory entry is a trash directory.
+     *
+     * @param[in] path - The path of the entry.
+     */
+    static bool isTrash(const std::filesystem::path& path);
+
+    /** @brief Adds an entry to delete.
+     *
+     * @param[in] path  - The file or directory to delete.
+     */
+    void add(const std::filesystem::path& path);
+
+    /** @brief Creates the trash directories of the added entries. */
+    void prepare();
+
+    /** @brief Renames the added entries into their trash directory,
+     *         removing them in place if that fails.
+     */
+    void moveAll();
+
+    /** @brief Removes the trash directories in a background thread. */
+    void purge();
+
+    /** @brief Removes the trash directories left in the given directories,
+     *         e.g. by a reset interrupted by a reboot, in a background thread.
+     *
+     * @param[in] dirs - The directories to look for trash directories in.
+     */
+    static void purgeLeftovers(const std::vector<std::filesystem::path>& dirs);
+
+  private:
+    /** @brief Removes directories in a detached thread. */
+    static void removeAsync(std::vector<std::filesystem::path> trashDirs);
+
+    /** @brief Name prefix of the trash directories */
+    static constexpr auto prefix = ".trash-";
+
+    /** @brief The entries to delete */
+    std::vector<std::filesystem::path> entries;
+
+    /** @brief The trash directory of each directory holding entries */
+    std::map<std::filesystem::path, std::filesystem::path> dirs;
+
+    /** @brief The destination of each entry in its trash directory */
+    std::map<std::filesystem::path, std::filesystem::path> moves;
+};
+
 class GardResetUbi : public GardReset
 {
   public:
@@ -31,9 +95,10 @@ class ItemUpdaterUbi : public ItemUpdater
 {
   public:
     ItemUpdaterUbi(sdbusplus::bus_t& bus, const std::string& path) :
-        ItemUpdater(bus, path)
+        ItemUpdater(bus, path), priorityStore(bus)
     {
         processPNORImage();
+        purgeTrash();
         gardReset = std::make_unique<GardResetUbi>(bus, GARD_PATH);
         volatileEnable = std::make_unique<ObjectEnable>(bus, volatilePath);
 
@@ -54,6 +119,14 @@ class ItemUpdaterUbi : public ItemUpdater
 
     bool isVersionFunctional(const std::string& versionId) override;
 
+    /** @brief Updates the host versions from filesystem changes, so that
+     *         the D-Bus objects follow the PNOR volumes and symlinks
+     *         without a full rescan.
+     *
+     * @param[in] changes - The changes reported by Watch.
+     */
+    void processFilesystemChanges(const std::vector<WatchChange>& changes);
+
     /** @brief Determine the software version id
      *         from the symlink target (e.g. /media/ro-2a1022fe).
      *
@@ -62,6 +135,9 @@ class ItemUpdaterUbi : public ItemUpdater
      */
     static std::string determineId(const std::string& symlinkPath);
 
+    /** @brief Persistent store of the RedundancyPriority values */
+    PriorityStore priorityStore;
+
   private:
     std::unique_ptr<Activation> createActivationObject(
         const std::string& path, const std::string& versionId,
@@ -106,8 +182,38 @@ class ItemUpdaterUbi : public ItemUpdater
      */
     void removeReadWritePartition(const std::string& versionId);
 
+    /** @brief Creates the D-Bus objects of the version held by a read-only
+     *         volume, unless they exist already.
+     *
+     * @param[in]  id - The version id (e.g. 2a1022fe for
+     *                  /media/pnor-ro-2a1022fe).
+     * @return False if the volume holds no pnor.toc, e.g. when it is not
+     *         mounted yet.
+     */
+    bool addReadOnlyVolume(const std::string& id);
+
+    /** @brief Adds a read-only volume seen by the watch, or keeps it to be
+     *         tried again on the next changes if it is not mounted yet.
+     *
+     * @param[in]  id - The version id.
+     */
+    void addOrDeferReadOnlyVolume(const std::string& id);
+
+    /** @brief Removes the D-Bus objects of a version whose read-only volume
+     *         disappeared.
+     *
+     * @param[in]  id - The version id.
+     */
+    void removeReadOnlyVolume(const std::string& id);
+
+    /** @brief Removes the trash left by interrupted resets. */
+    void purgeTrash();
+
     /** @brief Clears preserved PNOR partition */
     void removePreservedPartition();
+
+    /** @brief The read-only volumes seen without a pnor.toc */
+    std::set<std::string> pendingVolumes;
 };
 
 } // namespace updater
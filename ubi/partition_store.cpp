@@ -0,0 +1,299 @@
+#include "partition_store.hpp"
+
+#include "digest.hpp"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#include <phosphor-logging/log.hpp>
+
+#include <cerrno>
+#include <cstdio>
+#include <set>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+using namespace phosphor::logging;
+namespace fs = std::filesystem;
+
+namespace
+{
+
+/** @brief Prefix of the entries being written, skipped by the lookups */
+constexpr auto tmpPrefix = ".";
+
+/** @brief Throws if a version id could escape the versions directory. */
+void checkVersionId(const std::string& versionId)
+{
+    if (versionId.empty() || versionId.find('/') != std::string::npos ||
+        versionId.starts_with(tmpPrefix))
+    {
+        throw std::invalid_argument("Invalid version id: " + versionId);
+    }
+}
+
+/** @brief Flushes a directory entry to flash. */
+void syncDirectory(const fs::path& dir)
+{
+    auto fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+/** @brief Returns the bytes free for new files on a filesystem. */
+uintmax_t freeSpace(const fs::path& dir)
+{
+    struct statvfs st;
+    if (statvfs(dir.c_str(), &st) < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to stat " + dir.string());
+    }
+    return static_cast<uintmax_t>(st.f_bavail) * st.f_frsize;
+}
+
+/** @class StoreLock
+ *  @brief Serializes the imports and removals, which run from separate
+ *         systemd units.
+ */
+class StoreLock
+{
+  public:
+    StoreLock() = delete;
+    StoreLock(const StoreLock&) = delete;
+    StoreLock& operator=(const StoreLock&) = delete;
+    StoreLock(StoreLock&&) = delete;
+    StoreLock& operator=(StoreLock&&) = delete;
+
+    explicit StoreLock(const fs::path& root) :
+        fd(open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC))
+    {
+        if (fd < 0 || flock(fd, LOCK_EX) < 0)
+        {
+            auto error = errno;
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            throw std::system_error(error, std::generic_category(),
+                                    "Failed to lock " + root.string());
+        }
+    }
+
+    ~StoreLock()
+    {
+        close(fd);
+    }
+
+  private:
+    int fd;
+};
+
+} // namespace
+
+PartitionStore::PartitionStore(const fs::path& root) :
+    root(root), blobs(root / "blobs"), versions(root / "versions")
+{
+    fs::create_directories(blobs);
+    fs::create_directories(versions);
+}
+
+fs::path PartitionStore::versionPath(const std::string& versionId) const
+{
+    checkVersionId(versionId);
+    return versions / versionId;
+}
+
+std::string PartitionStore::digest(const fs::path& file)
+{
+    return fileDigest(file);
+}
+
+ImportStats PartitionStore::importVersion(const std::string& versionId,
+                                          const fs::path& source)
+{
+    auto target = versionPath(versionId);
+    StoreLock lock(root);
+    auto staging = versions / (tmpPrefix + versionId);
+    fs::remove_all(staging);
+    fs::create_directory(staging);
+
+    // The partitions are hashed first, so that a store too small for the
+    // new blobs fails the import before anything is written.
+    std::vector<std::pair<fs::path, std::string>> files;
+    std::set<std::string> newBlobs;
+    uintmax_t needed = 0;
+    for (const auto& file : fs::directory_iterator(source))
+    {
+        if (!file.is_regular_file())
+        {
+            log<level::INFO>("Skipping non-regular file",
+                             entry("FILENAME=%s", file.path().c_str()));
+            continue;
+        }
+
+        auto fileDigest = digest(file.path());
+        if (!fs::exists(blobs / fileDigest) &&
+            newBlobs.insert(fileDigest).second)
+        {
+            needed += file.file_size();
+        }
+        files.emplace_back(file.path(), std::move(fileDigest));
+    }
+
+    auto available = freeSpace(root);
+    if (needed > available)
+    {
+        throw std::runtime_error(
+            "Not enough space in the partition store " + root.string() +
+            ": " + std::to_string(needed) + " bytes needed, " +
+            std::to_string(available) + " available");
+    }
+
+    ImportStats stats;
+    for (const auto& [path, fileDigest] : files)
+    {
+        auto size = fs::file_size(path);
+        auto blob = blobs / fileDigest;
+        if (fs::exists(blob))
+        {
+            stats.bytesShared += size;
+        }
+        else
+        {
+            // Blobs are written aside so that a blob name always refers to
+            // its complete content.
+            auto tmpBlob = blobs / (tmpPrefix + blob.filename().string());
+            fs::copy_file(path, tmpBlob,
+                          fs::copy_options::overwrite_existing);
+            fs::permissions(tmpBlob, fs::perms::owner_read |
+                                         fs::perms::group_read |
+                                         fs::perms::others_read);
+            fs::rename(tmpBlob, blob);
+            stats.bytesWritten += size;
+            ++stats.newBlobs;
+        }
+
+        fs::create_hard_link(blob, staging / path.filename());
+        ++stats.files;
+    }
+
+    // One filesystem sync covers every blob and link written above, then the
+    // index is published in a single rename. An existing index is swapped
+    // with the new one and removed afterwards, a leftover of an interrupted
+    // removal is dropped by the next garbage collection.
+    sync();
+    if (fs::exists(target))
+    {
+        if (renameat2(AT_FDCWD, staging.c_str(), AT_FDCWD, target.c_str(),
+                      RENAME_EXCHANGE) < 0)
+        {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to exchange " + target.string());
+        }
+        syncDirectory(versions);
+        fs::remove_all(staging);
+    }
+    else
+    {
+        fs::rename(staging, target);
+        syncDirectory(versions);
+    }
+
+    log<level::INFO>("Imported host version in the partition store",
+                     entry("VERSIONID=%s", versionId.c_str()),
+                     entry("FILES=%zu", stats.files),
+                     entry("NEW_BLOBS=%zu", stats.newBlobs),
+                     entry("BYTES_WRITTEN=%ju", stats.bytesWritten),
+                     entry("BYTES_SHARED=%ju", stats.bytesShared));
+    return stats;
+}
+
+void PartitionStore::removeVersion(const std::string& versionId)
+{
+    auto target = versionPath(versionId);
+    {
+        // The index is renamed aside first, so that it is either whole or
+        // gone if the removal is interrupted.
+        StoreLock lock(root);
+        std::error_code ec;
+        if (fs::exists(target, ec))
+        {
+            auto removed = versions / (tmpPrefix + versionId);
+            fs::remove_all(removed);
+            fs::rename(target, removed);
+            syncDirectory(versions);
+            fs::remove_all(removed);
+        }
+    }
+    collectGarbage();
+}
+
+size_t PartitionStore::collectGarbage()
+{
+    StoreLock lock(root);
+    size_t removed = 0;
+
+    for (const auto& entry : fs::directory_iterator(versions))
+    {
+        if (entry.path().filename().string().starts_with(tmpPrefix))
+        {
+            fs::remove_all(entry.path());
+        }
+    }
+
+    for (const auto& entry : fs::directory_iterator(blobs))
+    {
+        // Each index entry is a hard link, the last link is the blob itself.
+        std::error_code ec;
+        if (entry.path().filename().string().starts_with(tmpPrefix) ||
+            fs::hard_link_count(entry.path(), ec) == 1)
+        {
+            if (fs::remove(entry.path(), ec))
+            {
+                ++removed;
+            }
+        }
+    }
+
+    if (removed > 0)
+    {
+        sync();
+    }
+    return removed;
+}
+
+void PartitionStore::sync() const
+{
+    auto fd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to open " + root.string());
+    }
+    auto rc = syncfs(fd);
+    auto error = errno;
+    close(fd);
+    if (rc < 0)
+    {
+        throw std::system_error(error, std::generic_category(),
+                                "Failed to sync " + root.string());
+    }
+}
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace openpower
+{
+namespace software
+{
+namespace updater
+{
+
+/** @brief Mount point of the partition store UBIFS volume */
+constexpr auto PARTITION_STORE_DIR = "/media/pnor-store";
+
+/** @struct ImportStats
+ *  @brief Outcome of importing a host version in the PartitionStore.
+ */
+struct ImportStats
+{
+    /** @brief Number of files of the version */
+    size_t files = 0;
+    /** @brief Number of files stored as new blobs */
+    size_t newBlobs = 0;
+    /** @brief Bytes written to the store */
+    uintmax_t bytesWritten = 0;
+    /** @brief Bytes shared with the versions already in the store */
+    uintmax_t bytesShared = 0;
+};
+
+/** @class PartitionStore
+ *  @brief Content-addressed store of the PNOR partition files.
+ *  @details The partition files of every host version (the content of its
+ *  pnor.xz.squashfs image) are stored once per content under
+ *  [root]/blobs/[sha256]. Each version is an index directory
+ *  [root]/versions/[versionId] holding one hard link per file of the
+ *  version, so that a partition which did not change between two releases
+ *  is written to flash once. The index directory is bind mounted on
+ *  /media/pnor-ro-[versionId], which is where hiomapd reads the version
+ *  from. A blob is dropped once no index links to it anymore.
+ */
+class PartitionStore
+{
+  public:
+    PartitionStore() = delete;
+    PartitionStore(const PartitionStore&) = delete;
+    PartitionStore& operator=(const PartitionStore&) = delete;
+    PartitionStore(PartitionStore&&) = delete;
+    PartitionStore& operator=(PartitionStore&&) = delete;
+    ~PartitionStore() = default;
+
+    /** @brief Constructs PartitionStore, creating its directories.
+     *
+     *  @param[in] root - The directory holding the store, usually the mount
+     *                    point of the store UBIFS volume.
+     */
+    explicit PartitionStore(const std::filesystem::path& root);
+
+    /** @brief Adds a host version to the store.
+     *  @details The index of the version is built aside and renamed into
+     *  place once every blob is on flash, so an interrupted import leaves
+     *  no partial version behind. An existing index of the same version is
+     *  replaced. The import fails before writing anything when the store
+     *  has no room for the new blobs.
+     *
+     *  @param[in] versionId - The id of the version.
+     *  @param[in] source - The directory holding the partition files and
+     *                      pnor.toc of the version.
+     *  @return The import statistics.
+     */
+    ImportStats importVersion(const std::string& versionId,
+                              const std::filesystem::path& source);
+
+    /** @brief Removes a host version and the blobs only it used.
+     *
+     *  @param[in] versionId - The id of the version.
+     */
+    void removeVersion(const std::string& versionId);
+
+    /** @brief Removes the blobs no version links to, along with the leftovers
+     *         of interrupted imports.
+     *
+     *  @return The number of blobs removed.
+     */
+    size_t collectGarbage();
+
+    /** @brief Returns the index directory of a version.
+     *
+     *  @param[in] versionId - The id of the version.
+     */
+    std::filesystem::path versionPath(const std::string& versionId) const;
+
+    /** @brief Computes the SHA-256 digest of a file.
+     *
+     *  @param[in] file - The file to hash.
+     *  @return The lowercase hexadecimal digest.
+     */
+    static std::string digest(const std::filesystem::path& file);
+
+  private:
+    /** @brief Flushes the store filesystem to flash. */
+    void sync() const;
+
+    /** @brief The directory holding the store */
+    std::filesystem::path root;
+
+    /** @brief The directory holding the blobs */
+    std::filesystem::path blobs;
+
+    /** @brief The directory holding the version indexes */
+    std::filesystem::path versions;
+};
+
+} // namespace updater
+} // namespace software
+} // namespace openpower
@@ -2,11 +2,19 @@
 
 #include "serialize.hpp"
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <cereal/archives/json.hpp>
-#include <sdbusplus/server.hpp>
+#include <phosphor-logging/log.hpp>
 
+#include <cerrno>
+#include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <sstream>
+#include <system_error>
 
 namespace openpower
 {
@@ -15,122 +23,323 @@ namespace software
 namespace updater
 {
 
-void storeToFile(const std::string& versionId, uint8_t priority)
+using namespace phosphor::logging;
+namespace fs = std::filesystem;
+
+namespace
+{
+
+constexpr auto envVarPrefix = "pnor-";
+
+/** @brief Returns the pnor-[versionId] variables of the u-boot environment.
+ *
+ *  The environment is read once per process. The returned map is kept up to
+ *  date with the changes committed by this process.
+ */
+std::map<std::string, std::string>& ubootEnv()
+{
+    static std::map<std::string, std::string> env = []() {
+        std::map<std::string, std::string> vars;
+        constexpr auto devicePath = "/dev/mtd/u-boot-env";
+        std::error_code ec;
+        if (!fs::exists(devicePath, ec))
+        {
+            return vars;
+        }
+
+        // The environment is a CRC header followed by "name=value\0" entries
+        // and terminated by an empty entry.
+        std::ifstream input(devicePath, std::ios::in | std::ios::binary);
+        std::string content{std::istreambuf_iterator<char>(input),
+                            std::istreambuf_iterator<char>()};
+        std::istringstream entries(content);
+        std::string entry;
+        constexpr size_t maxHeaderSize = 5;
+        for (bool first = true; std::getline(entries, entry, '\0');
+             first = false)
+        {
+            auto pos = entry.find(envVarPrefix);
+            if (pos == std::string::npos || (pos != 0 && !first) ||
+                pos > maxHeaderSize)
+            {
+                continue;
+            }
+            auto eq = entry.find('=', pos);
+            if (eq == std::string::npos)
+            {
+                continue;
+            }
+            vars.emplace(entry.substr(pos, eq - pos), entry.substr(eq + 1));
+        }
+        return vars;
+    }();
+    return env;
+}
+
+/** @brief Replaces a file through a synced temporary file and a rename, so
+ *         that the file holds either the old or the new contents after a
+ *         power loss.
+ */
+void writeFileAtomic(const fs::path& path, const std::string& contents)
 {
-    auto bus = sdbusplus::bus::new_default();
+    auto tmpPath = path;
+    tmpPath += ".tmp";
+
+    auto fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                   0644);
+    if (fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(),
+                                "Failed to create " + tmpPath.string());
+    }
+
+    auto data = contents.data();
+    auto remaining = contents.size();
+    while (remaining > 0)
+    {
+        auto rc = write(fd, data, remaining);
+        if (rc < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (rc < 0)
+        {
+            auto error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(),
+                                    "Failed to write " + tmpPath.string());
+        }
+        data += rc;
+        remaining -= rc;
+    }
 
-    if (!std::filesystem::is_directory(PERSIST_DIR))
+    if (fsync(fd) < 0)
     {
-        std::filesystem::create_directories(PERSIST_DIR);
+        auto error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(),
+                                "Failed to sync " + tmpPath.string());
     }
+    close(fd);
 
-    // store one copy in /var/lib/obmc/openpower-pnor-code-mgmt/[versionId]
-    auto varPath = PERSIST_DIR + versionId;
-    std::ofstream varOutput(varPath.c_str());
-    cereal::JSONOutputArchive varArchive(varOutput);
-    varArchive(cereal::make_nvp("priority", priority));
+    fs::rename(tmpPath, path);
 
-    if (std::filesystem::is_directory(PNOR_RW_PREFIX + versionId))
+    auto dirFd = open(path.parent_path().c_str(),
+                      O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd >= 0)
     {
-        // store another copy in /media/pnor-rw-[versionId]/[versionId]
-        auto rwPath = PNOR_RW_PREFIX + versionId + "/" + versionId;
-        std::ofstream rwOutput(rwPath.c_str());
-        cereal::JSONOutputArchive rwArchive(rwOutput);
-        rwArchive(cereal::make_nvp("priority", priority));
+        fsync(dirFd);
+        close(dirFd);
     }
+}
 
-    // lastly, store the priority as an environment variable pnor-[versionId]
-    std::string serviceFile = "obmc-flash-bmc-setenv@pnor\\x2d" + versionId +
-                              "\\x3d" + std::to_string(priority) + ".service";
-    auto method = bus.new_method_call(SYSTEMD_BUSNAME, SYSTEMD_PATH,
-                                      SYSTEMD_INTERFACE, "StartUnit");
-    method.append(serviceFile, "replace");
-    bus.call_noreply(method);
+/** @brief Returns the JSON document holding a priority. */
+std::string serializePriority(uint8_t priority)
+{
+    std::ostringstream output;
+    {
+        cereal::JSONOutputArchive archive(output);
+        archive(cereal::make_nvp("priority", priority));
+    }
+    return output.str();
 }
 
-bool restoreFromFile(const std::string& versionId, uint8_t& priority)
+/** @brief Reads a priority from a JSON document, removing the file if it
+ *         cannot be parsed.
+ */
+bool deserializePriority(const fs::path& path, uint8_t& priority)
 {
-    auto varPath = PERSIST_DIR + versionId;
-    if (std::filesystem::exists(varPath))
+    std::error_code ec;
+    if (!fs::exists(path, ec))
     {
-        std::ifstream varInput(varPath.c_str(), std::ios::in);
-        try
+        return false;
+    }
+
+    std::ifstream input(path, std::ios::in);
+    try
+    {
+        cereal::JSONInputArchive archive(input);
+        archive(cereal::make_nvp("priority", priority));
+        return true;
+    }
+    catch (const cereal::RapidJSONException& e)
+    {
+        fs::remove(path, ec);
+    }
+    return false;
+}
+
+/** @brief Escapes a path to be used as a systemd unit instance name. */
+std::string escapeUnitPath(const std::string& path)
+{
+    std::string escaped;
+    for (auto c : path.substr(path.find_first_not_of('/')))
+    {
+        if (c == '/')
         {
-            cereal::JSONInputArchive varArchive(varInput);
-            varArchive(cereal::make_nvp("priority", priority));
-            return true;
+            escaped += '-';
         }
-        catch (const cereal::RapidJSONException& e)
+        else if (c == '-')
         {
-            std::filesystem::remove(varPath);
+            escaped += "\\x2d";
+        }
+        else
+        {
+            escaped += c;
         }
     }
+    return escaped;
+}
 
-    auto rwPath = PNOR_RW_PREFIX + versionId + "/" + versionId;
-    if (std::filesystem::exists(rwPath))
+} // namespace
+
+void PriorityStore::store(const std::string& versionId, uint8_t priority)
+{
+    Transaction transaction(*this);
+    pending[versionId] = priority;
+}
+
+void PriorityStore::remove(const std::string& versionId)
+{
+    Transaction transaction(*this);
+    pending[versionId] = std::nullopt;
+}
+
+bool PriorityStore::restore(const std::string& versionId, uint8_t& priority)
+{
+    if (deserializePriority(PERSIST_DIR + versionId, priority) ||
+        deserializePriority(PNOR_RW_PREFIX + versionId + "/" + versionId,
+                            priority))
+    {
+        persisted[versionId] = priority;
+        return true;
+    }
+
+    const auto& env = ubootEnv();
+    auto it = env.find(envVarPrefix + versionId);
+    if (it != env.end())
     {
-        std::ifstream rwInput(rwPath.c_str(), std::ios::in);
         try
         {
-            cereal::JSONInputArchive rwArchive(rwInput);
-            rwArchive(cereal::make_nvp("priority", priority));
+            priority = std::stoi(it->second);
             return true;
         }
-        catch (const cereal::RapidJSONException& e)
-        {
-            std::filesystem::remove(rwPath);
-        }
+        catch (const std::exception& e)
+        {}
     }
 
-    try
+    return false;
+}
+
+void PriorityStore::commit()
+{
+    auto changes = std::move(pending);
+    pending.clear();
+
+    // The u-boot environment script, one "name [value]" line per variable.
+    // A line without a value deletes the variable.
+    std::string envScript;
+    auto& env = ubootEnv();
+    // Only the copies in the pnor-rw volumes are written to the PNOR, the
+    // other copy and the u-boot environment live on the BMC flash.
+    FlashIoCounts io;
+
+    for (const auto& [versionId, priority] : changes)
     {
-        std::string devicePath = "/dev/mtd/u-boot-env";
+        auto varName = envVarPrefix + versionId;
+        auto varPath = fs::path(PERSIST_DIR) / versionId;
+        std::error_code ec;
 
-        if (std::filesystem::exists(devicePath) && !devicePath.empty())
+        if (!priority)
         {
-            std::ifstream input(devicePath.c_str());
-            std::string envVars;
-            std::getline(input, envVars);
+            // Note that the file /media/pnor-rw-[versionId]/[versionId] is
+            // deleted along with its surrounding volume.
+            fs::remove(varPath, ec);
+            persisted.erase(versionId);
+            if (env.erase(varName) > 0)
+            {
+                envScript += varName + "\n";
+            }
+            continue;
+        }
 
-            std::string versionVar = "pnor-" + versionId + "=";
-            auto varPosition = envVars.find(versionVar);
+        auto value = std::to_string(*priority);
+        auto known = persisted.find(versionId);
+        if (known == persisted.end() || known->second != *priority)
+        {
+            try
+            {
+                fs::create_directories(PERSIST_DIR);
+
+                // Store one copy in
+                // /var/lib/obmc/openpower-pnor-code-mgmt/[versionId]
+                auto json = serializePriority(*priority);
+                writeFileAtomic(varPath, json);
 
-            if (varPosition != std::string::npos)
+                // Store another copy in
+                // /media/pnor-rw-[versionId]/[versionId]
+                fs::path rwDir(PNOR_RW_PREFIX + versionId);
+                if (fs::is_directory(rwDir, ec))
+                {
+                    writeFileAtomic(rwDir / versionId, json);
+                    io.payload += json.size();
+                    io.written += json.size();
+                }
+                persisted[versionId] = *priority;
+            }
+            catch (const std::exception& e)
             {
-                // Grab the environment variable for this versionId. These
-                // variables follow the format "pnor-[versionId]=[priority]\0"
-                auto var = envVars.substr(varPosition);
-                priority = std::stoi(var.substr(versionVar.length()));
-                return true;
+                log<level::ERR>("Failed to store priority",
+                                entry("VERSIONID=%s", versionId.c_str()),
+                                entry("ERROR=%s", e.what()));
             }
         }
+
+        auto var = env.find(varName);
+        if (var == env.end() || var->second != value)
+        {
+            env[varName] = value;
+            envScript += varName + " " + value + "\n";
+        }
     }
-    catch (const std::exception& e)
-    {}
 
-    return false;
-}
+    if (io.written > 0)
+    {
+        flashIo.record("priority-update", io);
+    }
 
-void removeFile(const std::string& versionId)
-{
-    auto bus = sdbusplus::bus::new_default();
-
-    // Clear the environment variable pnor-[versionId].
-    std::string serviceFile =
-        "obmc-flash-bmc-setenv@pnor\\x2d" + versionId + ".service";
-    auto method = bus.new_method_call(SYSTEMD_BUSNAME, SYSTEMD_PATH,
-                                      SYSTEMD_INTERFACE, "StartUnit");
-    method.append(serviceFile, "replace");
-    bus.call_noreply(method);
-
-    // Delete the file /var/lib/obmc/openpower-pnor-code-mgmt/[versionId].
-    // Note that removeFile() is called in the case of a version being deleted,
-    // so the file /media/pnor-rw-[versionId]/[versionId] will also be deleted
-    // along with its surrounding directory.
-    std::string path = PERSIST_DIR + versionId;
-    if (std::filesystem::exists(path))
-    {
-        std::filesystem::remove(path);
+    if (envScript.empty())
+    {
+        return;
+    }
+
+    // Lastly, apply all the environment changes with a single fw_setenv run.
+    // Each commit uses its own script so that a unit started by a previous
+    // commit never reads a script it was not started for.
+    try
+    {
+        fs::create_directories(PERSIST_DIR);
+        std::string scriptPath = PERSIST_DIR "pnor-env.XXXXXX";
+        auto fd = mkstemp(scriptPath.data());
+        if (fd < 0)
+        {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Failed to create " + scriptPath);
+        }
+        close(fd);
+        writeFileAtomic(scriptPath, envScript);
+
+        auto serviceFile =
+            "obmc-flash-bios-setenv@" + escapeUnitPath(scriptPath) + ".service";
+        auto method = bus.new_method_call(SYSTEMD_BUSNAME, SYSTEMD_PATH,
+                                          SYSTEMD_INTERFACE, "StartUnit");
+        method.append(serviceFile, "replace");
+        bus.call_noreply(method);
+    }
+    catch (const std::exception& e)
+    {
+        log<level::ERR>("Failed to update the u-boot environment",
+                        entry("ERROR=%s", e.what()));
     }
 }
 
@@ -1,6 +1,12 @@
 #pragma once
 
+#include "flash_io.hpp"
+
+#include <sdbusplus/bus.hpp>
+
 #include <cstdint>
+#include <map>
+#include <optional>
 #include <string>
 
 namespace openpower
@@ -10,23 +16,108 @@ namespace software
 namespace updater
 {
 
-/** @brief Serialization function - stores activation information to file
- *  @param[in] versionId - The version for which to store information.
- *  @param[in] priority - RedundancyPriority value for that version.
+/** @class PriorityStore
+ *  @brief Persists the RedundancyPriority of each host version.
+ *  @details Each priority is kept in PERSIST_DIR, in the read-write volume of
+ *  the version and in the u-boot environment variable pnor-[versionId].
+ *  Changes made while a Transaction is open are applied together when the
+ *  outermost Transaction ends: every file is replaced through a rename and the
+ *  u-boot environment is updated once.
  */
-void storeToFile(const std::string& versionId, uint8_t priority);
+class PriorityStore
+{
+  public:
+    /** @class Transaction
+     *  @brief RAII scope grouping priority changes into a single update.
+     */
+    class Transaction
+    {
+      public:
+        Transaction() = delete;
+        Transaction(const Transaction&) = delete;
+        Transaction& operator=(const Transaction&) = delete;
+        Transaction(Transaction&&) = delete;
+        Transaction& operator=(Transaction&&) = delete;
 
-/** @brief Serialization function - restores activation information from file
- *  @param[in] versionId - The version for which to retrieve information.
- *  @param[in] priority - RedundancyPriority pointer for that version.
- *  @return true if restore was successful, false if not
- */
-bool restoreFromFile(const std::string& versionId, uint8_t& priority);
+        /** @brief Opens a transaction on the given store.
+         *
+         *  @param[in] store - The store to apply the changes to.
+         */
+        explicit Transaction(PriorityStore& store) : store(store)
+        {
+            ++store.depth;
+        }
 
-/** @brief Removes the serial file for a given version.
- *  @param[in] versionId - The version for which to remove a file, if it exists.
- */
-void removeFile(const std::string& versionId);
+        /** @brief Commits the changes if this is the outermost transaction.
+         */
+        ~Transaction()
+        {
+            if (--store.depth == 0)
+            {
+                store.commit();
+            }
+        }
+
+      private:
+        PriorityStore& store;
+    };
+
+    PriorityStore() = delete;
+    PriorityStore(const PriorityStore&) = delete;
+    PriorityStore& operator=(const PriorityStore&) = delete;
+    PriorityStore(PriorityStore&&) = delete;
+    PriorityStore& operator=(PriorityStore&&) = delete;
+    ~PriorityStore() = default;
+
+    /** @brief Constructs PriorityStore
+     *
+     *  @param[in] bus - The D-Bus bus object used to start the systemd unit
+     *                   that updates the u-boot environment.
+     */
+    explicit PriorityStore(sdbusplus::bus_t& bus) :
+        bus(bus), flashIo(bus, PRIORITY_STORE_PATH)
+    {}
+
+    /** @brief Stores the priority of a version.
+     *
+     *  @param[in] versionId - The version for which to store information.
+     *  @param[in] priority - RedundancyPriority value for that version.
+     */
+    void store(const std::string& versionId, uint8_t priority);
+
+    /** @brief Restores the priority of a version.
+     *
+     *  @param[in] versionId - The version for which to retrieve information.
+     *  @param[out] priority - RedundancyPriority value for that version.
+     *  @return true if restore was successful, false if not
+     */
+    bool restore(const std::string& versionId, uint8_t& priority);
+
+    /** @brief Removes the stored priority of a version.
+     *
+     *  @param[in] versionId - The version for which to remove the priority.
+     */
+    void remove(const std::string& versionId);
+
+  private:
+    /** @brief Applies the pending changes. */
+    void commit();
+
+    /** @brief Persistent sdbusplus D-Bus bus connection. */
+    sdbusplus::bus_t& bus;
+
+    /** @brief Nesting depth of the open transactions. */
+    unsigned depth = 0;
+
+    /** @brief Changes to apply on commit, std::nullopt removes the version. */
+    std::map<std::string, std::optional<uint8_t>> pending;
+
+    /** @brief The priorities known to be persisted. */
+    std::map<std::string, uint8_t> persisted;
+
+    /** @brief PNOR flash I/O of the committed updates */
+    FlashIoStatistics flashIo;
+};
 
 } // namespace updater
 } // namespace software
@@ -2,19 +2,21 @@
 
 #include "watch.hpp"
 
-#include "item_updater_ubi.hpp"
-
 #include <sys/inotify.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <phosphor-logging/log.hpp>
 
+#include <cerrno>
 #include <cstddef>
 #include <cstring>
 #include <filesystem>
 #include <functional>
 #include <stdexcept>
 #include <string>
+#include <system_error>
+#include <utility>
 
 namespace openpower
 {
@@ -25,23 +27,42 @@ namespace updater
 
 using namespace phosphor::logging;
 
-Watch::Watch(sd_event* loop,
-             std::function<void(const std::string&)> functionalCallback) :
-    functionalCallback(functionalCallback), fd(inotifyInit())
+Watch::Watch(sd_event* loop, Callback changeCallback,
+             std::chrono::milliseconds delay) :
+    loop(loop), delay(delay), changeCallback(std::move(changeCallback)),
+    fd(inotifyInit())
 
 {
-    // Create PNOR_ACTIVE_PATH if doesn't exist.
-    if (!std::filesystem::is_directory(PNOR_ACTIVE_PATH))
-    {
-        std::filesystem::create_directories(PNOR_ACTIVE_PATH);
-    }
+    constexpr auto dirEvents = IN_CREATE | IN_DELETE | IN_MOVED_TO |
+                               IN_MOVED_FROM | IN_ONLYDIR;
+    targets = {
+        {PNOR_ACTIVE_PATH, "", dirEvents, WatchEvent::ActiveLinkChanged,
+         WatchEvent::ActiveLinkChanged},
+        {MEDIA_DIR, "pnor-", dirEvents, WatchEvent::VolumeAdded,
+         WatchEvent::VolumeRemoved},
+        {IMG_DIR, "", dirEvents, WatchEvent::ImageAdded,
+         WatchEvent::ImageRemoved},
+    };
 
-    wd = inotify_add_watch(fd(), PNOR_ACTIVE_PATH, IN_CREATE);
-    if (-1 == wd)
+    for (size_t i = 0; i < targets.size(); ++i)
     {
-        auto error = errno;
-        throw std::system_error(error, std::generic_category(),
-                                "Error occurred during the inotify_init1");
+        // Create the directories if they don't exist, so that the entries
+        // created later on are seen.
+        std::error_code ec;
+        std::filesystem::create_directories(targets[i].dir, ec);
+
+        auto wd = inotify_add_watch(fd(), targets[i].dir.c_str(),
+                                    targets[i].mask);
+        if (-1 == wd)
+        {
+            // The other directories are still worth watching.
+            auto error = errno;
+            log<level::ERR>("Failed to add inotify watch",
+                            entry("DIR=%s", targets[i].dir.c_str()),
+                            entry("ERROR=%s", strerror(error)));
+            continue;
+        }
+        watches.emplace(wd, i);
     }
 
     decltype(eventSource.get()) sourcePtr = nullptr;
@@ -52,15 +73,32 @@ Watch::Watch(sd_event* loop,
     if (0 > rc)
     {
         throw std::system_error(-rc, std::generic_category(),
-                                "Error occurred during the inotify_init1");
+                                "Error occurred during the sd_event_add_io");
+    }
+
+    // The coalescing timer is armed by the first event of a burst.
+    sourcePtr = nullptr;
+    rc = sd_event_add_time(loop, &sourcePtr, CLOCK_MONOTONIC, 0, 0,
+                           timerCallback, this);
+
+    timerSource.reset(sourcePtr);
+
+    if (0 > rc)
+    {
+        throw std::system_error(-rc, std::generic_category(),
+                                "Error occurred during the sd_event_add_time");
     }
+    sd_event_source_set_enabled(timerSource.get(), SD_EVENT_OFF);
 }
 
 Watch::~Watch()
 {
-    if ((-1 != fd()) && (-1 != wd))
+    if (-1 != fd())
     {
-        inotify_rm_watch(fd(), wd);
+        for (const auto& [wd, target] : watches)
+        {
+            inotify_rm_watch(fd(), wd);
+        }
     }
 }
 
@@ -71,38 +109,162 @@ int Watch::callback(sd_event_source*, int fd, uint32_t revents, void* userdata)
         return 0;
     }
 
-    constexpr auto maxBytes = 1024;
-    uint8_t buffer[maxBytes];
-    auto bytes = read(fd, buffer, maxBytes);
-    if (0 > bytes)
+    auto watch = static_cast<Watch*>(userdata);
+
+    // Large enough for a few hundred events, aligned for inotify_event.
+    constexpr auto maxBytes = 64 * 1024;
+    alignas(inotify_event) static uint8_t buffer[maxBytes];
+
+    while (true)
     {
-        auto error = errno;
-        throw std::system_error(error, std::generic_category(),
-                                "failed to read inotify event");
+        auto bytes = read(fd, buffer, maxBytes);
+        if (0 > bytes)
+        {
+            auto error = errno;
+            if (error == EINTR)
+            {
+                continue;
+            }
+            if (error != EAGAIN)
+            {
+                log<level::ERR>("Failed to read inotify event",
+                                entry("ERROR=%s", strerror(error)));
+            }
+            break;
+        }
+
+        ssize_t offset = 0;
+        while (offset < bytes)
+        {
+            auto event = reinterpret_cast<inotify_event*>(&buffer[offset]);
+            watch->record(*event);
+            offset += offsetof(inotify_event, name) + event->len;
+        }
     }
 
-    auto offset = 0;
-    while (offset < bytes)
+    return 0;
+}
+
+void Watch::record(const inotify_event& event)
+{
+    if (event.mask & IN_Q_OVERFLOW)
+    {
+        overflow = true;
+    }
+    else if (event.mask & IN_IGNORED)
     {
-        auto event = reinterpret_cast<inotify_event*>(&buffer[offset]);
-        // Update the functional association on a RO
-        // active image symlink change
-        std::filesystem::path path(PNOR_ACTIVE_PATH);
-        path /= event->name;
-        if (std::filesystem::equivalent(path, PNOR_RO_ACTIVE_PATH))
+        auto it = watches.find(event.wd);
+        if (it != watches.end())
         {
-            auto id = ItemUpdaterUbi::determineId(path);
-            static_cast<Watch*>(userdata)->functionalCallback(id);
+            log<level::ERR>("inotify watch removed",
+                            entry("DIR=%s", targets[it->second].dir.c_str()));
+            watches.erase(it);
         }
-        offset += offsetof(inotify_event, name) + event->len;
+        return;
+    }
+    else
+    {
+        auto it = watches.find(event.wd);
+        if (it == watches.end() || event.len == 0)
+        {
+            return;
+        }
+        const auto& target = targets[it->second];
+        std::string name(event.name);
+        if (name.compare(0, target.prefix.size(), target.prefix) != 0)
+        {
+            return;
+        }
+        pending.emplace(it->second, std::move(name));
+    }
+
+    // Arm the timer on the first event of a burst, the following events are
+    // delivered along with it.
+    int enabled = SD_EVENT_OFF;
+    sd_event_source_get_enabled(timerSource.get(), &enabled);
+    if (enabled != SD_EVENT_OFF)
+    {
+        return;
     }
 
+    uint64_t now = 0;
+    sd_event_now(loop, CLOCK_MONOTONIC, &now);
+    sd_event_source_set_time(
+        timerSource.get(),
+        now + std::chrono::duration_cast<std::chrono::microseconds>(delay)
+                  .count());
+    sd_event_source_set_enabled(timerSource.get(), SD_EVENT_ONESHOT);
+}
+
+int Watch::timerCallback(sd_event_source*, uint64_t, void* userdata)
+{
+    static_cast<Watch*>(userdata)->dispatch();
     return 0;
 }
 
+void Watch::dispatch()
+{
+    std::vector<WatchChange> changes;
+
+    if (overflow)
+    {
+        // The individual events are meaningless once some were dropped.
+        overflow = false;
+        pending.clear();
+        changes.push_back({WatchEvent::Overflow, {}});
+    }
+    else
+    {
+        std::vector<WatchChange> removed;
+        std::vector<WatchChange> added;
+        std::vector<WatchChange> links;
+
+        for (const auto& [index, name] : pending)
+        {
+            const auto& target = targets[index];
+            auto path = target.dir + "/" + name;
+            struct stat st;
+            bool exists = lstat(path.c_str(), &st) == 0;
+
+            if (target.added == WatchEvent::ActiveLinkChanged)
+            {
+                links.push_back({target.added, name});
+            }
+            else if (exists)
+            {
+                added.push_back({target.added, name});
+            }
+            else
+            {
+                removed.push_back({target.removed, name});
+            }
+        }
+        pending.clear();
+
+        changes = std::move(removed);
+        changes.insert(changes.end(), added.begin(), added.end());
+        changes.insert(changes.end(), links.begin(), links.end());
+    }
+
+    if (changes.empty())
+    {
+        return;
+    }
+
+    try
+    {
+        changeCallback(changes);
+    }
+    catch (const std::exception& e)
+    {
+        log<level::ERR>("Failed to process filesystem changes",
+                        entry("ERROR=%s", e.what()));
+    }
+}
+
 int Watch::inotifyInit()
 {
-    auto fd = inotify_init1(IN_NONBLOCK);
+    auto fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
 
     if (-1 == fd)
     {
@@ -1,11 +1,17 @@
 #pragma once
 
+#include <sys/inotify.h>
 #include <systemd/sd-event.h>
 #include <unistd.h>
 
+#include <chrono>
 #include <functional>
+#include <map>
 #include <memory>
+#include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace openpower
 {
@@ -61,63 +67,158 @@ struct CustomFd
     int fd = -1;
 };
 
+/** @brief The kinds of changes reported by Watch */
+enum class WatchEvent
+{
+    /** @brief A PNOR_ACTIVE_PATH symlink (ro, rw or prsv) was replaced */
+    ActiveLinkChanged,
+    /** @brief A /media/pnor-* mount point appeared */
+    VolumeAdded,
+    /** @brief A /media/pnor-* mount point disappeared */
+    VolumeRemoved,
+    /** @brief An image directory appeared under IMG_DIR */
+    ImageAdded,
+    /** @brief An image directory disappeared from IMG_DIR */
+    ImageRemoved,
+    /** @brief Events were lost, the whole state has to be rescanned */
+    Overflow,
+};
+
+/** @struct WatchChange
+ *  @brief A change reported by Watch.
+ */
+struct WatchChange
+{
+    /** @brief The kind of change */
+    WatchEvent event;
+
+    /** @brief The entry that changed, relative to its watched directory
+     *         (e.g. "ro" or "pnor-ro-2a1022fe"), empty for Overflow.
+     */
+    std::string name;
+};
+
 /** @class Watch
  *
- *  @brief Adds inotify watch on PNOR symlinks file to monitor for changes in
- *         "running" PNOR version
+ *  @brief Adds inotify watches on the PNOR symlinks, the PNOR mount points
+ *         and the image upload directory to monitor the host firmware
+ *         state.
  *
- *  The inotify watch is hooked up with sd-event, so that on call back,
- *  appropriate actions related to a change in the "running" PNOR version
- *  can be taken.
+ *  The inotify watches are hooked up with sd-event. Events arriving in a
+ *  burst are coalesced per entry and delivered once the burst settled, so
+ *  that e.g. the ro, rw and prsv symlinks being replaced one after another
+ *  results in a single callback. The existence of each entry is checked at
+ *  delivery time, so an entry created and removed within a burst is reported
+ *  by its final state only. Removals are delivered before additions and
+ *  symlink changes come last.
  */
 class Watch
 {
   public:
-    /** @brief ctor - hook inotify watch with sd-event
+    using Callback = std::function<void(const std::vector<WatchChange>&)>;
+
+    /** @brief Time during which the events are coalesced */
+    static constexpr auto defaultDelay = std::chrono::milliseconds(100);
+
+    /** @brief ctor - hook inotify watches with sd-event
      *
      *  @param[in] loop - sd-event object
-     *  @param[in] functionalCallback - The callback function for updating
-     *                                  the functional associations.
+     *  @param[in] changeCallback - The callback function receiving the
+     *                              coalesced changes.
+     *  @param[in] delay - Time during which the events are coalesced.
      */
-    Watch(sd_event* loop,
-          std::function<void(const std::string&)> functionalCallback);
+    Watch(sd_event* loop, Callback changeCallback,
+          std::chrono::milliseconds delay = defaultDelay);
 
     Watch(const Watch&) = delete;
     Watch& operator=(const Watch&) = delete;
     Watch(Watch&&) = delete;
     Watch& operator=(Watch&&) = delete;
 
-    /** @brief dtor - remove inotify watch
+    /** @brief dtor - remove inotify watches
      */
     ~Watch();
 
   private:
-    /** @brief sd-event callback
+    /** @struct Target
+     *  @brief A watched directory.
+     */
+    struct Target
+    {
+        /** @brief The watched directory */
+        std::string dir;
+        /** @brief Only the entries starting with this prefix are reported */
+        std::string prefix;
+        /** @brief The inotify events to watch for */
+        uint32_t mask;
+        /** @brief Event reported when an entry exists at delivery time */
+        WatchEvent added;
+        /** @brief Event reported when an entry is gone at delivery time */
+        WatchEvent removed;
+    };
+
+    /** @brief sd-event callback for the inotify fd
      *
      *  @param[in] s - event source, floating (unused) in our case
      *  @param[in] fd - inotify fd
      *  @param[in] revents - events that matched for fd
      *  @param[in] userdata - pointer to Watch object
-     *  @returns 0 on success, -1 on fail
+     *  @returns 0, errors are logged so that the event loop keeps running
      */
     static int callback(sd_event_source* s, int fd, uint32_t revents,
                         void* userdata);
 
+    /** @brief sd-event callback for the coalescing timer
+     *
+     *  @param[in] s - event source
+     *  @param[in] usec - the time the timer elapsed
+     *  @param[in] userdata - pointer to Watch object
+     *  @returns 0
+     */
+    static int timerCallback(sd_event_source* s, uint64_t usec,
+                             void* userdata);
+
     /**  initialize an inotify instance and returns file descriptor */
     int inotifyInit();
 
-    /** @brief PNOR symlink file watch descriptor */
-    int wd = -1;
+    /** @brief Records an inotify event and arms the coalescing timer.
+     *
+     *  @param[in] event - The inotify event
+     */
+    void record(const inotify_event& event);
 
-    /** @brief event source */
-    EventSourcePtr eventSource;
+    /** @brief Delivers the recorded changes to the callback. */
+    void dispatch();
+
+    /** @brief The sd-event loop */
+    sd_event* loop;
+
+    /** @brief The watched directories */
+    std::vector<Target> targets;
 
-    /** @brief The callback function for updating the
-               functional associations. */
-    std::function<void(std::string&)> functionalCallback;
+    /** @brief The watch descriptors and the index of their target */
+    std::map<int, size_t> watches;
+
+    /** @brief The entries changed since the last delivery, per target */
+    std::set<std::pair<size_t, std::string>> pending;
+
+    /** @brief Whether the kernel dropped events since the last delivery */
+    bool overflow = false;
+
+    /** @brief Time during which the events are coalesced */
+    std::chrono::milliseconds delay;
+
+    /** @brief The callback function receiving the changes */
+    Callback changeCallback;
 
     /** @brief inotify file descriptor */
     CustomFd fd;
+
+    /** @brief inotify event source */
+    EventSourcePtr eventSource;
+
+    /** @brief coalescing timer event source */
+    EventSourcePtr timerSource;
 };
 
 } // namespace updater
@@ -175,4 +175,53 @@ void deleteAllErrorLogs(sdbusplus::bus_t& bus)
     }
 }
 
+void logHostFileError(sdbusplus::bus_t& bus, const std::string& file,
+                      uintmax_t current, uintmax_t expected,
+                      const std::string& reason)
+{
+    auto method = bus.new_method_call(
+        "xyz.openbmc_project.Logging", "/xyz/openbmc_project/logging",
+        "xyz.openbmc_project.Logging.Create", "Create");
+    std::map<std::string, std::string> additionalData = {
+        {"FILE_NAME", file},
+        {"CURRENT_FILE_SIZE", std::to_string(current)},
+        {"EXPECTED_FILE_SIZE", std::to_string(expected)}};
+    if (!reason.empty())
+    {
+        additionalData.emplace("REASON", reason);
+    }
+    method.append("xyz.openbmc_project.Software.Version.Error.HostFile",
+                  "xyz.openbmc_project.Logging.Entry.Level.Error",
+                  additionalData);
+
+    try
+    {
+        bus.call_noreply(method);
+    }
+    catch (const sdbusplus::exception_t& e)
+    {
+        log<level::ERR>("Error logging the host file error",
+                        entry("ERROR=%s", e.what()),
+                        entry("FILE_NAME=%s", file.c_str()));
+    }
+}
+
+void createBmcDump(sdbusplus::bus_t& bus)
+{
+    auto method = bus.new_method_call(
+        "xyz.openbmc_project.Dump.Manager", "/xyz/openbmc_project/dump/bmc",
+        "xyz.openbmc_project.Dump.Create", "CreateDump");
+    method.append(std::map<std::string, std::variant<std::string, uint64_t>>());
+
+    try
+    {
+        bus.call_noreply(method);
+    }
+    catch (const sdbusplus::exception_t& e)
+    {
+        log<level::ERR>("Error creating a BMC dump",
+                        entry("ERROR=%s", e.what()));
+    }
+}
+
 } // namespace utils
@@ -9,6 +9,7 @@
 
 #include <sdbusplus/bus.hpp>
 
+#include <cstdint>
 #include <string>
 
 extern "C"
@@ -65,6 +66,25 @@ void setClearNvram(sdbusplus::bus_t& bus);
  */
 void deleteAllErrorLogs(sdbusplus::bus_t& bus);
 
+/** @brief Log a HostFile error for a host firmware file whose size or
+ *         content is not the expected one.
+ *
+ * @param[in] bus      - The D-Bus bus object.
+ * @param[in] file     - The file name.
+ * @param[in] current  - The size of the file.
+ * @param[in] expected - The expected size.
+ * @param[in] reason   - What did not match, e.g. "digest", if not the size.
+ */
+void logHostFileError(sdbusplus::bus_t& bus, const std::string& file,
+                      uintmax_t current, uintmax_t expected,
+                      const std::string& reason = {});
+
+/** @brief Initiate a BMC dump
+ *
+ * @param[in] bus - The D-Bus bus object.
+ */
+void createBmcDump(sdbusplus::bus_t& bus);
+
 } // namespace utils
 
 #endif // OPENSSL_VERSION_NUMBER < 0x10100000L